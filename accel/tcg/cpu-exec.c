@@ -415,6 +415,29 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+/*
+ * The execution count at the head of @tb ran out: drop the block, so
+ * that the next lookup of its pc misses, and have that lookup translate
+ * a trace in its place.  The caller leaves the TB via TB_EXIT_REQUESTED.
+ *
+ * The pc is recorded rather than the cflags of the next TB, because an
+ * interrupt may be taken before execution gets back to it.
+ */
+void HELPER(tb_hot)(CPUArchState *env, void *ptr)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *tb = ptr;
+
+    /* We are at the head of @tb, so the pc is up to date for CF_PCREL */
+    cpu->trace_pc = log_pc(cpu, tb);
+
+    mmap_lock();
+    tb_phys_invalidate(tb, -1);
+    mmap_unlock();
+
+    qatomic_set(&cpu->neg.icount_decr.u16.high, -1);
+}
+
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
 /*
  * Disable CFI checks.
@@ -978,6 +1001,11 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                 CPUJumpCache *jc;
                 uint32_t h;
 
+                if (unlikely(pc == cpu->trace_pc)) {
+                    cpu->trace_pc = -1;
+                    cflags |= CF_TRACE;
+                }
+
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
                 mmap_unlock();
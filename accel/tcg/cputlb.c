@@ -237,6 +237,9 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    desc->large_page_root = (IntervalTreeRoot){ };
+    desc->n_large_pages = 0;
+    desc->large_page_overflow = false;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -473,23 +476,98 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/* Flush every entry of mmu_idx @midx that lies within [@start, @last]. */
+static void tlb_flush_large_page_locked(CPUState *cpu, int midx,
+                                        vaddr start, vaddr last)
+{
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    size_t n_entries = tlb_n_entries(f);
+    vaddr mask = ~(last - start);
+
+    /*
+     * Each page of the large page maps to one entry of the direct-mapped
+     * table, so visit either those entries or the whole table, whichever
+     * is fewer.
+     */
+    if (((last - start) >> TARGET_PAGE_BITS) < n_entries) {
+        for (vaddr i = 0; i <= last - start; i += TARGET_PAGE_SIZE) {
+            CPUTLBEntry *entry = tlb_entry(cpu, midx, start + i);
+
+            if (tlb_flush_entry_mask_locked(entry, start, mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_mask_locked(&f->table[i], start, mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(cpu, midx, start, mask);
+}
+
+static void tlb_remove_large_page(CPUTLBDesc *d, IntervalTreeNode *n)
+{
+    IntervalTreeNode *end = &d->large_pages[--d->n_large_pages];
+
+    /* Keep large_pages[] dense by moving the last element into the hole. */
+    interval_tree_remove(n, &d->large_page_root);
+    if (n != end) {
+        interval_tree_remove(end, &d->large_page_root);
+        n->start = end->start;
+        n->last = end->last;
+        interval_tree_insert(n, &d->large_page_root);
+    }
+}
+
+/*
+ * Flush the large pages of mmu_idx @midx that overlap [@start, @last],
+ * which lies within the large page region.  If we lost track of some
+ * large pages, flush the entire tlb instead and return true.
+ */
+static bool tlb_flush_large_pages_locked(CPUState *cpu, int midx,
+                                         vaddr start, vaddr last)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    IntervalTreeNode *n;
+
+    if (d->large_page_overflow) {
+        tlb_debug("forcing full flush midx %d (%016"
+                  VADDR_PRIx "/%016" VADDR_PRIx ")\n",
+                  midx, d->large_page_addr, d->large_page_mask);
+        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        qatomic_set(&cpu->neg.tlb.c.large_page_flush_count,
+                    cpu->neg.tlb.c.large_page_flush_count + 1);
+        return true;
+    }
+
+    while ((n = interval_tree_iter_first(&d->large_page_root,
+                                         start, last)) != NULL) {
+        tlb_debug("flushing large page midx %d (%016"
+                  VADDR_PRIx "-%016" VADDR_PRIx ")\n",
+                  midx, (vaddr)n->start, (vaddr)n->last);
+        tlb_flush_large_page_locked(cpu, midx, n->start, n->last);
+        tlb_remove_large_page(d, n);
+    }
+    return false;
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
     vaddr lp_mask = cpu->neg.tlb.d[midx].large_page_mask;
 
     /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d (%016"
-                  VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-    } else {
-        if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
-            tlb_n_used_entries_dec(cpu, midx);
-        }
-        tlb_flush_vtlb_page_locked(cpu, midx, page);
+    if ((page & lp_mask) == lp_addr &&
+        tlb_flush_large_pages_locked(cpu, midx, page,
+                                     page + TARGET_PAGE_SIZE - 1)) {
+        return;
     }
+    if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
+        tlb_n_used_entries_dec(cpu, midx);
+    }
+    tlb_flush_vtlb_page_locked(cpu, midx, page);
 }
 
 /**
@@ -721,11 +799,8 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
      * Because large_page_mask contains all 1's from the msb,
      * we only need to test the end of the range.
      */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr &&
+        tlb_flush_large_pages_locked(cpu, midx, addr, addr + len - 1)) {
         return;
     }
 
@@ -1060,28 +1135,53 @@ void tlb_set_dirty(CPUState *cpu, vaddr addr)
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember each large page,
+   and the area covered by all of them, so that we can flush every entry
+   within a large page when any part of it is invalidated.  */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
                                vaddr addr, uint64_t size)
 {
-    vaddr lp_addr = cpu->neg.tlb.d[mmu_idx].large_page_addr;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
+    vaddr lp_addr = d->large_page_addr;
     vaddr lp_mask = ~(size - 1);
+    vaddr start = addr & lp_mask;
+    vaddr last = start + size - 1;
+    IntervalTreeNode *n;
 
     if (lp_addr == (vaddr)-1) {
         /* No previous large page.  */
         lp_addr = addr;
     } else {
         /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= cpu->neg.tlb.d[mmu_idx].large_page_mask;
+           The region is only a quick filter for tlb flushes;
+           the pages within it are tracked individually below.  */
+        lp_mask &= d->large_page_mask;
         while (((lp_addr ^ addr) & lp_mask) != 0) {
             lp_mask <<= 1;
         }
     }
-    cpu->neg.tlb.d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
+    d->large_page_addr = lp_addr & lp_mask;
+    d->large_page_mask = lp_mask;
+
+    if (d->large_page_overflow) {
+        return;
+    }
+    for (n = interval_tree_iter_first(&d->large_page_root, start, last);
+         n != NULL;
+         n = interval_tree_iter_next(n, start, last)) {
+        if (n->start == start && n->last == last) {
+            return;
+        }
+    }
+    if (d->n_large_pages == CPU_TLB_LARGE_PAGES) {
+        /* Until the next full flush, rely on the region alone.  */
+        d->large_page_overflow = true;
+        return;
+    }
+    n = &d->large_pages[d->n_large_pages++];
+    n->start = start;
+    n->last = last;
+    interval_tree_insert(n, &d->large_page_root);
 }
 
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
@@ -1357,6 +1457,24 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
     }
 }
 
+/*
+ * Regions that do not use global locking are dispatched without the BQL;
+ * memory_region_dispatch_*() takes their own lock if they have one.
+ */
+static inline void io_lock(MemoryRegion *mr)
+{
+    if (mr->global_locking) {
+        bql_lock();
+    }
+}
+
+static inline void io_unlock(MemoryRegion *mr)
+{
+    if (mr->global_locking) {
+        bql_unlock();
+    }
+}
+
 /* Return true if ADDR is present in the victim tlb, and has been copied
    back to the main tlb.  */
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
@@ -2030,10 +2148,10 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    bql_lock();
+    io_lock(mr);
     ret = int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
                           type, ra, mr, mr_offset);
-    bql_unlock();
+    io_unlock(mr);
 
     return ret;
 }
@@ -2054,12 +2172,12 @@ static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    bql_lock();
+    io_lock(mr);
     a = int_ld_mmio_beN(cpu, full, ret_be, addr, size - 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset);
     b = int_ld_mmio_beN(cpu, full, ret_be, addr + size - 8, 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset + size - 8);
-    bql_unlock();
+    io_unlock(mr);
 
     return int128_make128(b, a);
 }
@@ -2577,10 +2695,10 @@ static uint64_t do_st_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    bql_lock();
+    io_lock(mr);
     ret = int_st_mmio_leN(cpu, full, val_le, addr, size, mmu_idx,
                           ra, mr, mr_offset);
-    bql_unlock();
+    io_unlock(mr);
 
     return ret;
 }
@@ -2601,12 +2719,12 @@ static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    bql_lock();
+    io_lock(mr);
     int_st_mmio_leN(cpu, full, int128_getlo(val_le), addr, 8,
                     mmu_idx, ra, mr, mr_offset);
     ret = int_st_mmio_leN(cpu, full, int128_gethi(val_le), addr + 8,
                           size - 8, mmu_idx, ra, mr, mr_offset + 8);
-    bql_unlock();
+    io_unlock(mr);
 
     return ret;
 }
@@ -72,6 +72,12 @@ G_NORETURN void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
                               int cflags);
+/*
+ * Make room in a full code buffer by discarding the oldest region of
+ * translations, or everything if there is no region to spare.  Like
+ * tb_flush(), this runs in an exclusive context.
+ */
+void tb_evict(CPUState *cpu);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
@@ -94,6 +100,7 @@ static inline vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
 }
 
 extern bool one_insn_per_tb;
+extern uint32_t tb_trace_threshold;
 
 /**
  * tcg_req_mo:
@@ -126,19 +126,22 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *plarge)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, large = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        large += qatomic_read(&cpu->neg.tlb.c.large_page_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *plarge = large;
 }
 
 static void tcg_dump_info(GString *buf)
@@ -150,7 +153,7 @@ static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, flush_large;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -189,13 +192,22 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
+    g_string_append_printf(buf, "TB flush/evict time %" PRId64 "/%" PRId64
+                           " us (max stall %" PRId64 " us)\n",
+                           qatomic_read_i64(&tb_ctx.tb_flush_time) / SCALE_US,
+                           qatomic_read_i64(&tb_ctx.tb_evict_time) / SCALE_US,
+                           qatomic_read_i64(&tb_ctx.tb_stall_max) / SCALE_US);
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_large);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB large page full flushes %zu\n",
+                           flush_large);
     tcg_dump_info(buf);
 }
 
@@ -217,7 +229,7 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
 
 static void tcg_dump_op_count(GString *buf)
 {
-    g_string_append_printf(buf, "[TCG profiler not compiled]\n");
+    tcg_dump_op_stats(buf);
 }
 
 HumanReadableText *qmp_x_query_opcount(Error **errp)
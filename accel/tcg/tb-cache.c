@@ -0,0 +1,678 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * Translated blocks are saved, together with the TCGRelocRecords that
+ * describe the host addresses embedded in their code, to a file whose
+ * name is a hash of the QEMU build, the guest executable and the CPU
+ * configuration.  Later runs map the file and, when tb_gen_code() misses,
+ * copy and relocate a matching block instead of translating it.
+ *
+ * Blocks are only reused if the guest code they were translated from is
+ * unchanged, so the cache stays correct for shared libraries and JITs
+ * that are not covered by the file name.  Once loaded, a block is an
+ * ordinary TB: writes to its guest pages invalidate it through the usual
+ * page protection mechanism.
+ *
+ * The cache holds host code that is executed as is, so it must only be
+ * used with a directory that no other user can write to.  tb_cache_init()
+ * refuses group- or world-writable directories and files owned by someone
+ * else, and the file carries a SHA-256 checksum so that truncated or
+ * corrupted files are ignored rather than run.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/cacheflush.h"
+#include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "elf.h"
+#include "exec/cpu_ldst.h"
+#include "exec/exec-all.h"
+#include "exec/tb-cache.h"
+#include "host/cpuinfo.h"
+#include "tcg/tcg.h"
+#include "internal-target.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC"
+#define TB_CACHE_VERSION    2
+
+/* Stop recording new blocks once the file would grow beyond this. */
+#define TB_CACHE_MAX_SIZE   (256 * MiB)
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_entries;
+    uint8_t key[32];
+    uint8_t csum[32];           /* see tb_cache_checksum() */
+} TBCacheHeader;
+
+/*
+ * An entry is followed by the guest code, the relocation records and
+ * the host code with its search data, each padded to 8 bytes.
+ */
+typedef struct TBCacheEntry {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    uint16_t size;
+    uint16_t icount;
+    uint16_t nb_relocs;
+    uint16_t jmp_reset_offset[2];
+    uint16_t jmp_insn_offset[2];
+    uint16_t pad;
+    uint32_t code_size;
+    uint32_t search_size;
+} TBCacheEntry;
+
+/* A block translated by this process, not yet in the file. */
+typedef struct TBCachePending {
+    bool dropped;
+    QEMU_ALIGNED(8) uint8_t data[];     /* TBCacheEntry and contents */
+} TBCachePending;
+
+typedef struct TBCache {
+    char *path;
+    uint8_t key[32];
+
+    /* The mapped cache file, and an index of its entries by pc. */
+    void *map;
+    size_t map_size;
+    struct stat map_stat;
+    unsigned nb_entries;
+    const TBCacheEntry **entries;
+    uint32_t *next;             /* 1-based chain of entries with one pc */
+    unsigned long *stale;       /* entries whose guest code has changed */
+    GHashTable *index;          /* pc -> 1-based first entry */
+
+    GPtrArray *pending;
+    GHashTable *pending_tb;     /* TranslationBlock -> TBCachePending */
+    size_t pending_size;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t nb_stale;
+} TBCache;
+
+/* Protected by mmap_lock. */
+static TBCache *tb_cache;
+
+static size_t tb_cache_entry_size(const TBCacheEntry *e)
+{
+    return sizeof(*e) + ROUND_UP(e->size, 8)
+           + e->nb_relocs * sizeof(TCGRelocRecord)
+           + ROUND_UP((size_t)e->code_size + e->search_size, 8);
+}
+
+static const uint8_t *tb_cache_entry_guest(const TBCacheEntry *e)
+{
+    return (const uint8_t *)(e + 1);
+}
+
+static const TCGRelocRecord *tb_cache_entry_relocs(const TBCacheEntry *e)
+{
+    return (const void *)(tb_cache_entry_guest(e) + ROUND_UP(e->size, 8));
+}
+
+static const uint8_t *tb_cache_entry_code(const TBCacheEntry *e)
+{
+    return (const void *)(tb_cache_entry_relocs(e) + e->nb_relocs);
+}
+
+static bool tb_cache_same_key(const TBCacheEntry *a, const TBCacheEntry *b)
+{
+    return a->pc == b->pc && a->cs_base == b->cs_base &&
+           a->flags == b->flags && a->cflags == b->cflags;
+}
+
+/*
+ * SHA-256 over the entries and then the header with a zeroed checksum.
+ * The header includes the key, which covers the build ID of QEMU.
+ */
+static void tb_cache_checksum(GChecksum *sum, const TBCacheHeader *h,
+                              uint8_t *csum)
+{
+    TBCacheHeader copy = *h;
+    gsize len = sizeof(copy.csum);
+
+    memset(copy.csum, 0, sizeof(copy.csum));
+    g_checksum_update(sum, (const guchar *)&copy, sizeof(copy));
+    g_checksum_get_digest(sum, csum, &len);
+}
+
+/* Only trust files that no one but us could have written. */
+static bool tb_cache_trusted(const struct stat *st)
+{
+    return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static void tb_cache_unmap(TBCache *c)
+{
+    if (c->map) {
+        munmap(c->map, c->map_size);
+        c->map = NULL;
+    }
+    c->map_size = 0;
+    c->nb_entries = 0;
+    g_clear_pointer(&c->entries, g_free);
+    g_clear_pointer(&c->next, g_free);
+    g_clear_pointer(&c->stale, g_free);
+    g_hash_table_remove_all(c->index);
+}
+
+/* (Re)load the cache file and index its entries. */
+static void tb_cache_map(TBCache *c)
+{
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    uint8_t csum[32];
+    const TBCacheHeader *h;
+    struct stat st;
+    unsigned i, nb;
+    size_t off;
+    int fd;
+
+    tb_cache_unmap(c);
+
+    fd = open(c->path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return;
+    }
+    c->map_stat = st;
+    if (!S_ISREG(st.st_mode) || !tb_cache_trusted(&st)) {
+        warn_report_once("-tb-cache: ignoring %s, which is not a regular "
+                         "file private to this user", c->path);
+        close(fd);
+        return;
+    }
+    if ((size_t)st.st_size < sizeof(*h)) {
+        close(fd);
+        return;
+    }
+    c->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return;
+    }
+    c->map_size = st.st_size;
+
+    h = c->map;
+    if (memcmp(h->magic, TB_CACHE_MAGIC, sizeof(h->magic)) ||
+        h->version != TB_CACHE_VERSION ||
+        memcmp(h->key, c->key, sizeof(c->key))) {
+        tb_cache_unmap(c);
+        return;
+    }
+    g_checksum_update(sum, c->map + sizeof(*h), c->map_size - sizeof(*h));
+    tb_cache_checksum(sum, h, csum);
+    if (memcmp(h->csum, csum, sizeof(csum))) {
+        tb_cache_unmap(c);
+        return;
+    }
+
+    nb = MIN(h->nb_entries, c->map_size / sizeof(TBCacheEntry));
+    c->entries = g_new(const TBCacheEntry *, nb);
+    c->next = g_new(uint32_t, nb);
+
+    off = sizeof(*h);
+    for (i = 0; i < nb; i++) {
+        const TBCacheEntry *e = c->map + off;
+
+        /* Stop at a malformed entry, the checksum notwithstanding. */
+        if (c->map_size - off < sizeof(*e) ||
+            c->map_size - off < tb_cache_entry_size(e)) {
+            break;
+        }
+        c->entries[i] = e;
+        c->next[i] = GPOINTER_TO_UINT(g_hash_table_lookup(c->index, &e->pc));
+        g_hash_table_insert(c->index, (gpointer)&e->pc,
+                            GUINT_TO_POINTER(i + 1));
+        off += tb_cache_entry_size(e);
+    }
+    c->nb_entries = i;
+    c->stale = bitmap_new(i);
+
+    trace_tb_cache_map(c->path, i);
+}
+
+/* Is there a valid entry in the file identical to @e? */
+static bool tb_cache_find(TBCache *c, const TBCacheEntry *e)
+{
+    unsigned i = GPOINTER_TO_UINT(g_hash_table_lookup(c->index, &e->pc));
+
+    for (; i; i = c->next[i - 1]) {
+        const TBCacheEntry *o = c->entries[i - 1];
+
+        if (!test_bit(i - 1, c->stale) && tb_cache_same_key(o, e) &&
+            o->size == e->size &&
+            !memcmp(tb_cache_entry_guest(o), tb_cache_entry_guest(e),
+                    e->size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Check that the guest code of @e is still mapped and unchanged.
+ * Like translation, this write-protects the pages holding the code.
+ */
+static bool tb_cache_validate(const TBCacheEntry *e, TranslationBlock *tb,
+                              vaddr pc)
+{
+    vaddr last = pc + e->size - 1;
+
+    if (e->size == 0 || e->size > TARGET_PAGE_SIZE ||
+        !page_check_range(pc, e->size, PAGE_EXEC)) {
+        return false;
+    }
+    if ((pc ^ last) & TARGET_PAGE_MASK) {
+        tb_page_addr_t page1 = last & TARGET_PAGE_MASK;
+
+        tb_set_page_addr1(tb, page1);
+        tb_lock_page1(tb_page_addr0(tb), page1);
+    }
+    return !memcmp(g2h_untagged(pc), tb_cache_entry_guest(e), e->size);
+}
+
+/* Copy the host code of @e to the TB being generated and relocate it. */
+static bool tb_cache_install(const TBCacheEntry *e, TranslationBlock *tb)
+{
+    void *rw = tcg_splitwx_to_rw(tb->tc.ptr);
+    size_t size = (size_t)e->code_size + e->search_size;
+
+    if (e->code_size == 0) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        if ((e->jmp_reset_offset[i] != TB_JMP_OFFSET_INVALID &&
+             e->jmp_reset_offset[i] >= e->code_size) ||
+            (e->jmp_insn_offset[i] != TB_JMP_OFFSET_INVALID &&
+             e->jmp_insn_offset[i] + 4 > e->code_size)) {
+            return false;
+        }
+    }
+
+    memcpy(rw, tb_cache_entry_code(e), size);
+    if (!tcg_apply_relocs(rw, tb, tb_cache_entry_relocs(e), e->nb_relocs,
+                          e->code_size)) {
+        return false;
+    }
+    flush_idcache_range((uintptr_t)tb->tc.ptr, (uintptr_t)rw, e->code_size);
+
+    tb->size = e->size;
+    tb->icount = e->icount;
+    tb->tc.size = e->code_size;
+    for (int i = 0; i < 2; i++) {
+        tb->jmp_reset_offset[i] = e->jmp_reset_offset[i];
+        tb->jmp_insn_offset[i] = e->jmp_insn_offset[i];
+    }
+    return true;
+}
+
+int tb_cache_load(TranslationBlock *tb, vaddr pc)
+{
+    TBCache *c = tb_cache;
+    uint64_t key = pc;
+    unsigned i;
+
+    if (!c) {
+        return -1;
+    }
+
+    i = GPOINTER_TO_UINT(g_hash_table_lookup(c->index, &key));
+    for (; i; i = c->next[i - 1]) {
+        const TBCacheEntry *e = c->entries[i - 1];
+
+        if (e->pc != pc || e->cs_base != tb->cs_base ||
+            e->flags != tb->flags || e->cflags != tb->cflags ||
+            test_bit(i - 1, c->stale)) {
+            continue;
+        }
+        /* Leave a full buffer to tb_gen_code(), which flushes it. */
+        if (tcg_splitwx_to_rw(tb->tc.ptr) + e->code_size + e->search_size >
+            tcg_ctx->code_gen_highwater) {
+            break;
+        }
+        if (tb_cache_validate(e, tb, pc) && tb_cache_install(e, tb)) {
+            c->hits++;
+            trace_tb_cache_hit(pc);
+            return e->code_size + e->search_size;
+        }
+        tb_set_page_addr1(tb, -1);
+        set_bit(i - 1, c->stale);
+        c->nb_stale++;
+        trace_tb_cache_stale(pc);
+    }
+    c->misses++;
+    return -1;
+}
+
+void tb_cache_record(TranslationBlock *tb, vaddr pc, int search_size)
+{
+    TBCache *c = tb_cache;
+    GArray *relocs = tcg_ctx->tb_relocs;
+    TBCachePending *p;
+    TBCacheEntry e;
+    size_t size;
+    void *d;
+
+    if (!c || tcg_ctx->tb_uncacheable || relocs->len > UINT16_MAX) {
+        return;
+    }
+
+    e = (TBCacheEntry) {
+        .pc = pc,
+        .cs_base = tb->cs_base,
+        .flags = tb->flags,
+        .cflags = tb->cflags,
+        .size = tb->size,
+        .icount = tb->icount,
+        .nb_relocs = relocs->len,
+        .jmp_reset_offset = { tb->jmp_reset_offset[0],
+                              tb->jmp_reset_offset[1] },
+        .jmp_insn_offset = { tb->jmp_insn_offset[0],
+                             tb->jmp_insn_offset[1] },
+        .code_size = tb->tc.size,
+        .search_size = search_size,
+    };
+    size = tb_cache_entry_size(&e);
+    if (c->map_size + c->pending_size + size > TB_CACHE_MAX_SIZE) {
+        return;
+    }
+
+    p = g_malloc0(sizeof(*p) + size);
+    d = p->data;
+    memcpy(d, &e, sizeof(e));
+    d += sizeof(e);
+    memcpy(d, g2h_untagged(pc), e.size);
+    d += ROUND_UP(e.size, 8);
+    memcpy(d, relocs->data, e.nb_relocs * sizeof(TCGRelocRecord));
+    d += e.nb_relocs * sizeof(TCGRelocRecord);
+    memcpy(d, tcg_splitwx_to_rw(tb->tc.ptr), e.code_size + e.search_size);
+
+    g_ptr_array_add(c->pending, p);
+    g_hash_table_insert(c->pending_tb, tb, p);
+    c->pending_size += size;
+}
+
+/*
+ * Blocks invalidated by this process, typically because the guest wrote
+ * to its own code, are not worth saving.
+ */
+void tb_cache_invalidate(TranslationBlock *tb)
+{
+    TBCache *c = tb_cache;
+    TBCachePending *p;
+
+    if (!c) {
+        return;
+    }
+    p = g_hash_table_lookup(c->pending_tb, tb);
+    if (p) {
+        p->dropped = true;
+        g_hash_table_remove(c->pending_tb, tb);
+    }
+}
+
+/*
+ * A block evicted to make room in the code buffer is still worth saving,
+ * but its TranslationBlock pointer is about to be reused.
+ */
+void tb_cache_evict(TranslationBlock *tb)
+{
+    if (tb_cache) {
+        g_hash_table_remove(tb_cache->pending_tb, tb);
+    }
+}
+
+/* After a flush, TranslationBlock pointers are reused. */
+void tb_cache_flush(void)
+{
+    if (tb_cache) {
+        g_hash_table_remove_all(tb_cache->pending_tb);
+    }
+}
+
+static bool tb_cache_write_entry(FILE *f, GChecksum *sum,
+                                 const TBCacheEntry *e)
+{
+    size_t size = tb_cache_entry_size(e);
+
+    g_checksum_update(sum, (const guchar *)e, size);
+    return fwrite(e, size, 1, f) == 1;
+}
+
+/* Returns the number of entries written, or -1 on error. */
+static int tb_cache_write(TBCache *c, FILE *f)
+{
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    TBCacheHeader h = {
+        .magic = TB_CACHE_MAGIC,
+        .version = TB_CACHE_VERSION,
+    };
+
+    memcpy(h.key, c->key, sizeof(h.key));
+    if (fwrite(&h, sizeof(h), 1, f) != 1) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < c->nb_entries; i++) {
+        const TBCacheEntry *e = c->entries[i];
+
+        if (test_bit(i, c->stale)) {
+            continue;
+        }
+        if (!tb_cache_write_entry(f, sum, e)) {
+            return -1;
+        }
+        h.nb_entries++;
+    }
+
+    for (unsigned i = 0; i < c->pending->len; i++) {
+        TBCachePending *p = g_ptr_array_index(c->pending, i);
+        const TBCacheEntry *e = (const TBCacheEntry *)p->data;
+
+        /* A forked child may save the same blocks as its parent. */
+        if (p->dropped || tb_cache_find(c, e)) {
+            continue;
+        }
+        if (!tb_cache_write_entry(f, sum, e)) {
+            return -1;
+        }
+        h.nb_entries++;
+    }
+
+    /* Finally fill in the number of entries and the checksum. */
+    tb_cache_checksum(sum, &h, h.csum);
+    if (fseek(f, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, f) != 1) {
+        return -1;
+    }
+    return h.nb_entries;
+}
+
+void tb_cache_save(void)
+{
+    TBCache *c = tb_cache;
+    g_autofree char *tmp = NULL;
+    struct stat st;
+    int nb_entries;
+    FILE *f;
+    int fd;
+
+    if (!c) {
+        return;
+    }
+
+    mmap_lock();
+    trace_tb_cache_stats(c->hits, c->misses, c->nb_stale);
+    if (c->pending_size == 0) {
+        goto out;
+    }
+
+    /*
+     * Other processes may have replaced the file since it was mapped:
+     * merge with their blocks rather than dropping them.
+     */
+    if (stat(c->path, &st) == 0 &&
+        (st.st_dev != c->map_stat.st_dev || st.st_ino != c->map_stat.st_ino ||
+         st.st_size != c->map_stat.st_size)) {
+        tb_cache_map(c);
+    }
+
+    tmp = g_strdup_printf("%s.%d", c->path, getpid());
+    unlink(tmp);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        goto out;
+    }
+    f = fdopen(fd, "w");
+    if (!f) {
+        close(fd);
+        unlink(tmp);
+        goto out;
+    }
+    nb_entries = tb_cache_write(c, f);
+    if (fclose(f) != 0) {
+        nb_entries = -1;
+    }
+
+    /* rename() is atomic, so readers see either file in full. */
+    if (nb_entries >= 0 && rename(tmp, c->path) == 0) {
+        trace_tb_cache_save(c->path, nb_entries);
+        g_ptr_array_set_size(c->pending, 0);
+        g_hash_table_remove_all(c->pending_tb);
+        c->pending_size = 0;
+    } else {
+        unlink(tmp);
+    }
+ out:
+    mmap_unlock();
+}
+
+#ifdef TCG_TARGET_RELOC_RECORDS
+static bool tb_cache_hash_file(GChecksum *sum, const char *path)
+{
+    g_autofree uint8_t *buf = g_malloc(64 * KiB);
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    while ((n = read(fd, buf, 64 * KiB)) > 0) {
+        g_checksum_update(sum, buf, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+/* Provided by the linker: the ELF header of the QEMU executable. */
+extern const char __ehdr_start[];
+
+/* Hash the GNU build ID of QEMU itself, or failing that its binary. */
+static bool tb_cache_hash_qemu(GChecksum *sum)
+{
+    const Elf64_Ehdr *eh = (const void *)__ehdr_start;
+    const Elf64_Phdr *ph = (const void *)__ehdr_start + eh->e_phoff;
+    uintptr_t bias = 0;
+    int i;
+
+    for (i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_LOAD && ph[i].p_offset == 0) {
+            bias = (uintptr_t)__ehdr_start - ph[i].p_vaddr;
+            break;
+        }
+    }
+
+    for (i = 0; i < eh->e_phnum; i++) {
+        size_t align = ph[i].p_align == 8 ? 8 : 4;
+        const uint8_t *p, *end;
+
+        if (ph[i].p_type != PT_NOTE) {
+            continue;
+        }
+        p = (const uint8_t *)(bias + ph[i].p_vaddr);
+        end = p + ph[i].p_memsz;
+        while (end - p >= sizeof(Elf64_Nhdr)) {
+            const Elf64_Nhdr *n = (const void *)p;
+            const uint8_t *name = p + sizeof(*n);
+            const uint8_t *desc = p + ROUND_UP(sizeof(*n) + n->n_namesz,
+                                               align);
+
+            if (desc > end || end - desc < n->n_descsz) {
+                break;
+            }
+            if (n->n_type == NT_GNU_BUILD_ID && n->n_namesz == 4 &&
+                !memcmp(name, "GNU", 4)) {
+                g_checksum_update(sum, desc, n->n_descsz);
+                return true;
+            }
+            p += ROUND_UP(desc - p + n->n_descsz, align);
+        }
+    }
+
+    return tb_cache_hash_file(sum, "/proc/self/exe");
+}
+
+static void tb_cache_hash_val(GChecksum *sum, uint64_t val)
+{
+    g_checksum_update(sum, (const guchar *)&val, sizeof(val));
+}
+
+void tb_cache_init(const char *dir, const char *exec_path,
+                   const char *cpu_model)
+{
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize len = sizeof(((TBCache *)NULL)->key);
+    struct stat st;
+    TBCache *c;
+
+    g_mkdir_with_parents(dir, 0700);
+    if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+        !tb_cache_trusted(&st)) {
+        warn_report("-tb-cache: %s must be a directory that only this user "
+                    "can write to, proceeding without translation cache",
+                    dir);
+        return;
+    }
+    if (!tb_cache_hash_qemu(sum) || !tb_cache_hash_file(sum, exec_path)) {
+        warn_report("-tb-cache: could not identify the executables, "
+                    "proceeding without translation cache");
+        return;
+    }
+    g_checksum_update(sum, (const guchar *)cpu_model, strlen(cpu_model));
+    tb_cache_hash_val(sum, guest_base);
+    tb_cache_hash_val(sum, reserved_va);
+    tb_cache_hash_val(sum, qemu_host_page_size);
+#ifdef CPUINFO_ALWAYS
+    tb_cache_hash_val(sum, cpuinfo);
+#endif
+
+    c = g_new0(TBCache, 1);
+    g_checksum_get_digest(sum, c->key, &len);
+    c->path = g_strdup_printf("%s/%s.tbc", dir, g_checksum_get_string(sum));
+    c->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    c->pending = g_ptr_array_new_with_free_func(g_free);
+    c->pending_tb = g_hash_table_new(NULL, NULL);
+    tb_cache_map(c);
+
+    tcg_ctx->tb_relocs = g_array_new(false, false, sizeof(TCGRelocRecord));
+    tb_cache = c;
+}
+#else
+void tb_cache_init(const char *dir, const char *exec_path,
+                   const char *cpu_model)
+{
+    warn_report("-tb-cache is not supported on this host");
+}
+#endif
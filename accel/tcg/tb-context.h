@@ -34,7 +34,12 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_evict_count;
     unsigned tb_phys_invalidate_count;
+    /* time spent with all vCPUs stopped for flush and eviction, in ns */
+    int64_t tb_flush_time;
+    int64_t tb_evict_time;
+    int64_t tb_stall_max;
 };
 
 extern TBContext tb_ctx;
@@ -20,9 +20,11 @@
 #include "qemu/osdep.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
+#include "qemu/timer.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
+#include "exec/tb-cache.h"
 #include "exec/tb-flush.h"
 #include "exec/translate-all.h"
 #include "sysemu/tcg.h"
@@ -31,6 +33,7 @@
 #include "tb-context.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "trace.h"
 
 
 /* List iterators for lists of tagged pointers in TranslationBlock. */
@@ -754,10 +757,20 @@ static void tb_remove(TranslationBlock *tb)
 }
 #endif /* CONFIG_USER_ONLY */
 
+/* Called from an exclusive context; the monitor may read concurrently. */
+static void tb_account_stall(int64_t *total, int64_t ns)
+{
+    qatomic_set_i64(total, *total + ns);
+    if (ns > tb_ctx.tb_stall_max) {
+        qatomic_set_i64(&tb_ctx.tb_stall_max, ns);
+    }
+}
+
 /* flush all the translation blocks */
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
     bool did_flush = false;
+    int64_t start, ns;
 
     mmap_lock();
     /* If it is already been done on request of another CPU, just retry. */
@@ -765,6 +778,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         goto done;
     }
     did_flush = true;
+    start = get_clock();
 
     CPU_FOREACH(cpu) {
         tcg_flush_jmp_cache(cpu);
@@ -772,11 +786,16 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
+    tb_cache_flush();
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
 
+    ns = get_clock() - start;
+    tb_account_stall(&tb_ctx.tb_flush_time, ns);
+    trace_tb_flush_all(tb_ctx.tb_flush_count, ns);
+
 done:
     mmap_unlock();
     if (did_flush) {
@@ -900,8 +919,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ * If @evict is set, the TB is still valid but its code is being reclaimed,
+ * and the caller has already flushed the jump cache of every cpu.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool evict)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -926,9 +948,13 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     if (rm_from_page_list) {
         tb_remove(tb);
     }
-
-    /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (evict) {
+        tb_cache_evict(tb);
+    } else {
+        tb_cache_invalidate(tb);
+        /* remove the TB from the hash list */
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -937,14 +963,16 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
 
-    qatomic_set(&tb_ctx.tb_phys_invalidate_count,
-                tb_ctx.tb_phys_invalidate_count + 1);
+    if (!evict) {
+        qatomic_set(&tb_ctx.tb_phys_invalidate_count,
+                    tb_ctx.tb_phys_invalidate_count + 1);
+    }
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate(tb, true, false);
     qemu_thread_jit_execute();
 }
 
@@ -956,10 +984,80 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate(tb, true, false);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        do_tb_phys_invalidate(tb, false, false);
+    }
+}
+
+static gboolean tb_evict_one(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    size_t *nb_tbs = data;
+
+    if (tb_page_addr0(tb) != -1) {
+        tb_lock_pages(tb);
+        do_tb_phys_invalidate(tb, true, true);
+        tb_unlock_pages(tb);
+    } else {
+        do_tb_phys_invalidate(tb, false, true);
+    }
+    (*nb_tbs)++;
+    return false;
+}
+
+/* Any flush or eviction since @gen was read makes room in the buffer. */
+static unsigned tb_evict_gen(void)
+{
+    return qatomic_read(&tb_ctx.tb_flush_count) +
+           qatomic_read(&tb_ctx.tb_evict_count);
+}
+
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data gen)
+{
+    CPUState *other;
+    size_t nb_tbs = 0;
+    int64_t start, ns;
+    bool evicted;
+
+    mmap_lock();
+    /* If room was made on request of another CPU, just retry. */
+    if (tb_evict_gen() != gen.host_int) {
+        mmap_unlock();
+        return;
+    }
+    start = get_clock();
+
+    CPU_FOREACH(other) {
+        tcg_flush_jmp_cache(other);
+    }
+    qemu_thread_jit_write();
+    evicted = tcg_region_evict(tb_evict_one, &nb_tbs);
+    qemu_thread_jit_execute();
+
+    if (evicted) {
+        qatomic_inc(&tb_ctx.tb_evict_count);
+        ns = get_clock() - start;
+        tb_account_stall(&tb_ctx.tb_evict_time, ns);
+        trace_tb_evict_region(nb_tbs, ns);
+    }
+    mmap_unlock();
+
+    if (!evicted) {
+        /* Every region is still in use by some context. */
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+    }
+}
+
+void tb_evict(CPUState *cpu)
+{
+    unsigned gen = tb_evict_gen();
+
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(gen));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_INT(gen));
     }
 }
 
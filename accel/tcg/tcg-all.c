@@ -47,6 +47,7 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t trace_threshold;
 };
 typedef struct TCGState TCGState;
 
@@ -99,6 +100,7 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+uint32_t tb_trace_threshold;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -207,6 +209,32 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static void tcg_get_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->trace_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->trace_threshold = value;
+    /* Blocks translated from now on pick up the new threshold */
+    qatomic_set(&tb_trace_threshold, value);
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -252,6 +280,13 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add(oc, "trace-threshold", "int",
+        tcg_get_trace_threshold, tcg_set_trace_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "trace-threshold",
+        "Executions of a block before it is retranslated as a trace "
+        "(0 to disable)");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -46,6 +46,7 @@
 #include "exec/cputlb.h"
 #include "exec/translate-all.h"
 #include "exec/translator.h"
+#include "exec/tb-cache.h"
 #include "exec/tb-flush.h"
 #include "qemu/bitmap.h"
 #include "qemu/qemu-print.h"
@@ -296,6 +297,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     int gen_code_size, search_size, max_insns;
     int64_t ti;
     void *host_pc;
+    bool from_cache = false;
 
     assert_memory_lock();
     qemu_thread_jit_write();
@@ -317,8 +319,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -337,6 +339,15 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
         tb_lock_page0(phys_pc);
+
+        /* Reuse a block translated by a previous run, if available. */
+        search_size = tb_cache_load(tb, pc);
+        if (search_size >= 0) {
+            gen_code_size = tb->tc.size;
+            search_size -= gen_code_size;
+            from_cache = true;
+            goto code_ready;
+        }
     }
 
     tcg_ctx->gen_tb = tb;
@@ -355,6 +366,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
  restart_translate:
     trace_translate_block(tb, pc, tb->tc.ptr);
+    tcg_ctx->tb_uncacheable = false;
 
     gen_code_size = setjmp_gen_code(env, tb, pc, host_pc, &max_insns, &ti);
     if (unlikely(gen_code_size < 0)) {
@@ -508,6 +520,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         }
     }
 
+ code_ready:
     qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
         ROUND_UP((uintptr_t)gen_code_buf + gen_code_size + search_size,
                  CODE_GEN_ALIGN));
@@ -538,6 +551,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         return tb;
     }
 
+    /*
+     * A trace takes the place of the block at its pc: from now on it is
+     * looked up with the same cflags as that block.
+     */
+    tb->cflags &= ~CF_TRACE;
+
     /*
      * Insert TB into the corresponding region tree before publishing it
      * through QHT. Otherwise rewinding happened in the TB might fail to
@@ -561,6 +580,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+    if (!from_cache) {
+        tb_cache_record(tb, pc, search_size);
+    }
     return tb;
 }
 
@@ -112,6 +112,76 @@ static void gen_tb_end(const TranslationBlock *tb, uint32_t cflags,
     }
 }
 
+/* Cap on the forward branches followed by a single trace. */
+#define TRACE_MAX_EDGES  8
+
+/*
+ * Count down the executions of a block that may become the head of a
+ * trace.  When the count runs out, tb_hot drops the block and asks for
+ * a trace to be built in its place at the next lookup.
+ */
+static void gen_tb_hot_count(DisasContextBase *db, uint32_t threshold)
+{
+    TCGv_ptr ptr = tcg_constant_ptr(&db->tb->hot_count);
+    TCGv_i32 count = tcg_temp_new_i32();
+    TCGLabel *cold = gen_new_label();
+
+    db->tb->hot_count = threshold;
+
+    tcg_gen_ld_i32(count, ptr, 0);
+    tcg_gen_subi_i32(count, count, 1);
+    tcg_gen_st_i32(count, ptr, 0);
+    tcg_gen_brcondi_i32(TCG_COND_NE, count, 0, cold);
+    gen_helper_tb_hot(tcg_env, tcg_constant_ptr(db->tb));
+    tcg_gen_br(tcg_ctx->exitreq_label);
+    gen_set_label(cold);
+}
+
+static bool translator_want_trace(const TranslatorOps *ops, uint32_t cflags)
+{
+    return ops->trace_continue &&
+           !(cflags & (CF_USE_ICOUNT | CF_NOIRQ | CF_SINGLE_STEP |
+                       CF_NO_GOTO_TB | CF_COUNT_MASK));
+}
+
+TCGLabel *translator_trace_edge(DisasContextBase *db, vaddr dest)
+{
+    if (!db->trace || db->trace_edges < 0 || db->plugin_enabled) {
+        return NULL;
+    }
+    /* Don't follow a branch from an insn which must end the TB. */
+    if (db->is_jmp != DISAS_NEXT && db->is_jmp != DISAS_NORETURN) {
+        return NULL;
+    }
+    if (dest == db->pc_first) {
+        return db->trace_head;
+    }
+    if (db->trace_next || db->trace_edges == 0 ||
+        dest < db->pc_next || !is_same_page(db, dest) ||
+        db->num_insns >= db->max_insns) {
+        return NULL;
+    }
+
+    db->trace_edges--;
+    db->trace_next = gen_new_label();
+    db->trace_dest = dest;
+    return db->trace_next;
+}
+
+int translator_trace_slot(DisasContextBase *db, int n)
+{
+    if (db->trace) {
+        if (db->trace_slots & (1 << n)) {
+            n ^= 1;
+            if (db->trace_slots & (1 << n)) {
+                return -1;
+            }
+        }
+        db->trace_slots |= 1 << n;
+    }
+    return n;
+}
+
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
 {
     /* Suppress goto_tb if requested. */
@@ -128,6 +198,7 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
                      DisasContextBase *db)
 {
     uint32_t cflags = tb_cflags(tb);
+    uint32_t trace_threshold = qatomic_read(&tb_trace_threshold);
     TCGOp *icount_start_insn;
     bool plugin_enabled;
 
@@ -142,10 +213,24 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->saved_can_do_io = -1;
     db->host_addr[0] = host_pc;
     db->host_addr[1] = NULL;
+    db->trace = (cflags & CF_TRACE) && translator_want_trace(ops, cflags);
+    db->trace_edges = TRACE_MAX_EDGES;
+    db->trace_slots = 0;
+    db->trace_head = NULL;
+    db->trace_next = NULL;
 
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
+    /*
+     * A trace loops back to its start, above the check for an exit
+     * request, so that each iteration sees interrupts.
+     */
+    if (db->trace) {
+        db->trace_head = gen_new_label();
+        gen_set_label(db->trace_head);
+    }
+
     /* Start translating.  */
     icount_start_insn = gen_tb_start(db, cflags);
     ops->tb_start(db, cpu);
@@ -154,6 +239,11 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     plugin_enabled = plugin_gen_tb_start(cpu, db, cflags & CF_MEMI_ONLY);
     db->plugin_enabled = plugin_enabled;
 
+    if (trace_threshold && !plugin_enabled && !(cflags & CF_TRACE) &&
+        translator_want_trace(ops, cflags)) {
+        gen_tb_hot_count(db, trace_threshold);
+    }
+
     while (true) {
         *max_insns = ++db->num_insns;
         ops->insn_start(db, cpu);
@@ -188,11 +278,32 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
             plugin_gen_insn_end();
         }
 
+        /*
+         * Continue a trace at the destination of a branch it followed.
+         * The insn ended with that branch, so all other paths out of it
+         * have been emitted by now, or are by trace_continue.
+         */
+        if (db->trace_next) {
+            tcg_debug_assert(db->is_jmp == DISAS_NORETURN);
+            ops->trace_continue(db, cpu);
+            gen_set_label(db->trace_next);
+            db->trace_next = NULL;
+            db->pc_next = db->trace_dest;
+            db->is_jmp = DISAS_NEXT;
+            db->saved_can_do_io = -1;
+        }
+
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
             break;
         }
 
+        /* A trace must not run off its first page. */
+        if (db->trace && !is_same_page(db, db->pc_next)) {
+            db->is_jmp = DISAS_TOO_MANY;
+            break;
+        }
+
         /* Stop translation if the output buffer is full,
            or we have executed all of the allowed instructions.  */
         if (tcg_op_buf_full() || db->num_insns >= db->max_insns) {
@@ -202,6 +313,7 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     }
 
     /* Emit code to exit the TB, as indicated by db->is_jmp.  */
+    translator_trace_stop(db);
     ops->tb_stop(db, cpu);
     gen_tb_end(tb, cflags, icount_start_insn, db->num_insns);
 
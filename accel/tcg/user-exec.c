@@ -23,6 +23,7 @@
 #include "tcg/tcg.h"
 #include "qemu/bitops.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "exec/cpu_ldst.h"
 #include "exec/translate-all.h"
 #include "exec/helper-proto.h"
@@ -145,6 +146,15 @@ typedef struct PageFlagsNode {
 
 static IntervalTreeRoot pageflags_root;
 
+/*
+ * Lockless lookups in pageflags_root have false negatives while the tree
+ * is being modified (see util/interval-tree.c).  Every batch of changes,
+ * made with mmap_lock held, is bracketed by a write to pageflags_seq, so
+ * that a reader which saw no concurrent change can trust a negative
+ * result without falling back to mmap_lock.
+ */
+static QemuSeqLock pageflags_seq;
+
 static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
 {
     IntervalTreeNode *n;
@@ -208,15 +218,22 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageFlagsNode *p = pageflags_find(address, address);
+    PageFlagsNode *p;
+    unsigned seq;
 
     /*
-     * See util/interval-tree.c re lockless lookups: no false positives but
-     * there are false negatives.  If we find nothing, retry with the mmap
-     * lock acquired.
+     * Lockless lookups have no false positives.  If we find nothing and
+     * the tree was modified meanwhile, retry with the mmap lock acquired.
      */
-    if (p) {
-        return p->flags;
+    WITH_RCU_READ_LOCK_GUARD() {
+        seq = seqlock_read_begin(&pageflags_seq);
+        p = pageflags_find(address, address);
+        if (p) {
+            return qatomic_read(&p->flags);
+        }
+        if (!seqlock_read_retry(&pageflags_seq, seq)) {
+            return 0;
+        }
     }
     if (have_mmap_lock()) {
         return 0;
@@ -376,7 +393,7 @@ static bool pageflags_set_clear(target_ulong start, target_ulong last,
      */
     if (start == p_start && last == p_last) {
         if (merge_flags) {
-            p->flags = merge_flags;
+            qatomic_set(&p->flags, merge_flags);
         } else {
             interval_tree_remove(&p->itree, &pageflags_root);
             g_free_rcu(p, rcu);
@@ -421,7 +438,7 @@ static bool pageflags_set_clear(target_ulong start, target_ulong last,
                 }
             } else {
                 if (merge_flags) {
-                    p->flags = merge_flags;
+                    qatomic_set(&p->flags, merge_flags);
                 } else {
                     interval_tree_remove(&p->itree, &pageflags_root);
                     g_free_rcu(p, rcu);
@@ -510,17 +527,74 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
 
     if (!flags || reset) {
         page_reset_target_data(start, last);
+    }
+
+    /* Publish the whole range as one update, however many nodes it has. */
+    seqlock_write_begin(&pageflags_seq);
+    if (!flags || reset) {
         inval_tb |= pageflags_unset(start, last);
     }
     if (flags) {
         inval_tb |= pageflags_set_clear(start, last, flags,
                                         ~(reset ? 0 : PAGE_STICKY));
     }
+    seqlock_write_end(&pageflags_seq);
+
     if (inval_tb) {
         tb_invalidate_phys_range(start, last);
     }
 }
 
+/*
+ * A subroutine of page_check_range: check [start,last] without taking
+ * mmap_lock.  Return 1 or 0 for a definite answer, or -1 if the tree was
+ * modified concurrently or a write-protected page must be unprotected,
+ * in which case the caller must check again with the lock held.
+ */
+static int page_check_range_lockless(target_ulong start, target_ulong last,
+                                     int flags)
+{
+    unsigned seq;
+
+    RCU_READ_LOCK_GUARD();
+
+    seq = seqlock_read_begin(&pageflags_seq);
+    while (true) {
+        PageFlagsNode *p = pageflags_find(start, last);
+        target_ulong p_start, p_last;
+        int p_flags, missing;
+
+        if (!p) {
+            break;
+        }
+        p_start = p->itree.start;
+        p_last = p->itree.last;
+        p_flags = qatomic_read(&p->flags);
+        if (seqlock_read_retry(&pageflags_seq, seq)) {
+            return -1;
+        }
+
+        if (start < p_start) {
+            return 0; /* initial bytes invalid */
+        }
+        missing = flags & ~p_flags;
+        if (missing & ~PAGE_WRITE) {
+            return 0; /* page doesn't match */
+        }
+        if (missing & PAGE_WRITE) {
+            /* Writable but protected pages need page_unprotect. */
+            return p_flags & PAGE_WRITE_ORG ? -1 : 0;
+        }
+        if (last <= p_last) {
+            return 1;
+        }
+        start = p_last + 1;
+    }
+
+    /* Nothing found: trust it only if nothing changed meanwhile. */
+    return seqlock_read_retry(&pageflags_seq, seq) ? -1 : 0;
+}
+
 bool page_check_range(target_ulong start, target_ulong len, int flags)
 {
     target_ulong last;
@@ -537,6 +611,14 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
     }
 
     locked = have_mmap_lock();
+    if (!locked) {
+        int r = page_check_range_lockless(start, last, flags);
+
+        if (r >= 0) {
+            return r;
+        }
+    }
+
     while (true) {
         PageFlagsNode *p = pageflags_find(start, last);
         int missing;
@@ -678,7 +760,9 @@ void page_protect(tb_page_addr_t address)
     }
 
     if (prot & PAGE_WRITE) {
+        seqlock_write_begin(&pageflags_seq);
         pageflags_set_clear(start, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seq);
         mprotect(g2h_untagged(start), qemu_host_page_size,
                  prot & (PAGE_READ | PAGE_EXEC) ? PROT_READ : PROT_NONE);
     }
@@ -732,7 +816,9 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             start = address & TARGET_PAGE_MASK;
             len = TARGET_PAGE_SIZE;
             prot = p->flags | PAGE_WRITE;
+            seqlock_write_begin(&pageflags_seq);
             pageflags_set_clear(start, start + len - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seq);
             current_tb_invalidated = tb_invalidate_phys_page_unwind(start, pc);
         } else {
             start = address & qemu_host_page_mask;
@@ -747,8 +833,10 @@ int page_unprotect(target_ulong address, uintptr_t pc)
                     prot |= p->flags;
                     if (p->flags & PAGE_WRITE_ORG) {
                         prot |= PAGE_WRITE;
+                        seqlock_write_begin(&pageflags_seq);
                         pageflags_set_clear(addr, addr + TARGET_PAGE_SIZE - 1,
                                             PAGE_WRITE, 0);
+                        seqlock_write_end(&pageflags_seq);
                     }
                 }
                 /*
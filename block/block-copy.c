@@ -22,6 +22,7 @@
 #include "block/reqlist.h"
 #include "sysemu/block-backend.h"
 #include "qemu/units.h"
+#include "qemu/host-utils.h"
 #include "qemu/co-shared-resource.h"
 #include "qemu/coroutine.h"
 #include "qemu/ratelimit.h"
@@ -35,6 +36,8 @@
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
+#define BLOCK_COPY_ADAPT_INTERVAL 100000000LL /* ns */
+#define BLOCK_COPY_LATENCY_BUCKETS 32
 
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
@@ -54,6 +57,11 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /*
+     * Background calls come from block_copy_async(), and give way to the
+     * others (which copy-before-write uses to stall guest writes).
+     */
+    bool background;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
@@ -112,6 +120,38 @@ static int64_t task_end(BlockCopyTask *task)
     return task->req.offset + task->req.bytes;
 }
 
+/*
+ * Adaptive request sizing for background calls, and copy statistics.
+ *
+ * Completed requests are accounted in windows of BLOCK_COPY_ADAPT_INTERVAL.
+ * At the end of each window the limits grow additively (doubling until the
+ * first congestion, like TCP slow start) as long as throughput does not
+ * drop.  If throughput stops improving while the average request latency
+ * grows by more than a quarter, the target is considered congested and
+ * both limits are halved.
+ */
+typedef struct BlockCopyAdaptive {
+    int workers;        /* parallel requests per background call */
+    int64_t chunk;      /* maximum request length for background calls */
+    int max_workers;    /* upper bounds, from the last background call */
+    int64_t max_chunk;
+    bool slow_start;
+
+    /* Current measurement window */
+    int64_t window_start_ns;
+    int64_t window_bytes;
+    int64_t window_requests;
+    int64_t window_latency_ns;
+    uint64_t last_throughput;
+    uint64_t last_latency_ns;
+
+    /* Totals reported by block_copy_get_stats() */
+    int64_t first_start_ns;
+    int64_t last_end_ns;
+    uint64_t copied_bytes;
+    uint64_t latency_hist[BLOCK_COPY_LATENCY_BUCKETS]; /* log2 of us */
+} BlockCopyAdaptive;
+
 typedef struct BlockCopyState {
     /*
      * BdrvChild objects are not owned or managed by block-copy. They are
@@ -154,6 +194,16 @@ typedef struct BlockCopyState {
      * block_copy_reset_unallocated() every time it does.
      */
     bool skip_unallocated; /* atomic */
+    /* Number of running block_copy_common() calls that are not background */
+    int foreground_calls; /* atomic */
+
+    /*
+     * Protected by stats_lock, which unlike @lock can also be taken outside
+     * of coroutine context.
+     */
+    QemuMutex stats_lock;
+    BlockCopyAdaptive adaptive;
+
     /* State fields that use a thread-safe API */
     BdrvDirtyBitmap *copy_bitmap;
     ProgressMeter *progress;
@@ -180,6 +230,133 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+/* Called with lock held */
+static int64_t block_copy_max_adaptive_chunk(BlockCopyState *s)
+{
+    if (s->method == COPY_READ_WRITE_CLUSTER) {
+        return s->cluster_size;
+    }
+    return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_COPY_RANGE),
+               s->max_transfer);
+}
+
+/*
+ * Called with lock held.  Background calls merge adjacent dirty clusters
+ * into requests as long as the adaptive limit, other calls use the fixed
+ * size for the current method.
+ */
+static int64_t block_copy_call_chunk_size(BlockCopyState *s,
+                                          BlockCopyCallState *call_state)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+    int64_t chunk = block_copy_chunk_size(s);
+
+    if (call_state->background) {
+        QEMU_LOCK_GUARD(&s->stats_lock);
+        chunk = MIN(a->chunk, a->max_chunk);
+    }
+
+    return MIN_NON_ZERO(chunk, call_state->max_chunk);
+}
+
+/* Number of requests that a background call may have in flight */
+static int block_copy_call_workers(BlockCopyState *s,
+                                   BlockCopyCallState *call_state)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+
+    /* Keep copy-before-write stalls short: get out of their way */
+    if (qatomic_read(&s->foreground_calls)) {
+        return 1;
+    }
+
+    QEMU_LOCK_GUARD(&s->stats_lock);
+    return MIN(a->workers, a->max_workers);
+}
+
+/*
+ * Called with lock held, when a background call starts.  The limits of the
+ * latest call bound the adaptation.
+ */
+static void block_copy_set_adaptive_limits(BlockCopyState *s,
+                                           BlockCopyCallState *call_state)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+
+    QEMU_LOCK_GUARD(&s->stats_lock);
+    a->max_workers = call_state->max_workers;
+    a->max_chunk = MIN_NON_ZERO(block_copy_max_adaptive_chunk(s),
+                                call_state->max_chunk);
+    a->chunk = MIN(a->chunk, a->max_chunk);
+}
+
+/* Called with stats_lock held, at the end of a measurement window */
+static void block_copy_adapt(BlockCopyState *s, int64_t now)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+    int64_t step = MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER);
+    uint64_t throughput, latency, lo, hi;
+    bool congested;
+
+    mulu64(&lo, &hi, a->window_bytes, NANOSECONDS_PER_SECOND);
+    divu128(&lo, &hi, now - a->window_start_ns);
+    throughput = lo;
+    latency = a->window_latency_ns / a->window_requests;
+
+    congested = a->last_throughput && throughput <= a->last_throughput &&
+                latency > a->last_latency_ns + a->last_latency_ns / 4;
+
+    if (congested) {
+        a->slow_start = false;
+        a->workers = MAX(a->workers / 2, 1);
+        a->chunk = MAX(QEMU_ALIGN_DOWN(a->chunk / 2, s->cluster_size),
+                       s->cluster_size);
+    } else if (throughput >= a->last_throughput && a->max_workers) {
+        if (a->workers < a->max_workers) {
+            a->workers = a->slow_start ? a->workers * 2 : a->workers + 1;
+            a->workers = MIN(a->workers, a->max_workers);
+        } else if (a->chunk < a->max_chunk) {
+            a->chunk = a->slow_start ? a->chunk * 2 : a->chunk + step;
+            a->chunk = MIN(a->chunk, a->max_chunk);
+        }
+    }
+
+    trace_block_copy_adapt(s, throughput, latency, a->workers, a->chunk);
+
+    a->last_throughput = throughput;
+    a->last_latency_ns = latency;
+    a->window_start_ns = now;
+    a->window_bytes = 0;
+    a->window_requests = 0;
+    a->window_latency_ns = 0;
+}
+
+/* Account a successfully copied request of @bytes */
+static void block_copy_account(BlockCopyState *s, int64_t bytes,
+                               int64_t start_ns, int64_t end_ns)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+    int64_t latency = end_ns - start_ns;
+    uint64_t us = latency / SCALE_US;
+    int bucket = us ? MIN(63 - clz64(us), BLOCK_COPY_LATENCY_BUCKETS - 1) : 0;
+
+    QEMU_LOCK_GUARD(&s->stats_lock);
+    if (!a->copied_bytes) {
+        a->first_start_ns = start_ns;
+        a->window_start_ns = start_ns;
+    }
+    a->copied_bytes += bytes;
+    a->last_end_ns = MAX(a->last_end_ns, end_ns);
+    a->latency_hist[bucket]++;
+
+    a->window_bytes += bytes;
+    a->window_requests++;
+    a->window_latency_ns += latency;
+    if (end_ns - a->window_start_ns >= BLOCK_COPY_ADAPT_INTERVAL) {
+        block_copy_adapt(s, end_ns);
+    }
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
  * the beginning of it.
@@ -192,7 +369,7 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
     int64_t max_chunk;
 
     QEMU_LOCK_GUARD(&s->lock);
-    max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    max_chunk = block_copy_call_chunk_size(s, call_state);
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -271,6 +448,7 @@ void block_copy_state_free(BlockCopyState *s)
     ratelimit_destroy(&s->rate_limit);
     bdrv_release_dirty_bitmap(s->copy_bitmap);
     shres_destroy(s->mem);
+    qemu_mutex_destroy(&s->stats_lock);
     g_free(s);
 }
 
@@ -306,6 +484,11 @@ void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
          */
         s->method = use_copy_range ? COPY_RANGE_SMALL : COPY_READ_WRITE;
     }
+
+    /* Background calls start with the request length of the method */
+    WITH_QEMU_LOCK_GUARD(&s->stats_lock) {
+        s->adaptive.chunk = block_copy_chunk_size(s);
+    }
 }
 
 static int64_t block_copy_calculate_cluster_size(BlockDriverState *target,
@@ -415,8 +598,13 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
+        .adaptive = {
+            .workers = 1,
+            .slow_start = true,
+        },
     };
 
+    qemu_mutex_init(&s->stats_lock);
     block_copy_set_copy_opts(s, false, false);
 
     ratelimit_init(&s->rate_limit);
@@ -564,6 +752,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     BlockCopyState *s = t->s;
     bool error_is_read = false;
     BlockCopyMethod method = t->method;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int ret;
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -571,6 +760,12 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
                                  &error_is_read);
     }
 
+    /* Zero writes say nothing about how fast data can be copied */
+    if (ret >= 0 && t->method != COPY_WRITE_ZEROES) {
+        block_copy_account(s, t->req.bytes, start_ns,
+                           qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+    }
+
     WITH_QEMU_LOCK_GUARD(&s->lock) {
         if (s->method == t->method) {
             s->method = method;
@@ -796,6 +991,10 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
         }
+        if (aio && call_state->background) {
+            aio_task_pool_set_max_busy_tasks(aio,
+                    block_copy_call_workers(s, call_state));
+        }
 
         ret = block_copy_task_run(aio, task);
         if (ret < 0) {
@@ -846,8 +1045,15 @@ block_copy_common(BlockCopyCallState *call_state)
 
     qemu_co_mutex_lock(&s->lock);
     QLIST_INSERT_HEAD(&s->calls, call_state, list);
+    if (call_state->background) {
+        block_copy_set_adaptive_limits(s, call_state);
+    }
     qemu_co_mutex_unlock(&s->lock);
 
+    if (!call_state->background) {
+        qatomic_inc(&s->foreground_calls);
+    }
+
     do {
         ret = block_copy_dirty_clusters(call_state);
 
@@ -889,6 +1095,10 @@ block_copy_common(BlockCopyCallState *call_state)
          */
     } while (ret > 0 && !qatomic_read(&call_state->cancelled));
 
+    if (!call_state->background) {
+        qatomic_dec(&s->foreground_calls);
+    }
+
     qatomic_store_release(&call_state->finished, true);
 
     if (call_state->cb) {
@@ -955,6 +1165,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .background = true,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -1029,6 +1240,48 @@ int64_t block_copy_cluster_size(BlockCopyState *s)
     return s->cluster_size;
 }
 
+/* Upper bound of the histogram bucket containing the @pct percentile */
+static uint64_t block_copy_latency_percentile(BlockCopyAdaptive *a, int pct)
+{
+    uint64_t total = 0, rank, seen = 0;
+    int i;
+
+    for (i = 0; i < BLOCK_COPY_LATENCY_BUCKETS; i++) {
+        total += a->latency_hist[i];
+    }
+
+    rank = DIV_ROUND_UP(total * pct, 100);
+    for (i = 0; i < BLOCK_COPY_LATENCY_BUCKETS && rank; i++) {
+        seen += a->latency_hist[i];
+        if (seen >= rank) {
+            return (UINT64_C(2) << i) * SCALE_US;
+        }
+    }
+    return 0;
+}
+
+void block_copy_get_stats(BlockCopyState *s, BlockJobInfoBackup *stats)
+{
+    BlockCopyAdaptive *a = &s->adaptive;
+    uint64_t lo = 0, hi = 0;
+
+    QEMU_LOCK_GUARD(&s->stats_lock);
+
+    if (a->last_end_ns > a->first_start_ns) {
+        mulu64(&lo, &hi, a->copied_bytes, NANOSECONDS_PER_SECOND);
+        divu128(&lo, &hi, a->last_end_ns - a->first_start_ns);
+    }
+
+    *stats = (BlockJobInfoBackup) {
+        .chunk_size = a->chunk,
+        .workers = a->workers,
+        .throughput = lo,
+        .latency_p50 = block_copy_latency_percentile(a, 50),
+        .latency_p90 = block_copy_latency_percentile(a, 90),
+        .latency_p99 = block_copy_latency_percentile(a, 99),
+    };
+}
+
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
 {
     qatomic_set(&s->skip_unallocated, skip);
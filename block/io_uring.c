@@ -16,7 +16,11 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
+#include "block/aio-wait.h"
+#include "exec/memory.h" /* for ram_block_discard_disable() */
 #include "sysemu/block-backend.h"
 #include "trace.h"
 
@@ -26,6 +30,31 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of fixed file slots registered with each ring */
+#define MAX_FIXED_FILES 64
+
+/* The kernel does not accept registered buffers larger than 1 GB */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+
+/*
+ * Memory registered with luring_register_buf().  Each ring registers a
+ * snapshot of these buffers with the kernel and uses READ_FIXED and
+ * WRITE_FIXED for requests that fall within them.  Writers hold the BQL,
+ * the lock protects readers in other threads.
+ *
+ * The kernel pins registered buffers, so discarding guest RAM is disabled
+ * for as long as luring_bufs is not empty.
+ */
+typedef struct LuringBuf {
+    void *host;
+    size_t size;
+    unsigned refcnt;
+} LuringBuf;
+
+static QemuMutex luring_bufs_lock;
+static GArray *luring_bufs; /* LuringBuf sorted by host address */
+static uint64_t luring_bufs_gen;
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -51,6 +80,7 @@ typedef struct LuringQueue {
 
 struct LuringState {
     AioContext *aio_context;
+    QLIST_ENTRY(LuringState) next;  /* in luring_states, while attached */
 
     struct io_uring ring;
 
@@ -58,8 +88,22 @@ struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /* Registered buffers, sorted by address, valid for bufs_gen */
+    struct iovec *bufs;
+    unsigned int nr_bufs;
+    uint64_t bufs_gen;
+
+    /* Fixed file slots, -1 if free */
+    int files[MAX_FIXED_FILES];
+    bool files_registered;
+    bool files_unsupported;
 };
 
+/* Rings attached to an AioContext, protected by the BQL */
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+
 /**
  * luring_resubmit:
  *
@@ -88,6 +132,15 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update read position */
     luringcb->total_read += nread;
+
+    /*
+     * Continue with readv: the registered buffers may have been released
+     * since the request was submitted, see luring_unregister_buf().
+     */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.opcode = IORING_OP_READV;
+        luringcb->sqeq.buf_index = 0;
+    }
     remaining = luringcb->qiov->size - luringcb->total_read;
 
     /* Shorten qiov */
@@ -323,6 +376,142 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+static bool luring_idle(LuringState *s)
+{
+    return s->io_q.in_queue == 0 && s->io_q.in_flight == 0;
+}
+
+/*
+ * Replace the buffers registered with the ring by the current contents of
+ * luring_bufs.  Only called when the ring is idle, so that no request
+ * refers to the old buffer indices.
+ */
+static void luring_release_bufs(LuringState *s)
+{
+    if (s->nr_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        g_free(s->bufs);
+        s->bufs = NULL;
+        s->nr_bufs = 0;
+    }
+}
+
+static void luring_update_bufs(LuringState *s)
+{
+    unsigned int i, n = 0;
+    int ret;
+
+    luring_release_bufs(s);
+
+    qemu_mutex_lock(&luring_bufs_lock);
+    s->bufs_gen = qatomic_read(&luring_bufs_gen);
+    for (i = 0; luring_bufs && i < luring_bufs->len; i++) {
+        LuringBuf *buf = &g_array_index(luring_bufs, LuringBuf, i);
+        n += DIV_ROUND_UP(buf->size, MAX_FIXED_BUF_SIZE);
+    }
+    if (n) {
+        s->bufs = g_new(struct iovec, n);
+    }
+    for (i = 0; n && i < luring_bufs->len; i++) {
+        LuringBuf *buf = &g_array_index(luring_bufs, LuringBuf, i);
+        size_t done;
+
+        for (done = 0; done < buf->size; done += MAX_FIXED_BUF_SIZE) {
+            s->bufs[s->nr_bufs++] = (struct iovec) {
+                .iov_base = buf->host + done,
+                .iov_len = MIN(buf->size - done, MAX_FIXED_BUF_SIZE),
+            };
+        }
+    }
+    qemu_mutex_unlock(&luring_bufs_lock);
+
+    if (!s->nr_bufs) {
+        return;
+    }
+
+    /* Fall back to unregistered buffers, e.g. if RLIMIT_MEMLOCK is too low */
+    ret = io_uring_register_buffers(&s->ring, s->bufs, s->nr_bufs);
+    trace_luring_register_buffers(s, s->nr_bufs, ret);
+    if (ret < 0) {
+        g_free(s->bufs);
+        s->bufs = NULL;
+        s->nr_bufs = 0;
+    }
+}
+
+/* Returns the index of the registered buffer containing @iov, or -1 */
+static int luring_find_buf(LuringState *s, const struct iovec *iov)
+{
+    unsigned int lo = 0, hi = s->nr_bufs;
+
+    if (s->bufs_gen != qatomic_read(&luring_bufs_gen)) {
+        if (!luring_idle(s)) {
+            return -1;
+        }
+        luring_update_bufs(s);
+    }
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        struct iovec *buf = &s->bufs[mid];
+
+        if (iov->iov_base < buf->iov_base) {
+            hi = mid;
+        } else if (iov->iov_base >= buf->iov_base + buf->iov_len) {
+            lo = mid + 1;
+        } else if (iov->iov_base + iov->iov_len <=
+                   buf->iov_base + buf->iov_len) {
+            return mid;
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/* Returns the fixed file slot for @fd, registering it if needed, or -1 */
+static int luring_find_file(LuringState *s, int fd)
+{
+    int i, ret, free_slot = -1;
+
+    if (s->files_unsupported) {
+        return -1;
+    }
+
+    if (!s->files_registered) {
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            s->files[i] = -1;
+        }
+        ret = io_uring_register_files(&s->ring, s->files, MAX_FIXED_FILES);
+        trace_luring_register_files(s, ret);
+        if (ret < 0) {
+            /* Sparse file tables need Linux 5.5 */
+            s->files_unsupported = true;
+            return -1;
+        }
+        s->files_registered = true;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->files[i] == fd) {
+            return i;
+        }
+        if (s->files[i] == -1 && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot == -1) {
+        return -1;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, free_slot, &fd, 1);
+    if (ret < 0) {
+        return -1;
+    }
+    s->files[free_slot] = fd;
+    return free_slot;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -339,19 +528,36 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    QEMUIOVector *qiov = luringcb->qiov;
+    int file = luring_find_file(s, fd);
+    int buf = -1;
+
+    if (file >= 0) {
+        fd = file;
+    }
+
+    /* The fixed buffer opcodes take a single contiguous buffer */
+    if (qiov && qiov->niov == 1) {
+        buf = luring_find_buf(s, &qiov->iov[0]);
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
-        break;
     case QEMU_AIO_ZONE_APPEND:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                      qiov->iov[0].iov_len, offset, buf);
+        } else {
+            io_uring_prep_writev(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                     qiov->iov[0].iov_len, offset, buf);
+        } else {
+            io_uring_prep_readv(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -361,6 +567,9 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (file >= 0) {
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -410,11 +619,21 @@ void luring_detach_aio_context(LuringState *s, AioContext *old_context)
     aio_set_fd_handler(old_context, s->ring.ring_fd,
                        NULL, NULL, NULL, NULL, s);
     qemu_bh_delete(s->completion_bh);
+    QLIST_REMOVE(s, next);
     s->aio_context = NULL;
+
+    /* Unpin guest memory and drop the file references right away */
+    luring_release_bufs(s);
+    s->bufs_gen = 0;
+    if (s->files_registered) {
+        io_uring_unregister_files(&s->ring);
+        s->files_registered = false;
+    }
 }
 
 void luring_attach_aio_context(LuringState *s, AioContext *new_context)
 {
+    QLIST_INSERT_HEAD(&luring_states, s, next);
     s->aio_context = new_context;
     s->completion_bh = aio_bh_new(new_context, qemu_luring_completion_bh, s);
     aio_set_fd_handler(s->aio_context, s->ring.ring_fd,
@@ -446,5 +665,139 @@ void luring_cleanup(LuringState *s)
 {
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
+    g_free(s->bufs);
     g_free(s);
 }
+
+void luring_register_buf(void *host, size_t size)
+{
+    LuringBuf *buf;
+    unsigned int i;
+
+    GLOBAL_STATE_CODE();
+
+    qemu_mutex_lock(&luring_bufs_lock);
+    if (!luring_bufs) {
+        luring_bufs = g_array_new(false, false, sizeof(LuringBuf));
+    }
+    for (i = 0; i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            buf->refcnt++;
+            goto out;
+        }
+        if (buf->host > host) {
+            break;
+        }
+    }
+
+    /*
+     * Pinned memory must not be discarded, e.g. by virtio-mem or
+     * virtio-balloon.  If discards are needed, do without fixed buffers;
+     * luring_unregister_buf() then finds nothing to unregister.
+     */
+    if (luring_bufs->len == 0 && ram_block_discard_disable(true) < 0) {
+        trace_luring_register_buf_discard(host, size);
+        goto out;
+    }
+    g_array_insert_val(luring_bufs, i, ((LuringBuf) {
+        .host = host,
+        .size = size,
+        .refcnt = 1,
+    }));
+    qatomic_inc(&luring_bufs_gen);
+out:
+    qemu_mutex_unlock(&luring_bufs_lock);
+}
+
+static void luring_release_bufs_bh(void *opaque)
+{
+    luring_release_bufs(opaque);
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    LuringState *s;
+    LuringBuf *buf;
+    unsigned int i;
+    bool removed = false;
+
+    GLOBAL_STATE_CODE();
+
+    qemu_mutex_lock(&luring_bufs_lock);
+    for (i = 0; luring_bufs && i < luring_bufs->len; i++) {
+        buf = &g_array_index(luring_bufs, LuringBuf, i);
+        if (buf->host == host && buf->size == size) {
+            if (--buf->refcnt == 0) {
+                g_array_remove_index(luring_bufs, i);
+                qatomic_inc(&luring_bufs_gen);
+                removed = true;
+            }
+            break;
+        }
+    }
+    qemu_mutex_unlock(&luring_bufs_lock);
+
+    if (!removed) {
+        return;
+    }
+
+    /*
+     * Unpin the memory now rather than when each ring next goes idle.
+     * The rings register the remaining buffers again on their own.  Not
+     * done under luring_bufs_lock, which luring_update_bufs() takes.
+     */
+    QLIST_FOREACH(s, &luring_states, next) {
+        aio_wait_bh_oneshot(s->aio_context, luring_release_bufs_bh, s);
+    }
+    if (luring_bufs->len == 0) {
+        ram_block_discard_disable(false);
+    }
+}
+
+typedef struct LuringUnregisterFd {
+    LuringState *s;
+    int fd;
+} LuringUnregisterFd;
+
+static void luring_unregister_fd_bh(void *opaque)
+{
+    LuringUnregisterFd *data = opaque;
+    LuringState *s = data->s;
+    int unused = -1;
+
+    if (!s->files_registered) {
+        return;
+    }
+    for (int i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->files[i] == data->fd) {
+            /* Requests in flight hold their own reference to the file */
+            io_uring_register_files_update(&s->ring, i, &unused, 1);
+            s->files[i] = -1;
+        }
+    }
+}
+
+/*
+ * A fixed file slot holds a reference to the open file, which would keep
+ * it open (and its image locks held) after the fd is closed: free the slot
+ * in every ring.
+ */
+void luring_unregister_fd(int fd)
+{
+    LuringState *s;
+
+    GLOBAL_STATE_CODE();
+
+    trace_luring_unregister_fd(fd);
+    QLIST_FOREACH(s, &luring_states, next) {
+        LuringUnregisterFd data = { .s = s, .fd = fd };
+
+        aio_wait_bh_oneshot(s->aio_context, luring_unregister_fd_bh, &data);
+    }
+}
+
+static void __attribute__((constructor)) luring_bufs_init(void)
+{
+    qemu_mutex_init(&luring_bufs_lock);
+}
@@ -24,17 +24,34 @@
 
 #include "qemu/osdep.h"
 #include "block/block-io.h"
+#include "qemu/host-utils.h"
 #include "qemu/memalign.h"
+#include "qemu/queue.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * Tables are found through a hash of their offset, and unreferenced tables
+ * are kept in two LRU lists for eviction (segmented LRU).  A table starts
+ * out in the probationary segment and is promoted to the protected segment
+ * when it is used again after other tables have been used in between.
+ * Victims are taken from the probationary segment first, so a sequential
+ * scan through the image (e.g. by a backup job or qemu-img convert) only
+ * recycles probationary entries and does not evict the working set.
+ */
+
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    bool     hot;       /* In the protected segment */
+    int      hash_next; /* Next entry in the same bucket, or -1 */
+    QTAILQ_ENTRY(Qcow2CachedTable) next_lru; /* Only while ref == 0 */
 } Qcow2CachedTable;
 
+typedef QTAILQ_HEAD(, Qcow2CachedTable) Qcow2CacheLRU;
+
 struct Qcow2Cache {
     Qcow2CachedTable       *entries;
     struct Qcow2Cache      *depends;
@@ -44,6 +61,19 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    int                    *buckets;
+    unsigned                hash_mask;
+    int                     table_bits;
+
+    Qcow2CacheLRU           probation;
+    Qcow2CacheLRU           protected;
+    int                     protected_count;
+    int                     protected_max;
+
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                evictions;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -71,6 +101,92 @@ static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
     }
 }
 
+static inline unsigned qcow2_cache_bucket(Qcow2Cache *c, uint64_t offset)
+{
+    return (offset >> c->table_bits) & c->hash_mask;
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    for (i = c->buckets[qcow2_cache_bucket(c, offset)]; i >= 0;
+         i = c->entries[i].hash_next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void qcow2_cache_hash_insert(Qcow2Cache *c, int i)
+{
+    unsigned bucket = qcow2_cache_bucket(c, c->entries[i].offset);
+
+    c->entries[i].hash_next = c->buckets[bucket];
+    c->buckets[bucket] = i;
+}
+
+static void qcow2_cache_hash_remove(Qcow2Cache *c, int i)
+{
+    int *p = &c->buckets[qcow2_cache_bucket(c, c->entries[i].offset)];
+
+    while (*p != i) {
+        assert(*p >= 0);
+        p = &c->entries[*p].hash_next;
+    }
+    *p = c->entries[i].hash_next;
+    c->entries[i].hash_next = -1;
+}
+
+static inline Qcow2CacheLRU *qcow2_cache_lru(Qcow2Cache *c,
+                                             Qcow2CachedTable *t)
+{
+    return t->hot ? &c->protected : &c->probation;
+}
+
+/*
+ * Turn an unreferenced entry into an empty one, which is reused before any
+ * other entry.  The caller must have removed it from the hash table.
+ */
+static void qcow2_cache_entry_reset(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    assert(t->ref == 0);
+    QTAILQ_REMOVE(qcow2_cache_lru(c, t), t, next_lru);
+    if (t->hot) {
+        t->hot = false;
+        c->protected_count--;
+    }
+    t->offset = 0;
+    t->lru_counter = 0;
+    QTAILQ_INSERT_HEAD(&c->probation, t, next_lru);
+}
+
+/*
+ * Move an entry that is used again into the protected segment.  If that
+ * makes the segment too large, its least recently used unreferenced entry
+ * goes back to the probationary segment as the most recently used one.
+ */
+static void qcow2_cache_promote(Qcow2Cache *c, Qcow2CachedTable *t)
+{
+    Qcow2CachedTable *old;
+
+    t->hot = true;
+    c->protected_count++;
+
+    if (c->protected_count > c->protected_max) {
+        old = QTAILQ_FIRST(&c->protected);
+        if (old) {
+            QTAILQ_REMOVE(&c->protected, old, next_lru);
+            old->hot = false;
+            c->protected_count--;
+            QTAILQ_INSERT_TAIL(&c->probation, old, next_lru);
+        }
+    }
+}
+
 static void qcow2_cache_table_release(Qcow2Cache *c, int i, int num_tables)
 {
 /* Using MADV_DONTNEED to discard memory is a Linux-specific feature */
@@ -106,8 +222,8 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_hash_remove(c, i);
+            qcow2_cache_entry_reset(c, i);
             i++;
             to_clean++;
         }
@@ -120,6 +236,28 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
     c->cache_clean_lru_counter = c->lru_counter;
 }
 
+/* Mark all entries as empty, which must be unreferenced */
+static void qcow2_cache_reset_index(Qcow2Cache *c)
+{
+    int i;
+
+    memset(c->buckets, -1, (c->hash_mask + 1) * sizeof(int));
+    QTAILQ_INIT(&c->probation);
+    QTAILQ_INIT(&c->protected);
+    c->protected_count = 0;
+
+    for (i = 0; i < c->size; i++) {
+        Qcow2CachedTable *t = &c->entries[i];
+
+        assert(t->ref == 0);
+        t->offset = 0;
+        t->lru_counter = 0;
+        t->hot = false;
+        t->hash_next = -1;
+        QTAILQ_INSERT_TAIL(&c->probation, t, next_lru);
+    }
+}
+
 Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
                                unsigned table_size)
 {
@@ -134,17 +272,25 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->table_bits = ctz32(table_size);
+    c->hash_mask = pow2ceil(num_tables) - 1;
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->buckets = g_try_new(int, c->hash_mask + 1);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->buckets || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
     }
 
+    /* Leave a quarter of the cache for tables that are used only once */
+    c->protected_max = MAX(num_tables - num_tables / 4, 1);
+    qcow2_cache_reset_index(c);
+
     return c;
 }
 
@@ -157,6 +303,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -300,19 +447,14 @@ void qcow2_cache_depends_on_flush(Qcow2Cache *c)
 
 int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 {
-    int ret, i;
+    int ret;
 
     ret = qcow2_cache_flush(bs, c);
     if (ret < 0) {
         return ret;
     }
 
-    for (i = 0; i < c->size; i++) {
-        assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
-    }
-
+    qcow2_cache_reset_index(c);
     qcow2_cache_table_release(c, 0, c->size);
 
     c->lru_counter = 0;
@@ -325,11 +467,9 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +484,36 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
+    i = qcow2_cache_lookup(c, offset);
+    if (i >= 0) {
+        t = &c->entries[i];
+        c->hits++;
+        if (t->ref == 0) {
+            QTAILQ_REMOVE(qcow2_cache_lru(c, t), t, next_lru);
+            /*
+             * Consecutive uses of the same table, as in a sequential scan,
+             * do not count as being used again.
+             */
+            if (!t->hot && t->lru_counter != c->lru_counter) {
+                qcow2_cache_promote(c, t);
+            }
         }
-    } while (i != lookup_index);
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    t = QTAILQ_FIRST(&c->probation);
+    if (!t) {
+        t = QTAILQ_FIRST(&c->protected);
+    }
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = t - c->entries;
+    c->misses++;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +524,15 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    if (t->offset) {
+        c->evictions++;
+        qcow2_cache_hash_remove(c, i);
+    }
+    qcow2_cache_entry_reset(c, i);
+
+    /* Hold a reference so that nobody else picks the entry while we read */
+    QTAILQ_REMOVE(&c->probation, t, next_lru);
+    t->ref++;
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -386,15 +541,19 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         ret = bdrv_pread(bs->file, offset, c->table_size,
                          qcow2_cache_get_table_addr(c, i), 0);
         if (ret < 0) {
+            t->ref--;
+            QTAILQ_INSERT_HEAD(&c->probation, t, next_lru);
             return ret;
         }
     }
+    t->ref--;
 
-    c->entries[i].offset = offset;
+    t->offset = offset;
+    qcow2_cache_hash_insert(c, i);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    t->ref++;
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -418,15 +577,17 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(c, *table);
+    Qcow2CachedTable *t = &c->entries[i];
 
-    c->entries[i].ref--;
+    t->ref--;
     *table = NULL;
 
-    if (c->entries[i].ref == 0) {
-        c->entries[i].lru_counter = ++c->lru_counter;
+    if (t->ref == 0) {
+        t->lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(qcow2_cache_lru(c, t), t, next_lru);
     }
 
-    assert(c->entries[i].ref >= 0);
+    assert(t->ref >= 0);
 }
 
 void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
@@ -438,14 +599,9 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,9 +610,18 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_hash_remove(c, i);
+    qcow2_cache_entry_reset(c, i);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats)
+{
+    *stats = (Qcow2CacheStats) {
+        .hits = c->hits,
+        .misses = c->misses,
+        .evictions = c->evictions,
+    };
+}
@@ -62,6 +62,7 @@ int coroutine_fn qcow2_shrink_l1_table(BlockDriverState *bs,
     }
 
     BLKDBG_CO_EVENT(bs->file, BLKDBG_L1_SHRINK_FREE_L2_CLUSTERS);
+    qcow2_cluster_map_invalidate(s);
     for (i = s->l1_size - 1; i > new_l1_size - 1; i--) {
         if ((s->l1_table[i] & L1E_OFFSET_MASK) == 0) {
             continue;
@@ -78,6 +79,7 @@ fail:
      * overwritten l1_table. In this case it would be better to clear the
      * l1_table in memory to avoid possible image corruption.
      */
+    qcow2_cluster_map_invalidate(s);
     memset(s->l1_table + new_l1_size, 0,
            (s->l1_size - new_l1_size) * L1E_SIZE);
     return ret;
@@ -562,6 +564,113 @@ do_perform_cow_write(BlockDriverState *bs, uint64_t cluster_offset,
     return 0;
 }
 
+/*
+ * Record that the @bytes bytes at guest @offset are stored contiguously at
+ * @host_offset, in clusters of type QCOW2_SUBCLUSTER_NORMAL.  The caller
+ * must hold s->lock since it read the L2 entries, so that the mappings
+ * cannot have been changed in the meantime.
+ */
+void qcow2_cluster_map_insert(BDRVQcow2State *s, uint64_t offset,
+                              uint64_t bytes, uint64_t host_offset)
+{
+    uint64_t cluster = offset >> s->cluster_bits;
+    uint64_t host_cluster = start_of_cluster(s, host_offset);
+    uint64_t nb_clusters = size_to_clusters(s, offset_into_cluster(s, offset)
+                                            + bytes);
+    uint64_t i;
+
+    nb_clusters = MIN(nb_clusters, QCOW2_CLUSTER_MAP_SIZE);
+
+    seqlock_write_lock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+    for (i = 0; i < nb_clusters; i++) {
+        Qcow2ClusterMapEntry *e =
+            &s->cluster_map[(cluster + i) % QCOW2_CLUSTER_MAP_SIZE];
+
+        e->guest_cluster = cluster + i + 1;
+        e->host_offset = host_cluster + (i << s->cluster_bits);
+        e->generation = s->cluster_map_generation;
+    }
+    seqlock_write_unlock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+}
+
+/*
+ * Drop the mappings of @nb_clusters guest clusters starting at the cluster
+ * that contains @offset.  Must be called with s->lock held, before the old
+ * host clusters can be freed.
+ */
+void qcow2_cluster_map_invalidate_range(BDRVQcow2State *s, uint64_t offset,
+                                        uint64_t nb_clusters)
+{
+    uint64_t cluster = offset >> s->cluster_bits;
+    uint64_t i;
+
+    if (nb_clusters >= QCOW2_CLUSTER_MAP_SIZE) {
+        qcow2_cluster_map_invalidate(s);
+        return;
+    }
+
+    seqlock_write_lock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+    for (i = 0; i < nb_clusters; i++) {
+        Qcow2ClusterMapEntry *e =
+            &s->cluster_map[(cluster + i) % QCOW2_CLUSTER_MAP_SIZE];
+
+        if (e->guest_cluster == cluster + i + 1) {
+            e->guest_cluster = 0;
+        }
+    }
+    seqlock_write_unlock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+}
+
+/*
+ * Find the host offset of guest @offset in the cluster map, without taking
+ * s->lock.  This only finds clusters of type QCOW2_SUBCLUSTER_NORMAL that
+ * a previous lookup has recorded with qcow2_cluster_map_insert().
+ *
+ * On entry, *bytes is the maximum number of contiguous bytes starting at
+ * offset that we are interested in.  On success, *bytes is the number of
+ * bytes that are stored contiguously in the image file according to the map.
+ *
+ * Returns false if the cluster containing @offset is not in the map.
+ */
+bool qcow2_cluster_map_lookup(BDRVQcow2State *s, uint64_t offset,
+                              unsigned int *bytes, uint64_t *host_offset)
+{
+    uint64_t cluster = offset >> s->cluster_bits;
+    unsigned int offset_in_cluster = offset_into_cluster(s, offset);
+    uint64_t bytes_needed = (uint64_t) *bytes + offset_in_cluster;
+    uint64_t bytes_found, host_cluster;
+    unsigned seq;
+
+    do {
+        seq = seqlock_read_begin(&s->cluster_map_seqlock);
+        host_cluster = 0;
+        for (bytes_found = 0; bytes_found < bytes_needed;
+             bytes_found += s->cluster_size) {
+            uint64_t i = cluster + (bytes_found >> s->cluster_bits);
+            Qcow2ClusterMapEntry *e =
+                &s->cluster_map[i % QCOW2_CLUSTER_MAP_SIZE];
+
+            if (e->guest_cluster != i + 1 ||
+                e->generation != s->cluster_map_generation) {
+                break;
+            }
+            if (!bytes_found) {
+                host_cluster = e->host_offset;
+            } else if (e->host_offset != host_cluster + bytes_found) {
+                break;
+            }
+        }
+    } while (seqlock_read_retry(&s->cluster_map_seqlock, seq));
+
+    if (!bytes_found) {
+        return false;
+    }
+
+    *bytes = MIN(bytes_needed, bytes_found) - offset_in_cluster;
+    *host_offset = host_cluster + offset_in_cluster;
+    return true;
+}
+
 
 /*
  * get_host_offset
@@ -874,6 +983,7 @@ qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs, uint64_t offset,
 
     BLKDBG_CO_EVENT(bs->file, BLKDBG_L2_UPDATE_COMPRESSED);
     qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    qcow2_cluster_map_invalidate_range(s, offset, 1);
     set_l2_entry(s, l2_slice, l2_index, cluster_offset);
     if (has_subclusters(s)) {
         set_l2_bitmap(s, l2_slice, l2_index, 0);
@@ -1066,6 +1176,7 @@ int coroutine_fn qcow2_alloc_cluster_link_l2(BlockDriverState *bs,
     assert(l2_index + m->nb_clusters <= s->l2_slice_size);
     assert(m->cow_end.offset + m->cow_end.nb_bytes <=
            m->nb_clusters << s->cluster_bits);
+    qcow2_cluster_map_invalidate_range(s, m->offset, m->nb_clusters);
     for (i = 0; i < m->nb_clusters; i++) {
         uint64_t offset = cluster_offset + ((uint64_t)i << s->cluster_bits);
         /* if two concurrent writes happen to the same unallocated cluster
@@ -1582,6 +1693,103 @@ out:
     return ret;
 }
 
+/*
+ * Give back the unused part of an allocation extent and make the slot free.
+ */
+static void GRAPH_RDLOCK
+release_alloc_extent(BlockDriverState *bs, Qcow2AllocExtent *ext)
+{
+    if (ext->offset < ext->end) {
+        qcow2_free_clusters(bs, ext->offset, ext->end - ext->offset,
+                            QCOW2_DISCARD_NEVER);
+    }
+    *ext = (Qcow2AllocExtent) {};
+}
+
+/*
+ * Free the clusters that have been allocated in advance but not handed out
+ * yet.  Extents are kept across flushes, so that a writer keeps filling the
+ * same range of the image file.  This must happen before the image is
+ * closed or inactivated, and before refcounts are checked or copied into a
+ * snapshot, so that the clusters do not show up as leaked.  After a crash
+ * they are leaked like other clusters that were allocated but not linked.
+ */
+void qcow2_release_alloc_extents(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_MAX_ALLOC_EXTENTS; i++) {
+        release_alloc_extent(bs, &s->alloc_extents[i]);
+    }
+}
+
+/*
+ * Allocates up to *nb_clusters data clusters from the extent of the current
+ * AioContext.  Each writer thus fills its own contiguous range of the image
+ * file, and the refcounts of a whole extent are updated at once.  If
+ * *host_offset is not INV_OFFSET, the clusters must start there.
+ *
+ * On success, *host_offset and *nb_clusters describe the allocated clusters.
+ * *nb_clusters is set to 0 if no clusters can be allocated at *host_offset.
+ *
+ * Must be called with s->lock held.  Return 0 on success and -errno in error
+ * cases.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+alloc_from_extent(BlockDriverState *bs, uint64_t *host_offset,
+                  uint64_t *nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+    Qcow2AllocExtent *ext = NULL;
+    int64_t extent_clusters = MAX(s->alloc_extent_size >> s->cluster_bits, 1);
+    int64_t ret;
+    int i;
+
+    for (i = 0; i < QCOW2_MAX_ALLOC_EXTENTS; i++) {
+        if (s->alloc_extents[i].ctx == ctx) {
+            ext = &s->alloc_extents[i];
+            break;
+        }
+    }
+    if (!ext) {
+        i = s->alloc_extent_next++ % QCOW2_MAX_ALLOC_EXTENTS;
+        ext = &s->alloc_extents[i];
+        release_alloc_extent(bs, ext);
+        ext->ctx = ctx;
+    }
+
+    if (ext->offset == ext->end) {
+        if (*host_offset == INV_OFFSET) {
+            ret = qcow2_alloc_clusters(bs, extent_clusters << s->cluster_bits);
+            if (ret < 0) {
+                return ret;
+            }
+            ext->offset = ret;
+        } else {
+            ret = qcow2_alloc_clusters_at(bs, *host_offset, extent_clusters);
+            if (ret < 0) {
+                return ret;
+            }
+            ext->offset = *host_offset;
+            extent_clusters = ret;
+        }
+        ext->end = ext->offset + (extent_clusters << s->cluster_bits);
+    }
+
+    if (*host_offset != INV_OFFSET && *host_offset != ext->offset) {
+        *nb_clusters = 0;
+        return 0;
+    }
+
+    *nb_clusters = MIN(*nb_clusters,
+                       (ext->end - ext->offset) >> s->cluster_bits);
+    *host_offset = ext->offset;
+    ext->offset += *nb_clusters << s->cluster_bits;
+    return 0;
+}
+
 /*
  * Allocates new clusters for the given guest_offset.
  *
@@ -1619,6 +1827,12 @@ do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
 
     /* Allocate new clusters */
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
+    if (s->alloc_extent_size &&
+        alloc_from_extent(bs, host_offset, nb_clusters) == 0) {
+        return 0;
+    }
+
+    /* Allocate just the requested clusters */
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
             qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
@@ -1916,6 +2130,7 @@ discard_in_l2_slice(BlockDriverState *bs, uint64_t offset, uint64_t nb_clusters,
     /* Limit nb_clusters to one L2 slice */
     nb_clusters = MIN(nb_clusters, s->l2_slice_size - l2_index);
     assert(nb_clusters <= INT_MAX);
+    qcow2_cluster_map_invalidate_range(s, offset, nb_clusters);
 
     for (i = 0; i < nb_clusters; i++) {
         uint64_t old_l2_entry = get_l2_entry(s, l2_slice, l2_index + i);
@@ -2055,6 +2270,7 @@ zero_in_l2_slice(BlockDriverState *bs, uint64_t offset,
     /* Limit nb_clusters to one L2 slice */
     nb_clusters = MIN(nb_clusters, s->l2_slice_size - l2_index);
     assert(nb_clusters <= INT_MAX);
+    qcow2_cluster_map_invalidate_range(s, offset, nb_clusters);
 
     for (i = 0; i < nb_clusters; i++) {
         uint64_t old_l2_entry = get_l2_entry(s, l2_slice, l2_index + i);
@@ -1611,6 +1611,11 @@ fix_l2_entry_by_zero(BlockDriverState *bs, BdrvCheckResult *res,
     uint64_t l2e_offset = l2_offset + (uint64_t)l2_index * l2_entry_size(s);
     int ign = active ? QCOW2_OL_ACTIVE_L2 : QCOW2_OL_INACTIVE_L2;
 
+    /* We don't know the guest offset of this entry, so drop all mappings */
+    if (active) {
+        qcow2_cluster_map_invalidate(s);
+    }
+
     if (has_subclusters(s)) {
         uint64_t l2_bitmap = get_l2_bitmap(s, l2_table, l2_index);
 
@@ -3387,6 +3392,7 @@ int qcow2_change_refcount_order(BlockDriverState *bs, int refcount_order,
     new_get_refcount = get_refcount_funcs[refcount_order];
     new_set_refcount = set_refcount_funcs[refcount_order];
 
+    qcow2_release_alloc_extents(bs);
 
     do {
         int total_walks;
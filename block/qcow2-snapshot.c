@@ -652,6 +652,12 @@ int qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info)
         return -ENOTSUP;
     }
 
+    /*
+     * Unused extent clusters must not be counted as part of the snapshot,
+     * and snapshot operations write all refcounts back to disk
+     */
+    qcow2_release_alloc_extents(bs);
+
     memset(sn, 0, sizeof(*sn));
 
     /* Generate an ID */
@@ -771,6 +777,8 @@ int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id)
         return -ENOTSUP;
     }
 
+    qcow2_release_alloc_extents(bs);
+
     /* Search the snapshot */
     snapshot_index = find_snapshot_by_id_or_name(bs, snapshot_id);
     if (snapshot_index < 0) {
@@ -873,6 +881,7 @@ int qcow2_snapshot_goto(BlockDriverState *bs, const char *snapshot_id)
      * Now update the in-memory L1 table to be in sync with the on-disk one. We
      * need to do this even if updating refcounts failed.
      */
+    qcow2_cluster_map_invalidate(s);
     for(i = 0;i < s->l1_size; i++) {
         s->l1_table[i] = be64_to_cpu(sn_l1_table[i]);
     }
@@ -919,6 +928,8 @@ int qcow2_snapshot_delete(BlockDriverState *bs,
         return -ENOTSUP;
     }
 
+    qcow2_release_alloc_extents(bs);
+
     /* Search the snapshot */
     snapshot_index = find_snapshot_by_id_and_name(bs, snapshot_id, name);
     if (snapshot_index < 0) {
@@ -1062,6 +1073,7 @@ int qcow2_snapshot_load_tmp(BlockDriverState *bs,
     }
 
     /* Switch the L1 table */
+    qcow2_cluster_map_invalidate(s);
     qemu_vfree(s->l1_table);
 
     s->l1_size = sn->l1_size;
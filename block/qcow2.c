@@ -614,6 +614,9 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    /* Preallocated clusters would be reported as leaked */
+    qcow2_release_alloc_extents(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -701,6 +704,8 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_COMPRESS_THREADS,
+    QCOW2_OPT_ALLOC_EXTENT_SIZE,
     NULL
 };
 
@@ -817,6 +822,18 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_COMPRESS_THREADS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of threads compressing or decompressing "
+                    "clusters in parallel",
+        },
+        {
+            .name = QCOW2_OPT_ALLOC_EXTENT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Allocate data clusters in extents of this size "
+                    "(0 to disable)",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -979,6 +996,8 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t compress_threads;
+    uint64_t alloc_extent_size;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1079,6 +1098,24 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->compress_threads = qemu_opt_get_number(opts, QCOW2_OPT_COMPRESS_THREADS,
+                                              QCOW2_MAX_THREADS);
+    if (r->compress_threads < 1 || r->compress_threads > INT_MAX) {
+        error_setg(errp, QCOW2_OPT_COMPRESS_THREADS
+                   " must be between 1 and %d", INT_MAX);
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    r->alloc_extent_size = qemu_opt_get_size(opts, QCOW2_OPT_ALLOC_EXTENT_SIZE,
+                                             0);
+    if (r->alloc_extent_size > QCOW2_MAX_ALLOC_EXTENT_SIZE) {
+        error_setg(errp, QCOW2_OPT_ALLOC_EXTENT_SIZE " must not exceed %"
+                   PRIu64 " bytes", (uint64_t) QCOW2_MAX_ALLOC_EXTENT_SIZE);
+        ret = -EINVAL;
+        goto fail;
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1238,6 +1275,8 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
     }
 
     s->discard_no_unref = r->discard_no_unref;
+    s->compress_threads = r->compress_threads;
+    s->alloc_extent_size = r->alloc_extent_size;
 
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
@@ -1578,6 +1617,11 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     s->l1_size = header.l1_size;
     s->l1_table_offset = header.l1_table_offset;
 
+    s->cluster_map = g_new0(Qcow2ClusterMapEntry, QCOW2_CLUSTER_MAP_SIZE);
+    s->cluster_map_generation = 0;
+    seqlock_init(&s->cluster_map_seqlock);
+    qemu_spin_init(&s->cluster_map_lock);
+
     l1_vm_state_index = size_to_l1(s, header.size);
     if (l1_vm_state_index > INT_MAX) {
         error_setg(errp, "Image is too big");
@@ -1690,6 +1734,12 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
         }
     }
 
+    /*
+     * An external data file may also be used without the qcow2 metadata,
+     * so new clusters in it are always zeroed, see handle_alloc_space()
+     */
+    s->zero_past_eof = !has_data_file(bs) && bdrv_has_zero_init(bs->file->bs);
+
     /* qcow2_read_extension may have set up the crypto context
      * if the crypt method needs a header region, some methods
      * don't need header extensions, so must check here
@@ -1892,6 +1942,8 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
+    g_free(s->cluster_map);
+    s->cluster_map = NULL;
     cache_clean_timer_del(bs);
     if (s->l2_table_cache) {
         qcow2_cache_destroy(s->l2_table_cache);
@@ -1997,6 +2049,8 @@ qcow2_reopen_prepare(BDRVReopenState *state,BlockReopenQueue *queue,
             goto fail;
         }
 
+        qcow2_release_alloc_extents(state->bs);
+
         ret = bdrv_flush(state->bs);
         if (ret < 0) {
             goto fail;
@@ -2039,6 +2093,7 @@ static void qcow2_reopen_commit(BDRVReopenState *state)
          * qcow2_reopen_prepare() and needs to be updated.
          */
         s->data_file = state->bs->file;
+        s->zero_past_eof = bdrv_has_zero_init(s->data_file->bs);
     }
     g_free(state->opaque);
 }
@@ -2389,12 +2444,21 @@ qcow2_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                             QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size);
         }
 
-        qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
-                                    &host_offset, &type);
-        qemu_co_mutex_unlock(&s->lock);
-        if (ret < 0) {
-            goto out;
+        if (qcow2_cluster_map_lookup(s, offset, &cur_bytes, &host_offset)) {
+            type = QCOW2_SUBCLUSTER_NORMAL;
+        } else {
+            qemu_co_mutex_lock(&s->lock);
+            ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+            /* With subclusters, the map would need the L2 bitmap too */
+            if (ret == 0 && type == QCOW2_SUBCLUSTER_NORMAL &&
+                !has_subclusters(s)) {
+                qcow2_cluster_map_insert(s, offset, cur_bytes, host_offset);
+            }
+            qemu_co_mutex_unlock(&s->lock);
+            if (ret < 0) {
+                goto out;
+            }
         }
 
         if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
@@ -2516,12 +2580,24 @@ handle_alloc_space(BlockDriverState *bs, QCowL2Meta *l2meta)
 {
     BDRVQcow2State *s = bs->opaque;
     QCowL2Meta *m;
+    bool can_write_zeroes =
+        s->data_file->bs->supported_zero_flags & BDRV_REQ_NO_FALLBACK;
+    int64_t file_length = -1;
 
-    if (!(s->data_file->bs->supported_zero_flags & BDRV_REQ_NO_FALLBACK)) {
+    if (bs->encrypted) {
         return 0;
     }
 
-    if (bs->encrypted) {
+    /*
+     * Clusters past the end of the image file have never been written, so
+     * they read as zeroes already if the protocol driver guarantees that
+     * for areas that a write beyond the end skips.
+     */
+    if (s->zero_past_eof) {
+        file_length = bdrv_co_getlength(s->data_file->bs);
+    }
+
+    if (!can_write_zeroes && file_length < 0) {
         return 0;
     }
 
@@ -2542,6 +2618,22 @@ handle_alloc_space(BlockDriverState *bs, QCowL2Meta *l2meta)
             continue;
         }
 
+        /*
+         * Preallocated zero clusters keep their host clusters, which may
+         * have been written before
+         */
+        if (file_length >= 0 && !m->keep_old_clusters &&
+            m->alloc_offset >= file_length) {
+            trace_qcow2_skip_cow(qemu_coroutine_self(), m->offset,
+                                 m->nb_clusters);
+            m->skip_cow = true;
+            continue;
+        }
+
+        if (!can_write_zeroes) {
+            continue;
+        }
+
         /*
          * instead of writing zero COW buffers,
          * efficiently zero out the whole clusters
@@ -2756,6 +2848,8 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
                           bdrv_get_device_or_node_name(bs));
     }
 
+    qcow2_release_alloc_extents(bs);
+
     ret = qcow2_cache_flush(bs, s->l2_table_cache);
     if (ret) {
         result = ret;
@@ -2792,6 +2886,8 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     cache_clean_timer_del(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
+    g_free(s->cluster_map);
+    s->cluster_map = NULL;
 
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
@@ -4305,6 +4401,8 @@ qcow2_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
 
     qemu_co_mutex_lock(&s->lock);
 
+    qcow2_release_alloc_extents(bs);
+
     /*
      * Even though we store snapshot size for all images, it was not
      * required until v3, so it is not safe to proceed for v2.
@@ -4778,7 +4876,9 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
         uint64_t chunk_size = MIN(bytes, s->cluster_size);
 
         if (!aio && chunk_size != bytes) {
-            aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+            /* Keep all compression threads busy */
+            aio = aio_task_pool_new(MAX(QCOW2_MAX_WORKERS,
+                                        2 * s->compress_threads));
         }
 
         ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_compressed_task_entry,
@@ -5311,6 +5411,21 @@ qcow2_get_specific_info(BlockDriverState *bs, Error **errp)
     return spec_info;
 }
 
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BlockStatsSpecific *stats = g_new0(BlockStatsSpecific, 1);
+    BDRVQcow2State *s = bs->opaque;
+
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2.l2_cache = g_new(Qcow2CacheStats, 1);
+    qcow2_cache_get_stats(s->l2_table_cache, stats->u.qcow2.l2_cache);
+    stats->u.qcow2.refcount_cache = g_new(Qcow2CacheStats, 1);
+    qcow2_cache_get_stats(s->refcount_block_cache,
+                          stats->u.qcow2.refcount_cache);
+
+    return stats;
+}
+
 static int coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_has_zero_init(BlockDriverState *bs)
 {
@@ -6160,6 +6275,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure                       = qcow2_measure,
     .bdrv_co_get_info                   = qcow2_co_get_info,
     .bdrv_get_specific_info             = qcow2_get_specific_info,
+    .bdrv_get_specific_stats            = qcow2_get_specific_stats,
 
     .bdrv_co_save_vmstate               = qcow2_co_save_vmstate,
     .bdrv_co_load_vmstate               = qcow2_co_load_vmstate,
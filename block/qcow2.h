@@ -27,6 +27,7 @@
 
 #include "crypto/block.h"
 #include "qemu/coroutine.h"
+#include "qemu/seqlock.h"
 #include "qemu/units.h"
 #include "block/block_int.h"
 
@@ -150,6 +151,8 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_COMPRESS_THREADS "compress-threads"
+#define QCOW2_OPT_ALLOC_EXTENT_SIZE "alloc-extent-size"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -324,6 +327,31 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/* Number of entries in the lockless cluster map used by reads */
+#define QCOW2_CLUSTER_MAP_SIZE 8192
+
+/*
+ * With the alloc-extent-size option, data clusters are allocated in extents,
+ * one for each of up to QCOW2_MAX_ALLOC_EXTENTS AioContexts that write to
+ * the image.  It is off by default: the image file is not shrunk when the
+ * unused tail of an extent is freed on close, and a crash leaves that tail
+ * as leaked clusters.
+ */
+#define QCOW2_MAX_ALLOC_EXTENTS 4
+#define QCOW2_MAX_ALLOC_EXTENT_SIZE (1 * GiB)
+
+typedef struct Qcow2AllocExtent {
+    AioContext *ctx; /* Writer that the extent belongs to, or NULL */
+    uint64_t offset; /* Next host offset to hand out */
+    uint64_t end;
+} Qcow2AllocExtent;
+
+typedef struct Qcow2ClusterMapEntry {
+    uint64_t guest_cluster; /* Guest cluster index + 1, 0 if unused */
+    uint64_t host_offset;
+    uint64_t generation;    /* Valid if equal to cluster_map_generation */
+} Qcow2ClusterMapEntry;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -357,8 +385,36 @@ typedef struct BDRVQcow2State {
     uint64_t free_cluster_index;
     uint64_t free_byte_offset;
 
+    /*
+     * Protects all metadata: the L1 table, the L2 and refcount block caches,
+     * cluster allocation and refcount updates.  These are not split into
+     * separate lock domains yet, because an allocating write updates all of
+     * them in one go and the caches depend on each other for flush ordering.
+     * Only read hits in @cluster_map and data I/O run without it.
+     */
     CoMutex lock;
 
+    /*
+     * Mappings of allocated data clusters that reads can look up without
+     * taking @lock, see qcow2_cluster_map_lookup().  Entries are added and
+     * invalidated with @lock held, so that a lookup racing with an L2 update
+     * can never insert a stale mapping.  Changing an L2 entry invalidates
+     * the mapping of its guest cluster, changing the L1 table invalidates
+     * all of them by bumping cluster_map_generation.  Updates take
+     * cluster_map_lock and are published through cluster_map_seqlock.
+     */
+    Qcow2ClusterMapEntry *cluster_map;
+    uint64_t cluster_map_generation;
+    QemuSeqLock cluster_map_seqlock;
+    QemuSpin cluster_map_lock;
+
+    /*
+     * Host clusters that have a refcount of 1 but are not used yet, see
+     * qcow2_release_alloc_extents()
+     */
+    Qcow2AllocExtent alloc_extents[QCOW2_MAX_ALLOC_EXTENTS];
+    unsigned alloc_extent_next;
+
     Qcow2CryptoHeaderExtension crypto_header; /* QCow2 header extension */
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
     QCryptoBlock *crypto; /* Disk encryption format driver */
@@ -410,6 +466,9 @@ typedef struct BDRVQcow2State {
 
     CoQueue thread_task_queue;
     int nb_threads;
+    int compress_threads; /* limit of nb_threads for (de)compression */
+    uint64_t alloc_extent_size; /* 0 if clusters are allocated as needed */
+    bool zero_past_eof; /* Unwritten areas past the end of bs->file read 0 */
 
     BdrvChild *data_file;
 
@@ -626,6 +685,17 @@ static inline uint64_t get_l2_bitmap(BDRVQcow2State *s, uint64_t *l2_slice,
     }
 }
 
+static inline void qcow2_cluster_map_invalidate(BDRVQcow2State *s)
+{
+    seqlock_write_lock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+    s->cluster_map_generation++;
+    seqlock_write_unlock(&s->cluster_map_seqlock, &s->cluster_map_lock);
+}
+
+/*
+ * Callers that change the host offset of an entry in an active L2 table
+ * must call qcow2_cluster_map_invalidate_range() for its guest cluster.
+ */
 static inline void set_l2_entry(BDRVQcow2State *s, uint64_t *l2_slice,
                                 int idx, uint64_t entry)
 {
@@ -927,6 +997,15 @@ int GRAPH_RDLOCK qcow2_write_l1_entry(BlockDriverState *bs, int l1_index);
 int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
                           uint8_t *buf, int nb_sectors, bool enc, Error **errp);
 
+void GRAPH_RDLOCK qcow2_release_alloc_extents(BlockDriverState *bs);
+
+void qcow2_cluster_map_insert(BDRVQcow2State *s, uint64_t offset,
+                              uint64_t bytes, uint64_t host_offset);
+void qcow2_cluster_map_invalidate_range(BDRVQcow2State *s, uint64_t offset,
+                                        uint64_t nb_clusters);
+bool qcow2_cluster_map_lookup(BDRVQcow2State *s, uint64_t offset,
+                              unsigned int *bytes, uint64_t *host_offset);
+
 int GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
@@ -1021,6 +1100,7 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
 
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
@@ -43,13 +43,13 @@ typedef struct {
     uint32_t mask;
     uint32_t pattern;
     CountType what;
-    uint64_t count;
+    qemu_plugin_u64 count;
 } InsnClassExecCount;
 
 typedef struct {
     char *insn;
     uint32_t opcode;
-    uint64_t count;
+    qemu_plugin_u64 count;
     InsnClassExecCount *class;
 } InsnExecCount;
 
@@ -154,18 +154,23 @@ static ClassSelector class_tables[] = {
 
 static InsnClassExecCount *class_table;
 static int class_table_sz;
+/* one uint64_t per class and per vCPU */
+static struct qemu_plugin_scoreboard *class_counts;
 
 static gint cmp_exec_count(gconstpointer a, gconstpointer b)
 {
     InsnExecCount *ea = (InsnExecCount *) a;
     InsnExecCount *eb = (InsnExecCount *) b;
-    return ea->count > eb->count ? -1 : 1;
+    uint64_t count_a = qemu_plugin_u64_sum(ea->count);
+    uint64_t count_b = qemu_plugin_u64_sum(eb->count);
+    return count_a > count_b ? -1 : 1;
 }
 
 static void free_record(gpointer data)
 {
     InsnExecCount *rec = (InsnExecCount *) data;
     g_free(rec->insn);
+    qemu_plugin_scoreboard_free(rec->count.score);
     g_free(rec);
 }
 
@@ -180,13 +185,16 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
         class = &class_table[i];
         switch (class->what) {
         case COUNT_CLASS:
-            if (class->count || verbose) {
+        {
+            uint64_t count = qemu_plugin_u64_sum(class->count);
+            if (count || verbose) {
                 g_string_append_printf(report,
                                        "Class: %-24s\t(%" PRId64 " hits)\n",
                                        class->class,
-                                       class->count);
+                                       count);
             }
             break;
+        }
         case COUNT_INDIVIDUAL:
             g_string_append_printf(report, "Class: %-24s\tcounted individually\n",
                                    class->class);
@@ -212,7 +220,7 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
                                    "Instr: %-24s\t(%" PRId64 " hits)"
                                    "\t(op=0x%08x/%s)\n",
                                    rec->insn,
-                                   rec->count,
+                                   qemu_plugin_u64_sum(rec->count),
                                    rec->opcode,
                                    rec->class ?
                                    rec->class->class : "un-categorised");
@@ -221,6 +229,7 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     }
 
     g_hash_table_destroy(insns);
+    qemu_plugin_scoreboard_free(class_counts);
 
     qemu_plugin_outs(report->str);
 }
@@ -228,18 +237,26 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
 static void plugin_init(void)
 {
     insns = g_hash_table_new_full(NULL, g_direct_equal, NULL, &free_record);
+
+    class_counts = qemu_plugin_scoreboard_new(class_table_sz *
+                                              sizeof(uint64_t));
+    for (int i = 0; i < class_table_sz; i++) {
+        class_table[i].count = (qemu_plugin_u64) {
+            class_counts, i * sizeof(uint64_t)
+        };
+    }
 }
 
 static void vcpu_insn_exec_before(unsigned int cpu_index, void *udata)
 {
-    uint64_t *count = (uint64_t *) udata;
-    (*count)++;
+    qemu_plugin_u64 *count = (qemu_plugin_u64 *) udata;
+    qemu_plugin_u64_add(*count, cpu_index, 1);
 }
 
-static uint64_t *find_counter(struct qemu_plugin_insn *insn)
+static qemu_plugin_u64 *find_counter(struct qemu_plugin_insn *insn)
 {
     int i;
-    uint64_t *cnt = NULL;
+    qemu_plugin_u64 *cnt = NULL;
     uint32_t opcode;
     InsnClassExecCount *class = NULL;
 
@@ -279,6 +296,8 @@ static uint64_t *find_counter(struct qemu_plugin_insn *insn)
             icount->opcode = opcode;
             icount->insn = qemu_plugin_insn_disas(insn);
             icount->class = class;
+            icount->count = qemu_plugin_scoreboard_u64(
+                qemu_plugin_scoreboard_new(sizeof(uint64_t)));
 
             g_hash_table_insert(insns, GUINT_TO_POINTER(opcode),
                                 (gpointer) icount);
@@ -300,14 +319,14 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
     size_t i;
 
     for (i = 0; i < n; i++) {
-        uint64_t *cnt;
+        qemu_plugin_u64 *cnt;
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
         cnt = find_counter(insn);
 
         if (cnt) {
             if (do_inline) {
-                qemu_plugin_register_vcpu_insn_exec_inline(
-                    insn, QEMU_PLUGIN_INLINE_ADD_U64, cnt, 1);
+                qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+                    insn, QEMU_PLUGIN_INLINE_ADD_U64, *cnt, 1);
             } else {
                 qemu_plugin_register_vcpu_insn_exec_cb(
                     insn, vcpu_insn_exec_before, QEMU_PLUGIN_CB_NO_REGS, cnt);
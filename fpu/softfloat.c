@@ -241,6 +241,23 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Conversions to integer take their rounding mode as an argument.
+ * The host handles truncation, and round-to-nearest-even via rint()
+ * in the default host rounding mode.
+ */
+static inline bool can_use_fpu_to_int(FloatRoundMode rmode, int scale,
+                                      const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(scale == 0 &&
+                  s->float_exception_flags & float_flag_inexact &&
+                  (rmode == float_round_nearest_even ||
+                   rmode == float_round_to_zero));
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -339,6 +356,18 @@ static inline bool f64_is_inf(union_float64 a)
     return float64_is_infinity(a.s);
 }
 
+static inline bool f32_is_zon_or_inf2(union_float32 a, union_float32 b)
+{
+    return (float32_is_zero_or_normal(a.s) || f32_is_inf(a)) &&
+           (float32_is_zero_or_normal(b.s) || f32_is_inf(b));
+}
+
+static inline bool f64_is_zon_or_inf2(union_float64 a, union_float64 b)
+{
+    return (float64_is_zero_or_normal(a.s) || f64_is_inf(a)) &&
+           (float64_is_zero_or_normal(b.s) || f64_is_inf(b));
+}
+
 static inline float32
 float32_gen2(float32 xa, float32 xb, float_status *s,
              hard_f32_op2_fn hard, soft_f32_op2_fn soft,
@@ -2990,20 +3019,42 @@ float16 float16_round_to_int(float16 a, float_status *s)
     return float16_round_pack_canonical(&p, s);
 }
 
-float32 float32_round_to_int(float32 a, float_status *s)
+float32 QEMU_FLATTEN float32_round_to_int(float32 a, float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+
+    ua.s = a;
+    if (can_use_fpu(s)) {
+        float32_input_flush1(&ua.s, s);
+        /* Only NaNs can raise a flag other than inexact. */
+        if (likely(!float32_is_any_nan(ua.s))) {
+            ua.h = rintf(ua.h);
+            return ua.s;
+        }
+    }
 
-    float32_unpack_canonical(&p, a, s);
+    float32_unpack_canonical(&p, ua.s, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float32_params);
     return float32_round_pack_canonical(&p, s);
 }
 
-float64 float64_round_to_int(float64 a, float_status *s)
+float64 QEMU_FLATTEN float64_round_to_int(float64 a, float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+
+    ua.s = a;
+    if (can_use_fpu(s)) {
+        float64_input_flush1(&ua.s, s);
+        /* Only NaNs can raise a flag other than inexact. */
+        if (likely(!float64_is_any_nan(ua.s))) {
+            ua.h = rint(ua.h);
+            return ua.s;
+        }
+    }
 
-    float64_unpack_canonical(&p, a, s);
+    float64_unpack_canonical(&p, ua.s, s);
     parts_round_to_int(&p, s->float_rounding_mode, 0, s, &float64_params);
     return float64_round_pack_canonical(&p, s);
 }
@@ -3043,6 +3094,47 @@ floatx80 floatx80_round_to_int(floatx80 a, float_status *status)
  * Floating-point to signed integer conversions
  */
 
+/*
+ * Round @a with the host FPU and return true if the result lies within
+ * [@lo, @hi), so that at most inexact is raised.  NaNs and out of range
+ * inputs compare false and are left to softfloat, which raises invalid.
+ * float32 inputs are widened to double, which is exact.
+ */
+static inline bool hard_to_int(double a, FloatRoundMode rmode,
+                               double lo, double hi, double *r)
+{
+    *r = rmode == float_round_to_zero ? trunc(a) : rint(a);
+    return likely(*r >= lo && *r < hi);
+}
+
+static inline bool float32_hard_to_int(float32 *a, FloatRoundMode rmode,
+                                       int scale, double lo, double hi,
+                                       double *r, float_status *s)
+{
+    union_float32 ua;
+
+    if (!can_use_fpu_to_int(rmode, scale, s)) {
+        return false;
+    }
+    float32_input_flush1(a, s);
+    ua.s = *a;
+    return hard_to_int(ua.h, rmode, lo, hi, r);
+}
+
+static inline bool float64_hard_to_int(float64 *a, FloatRoundMode rmode,
+                                       int scale, double lo, double hi,
+                                       double *r, float_status *s)
+{
+    union_float64 ua;
+
+    if (!can_use_fpu_to_int(rmode, scale, s)) {
+        return false;
+    }
+    float64_input_flush1(a, s);
+    ua.s = *a;
+    return hard_to_int(ua.h, rmode, lo, hi, r);
+}
+
 int8_t float16_to_int8_scalbn(float16 a, FloatRoundMode rmode, int scale,
                               float_status *s)
 {
@@ -3092,6 +3184,11 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float32_hard_to_int(&a, rmode, scale, INT32_MIN, 0x1p31, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3101,6 +3198,11 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float32_hard_to_int(&a, rmode, scale, INT64_MIN, 0x1p63, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3119,6 +3221,11 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float64_hard_to_int(&a, rmode, scale, INT32_MIN, 0x1p31, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3128,6 +3235,11 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float64_hard_to_int(&a, rmode, scale, INT64_MIN, 0x1p63, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3519,6 +3631,11 @@ uint32_t float32_to_uint32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float32_hard_to_int(&a, rmode, scale, 0, 0x1p32, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3528,6 +3645,11 @@ uint64_t float32_to_uint64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float32_hard_to_int(&a, rmode, scale, 0, 0x1p64, &r, s)) {
+        return r;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -3546,6 +3668,11 @@ uint32_t float64_to_uint32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float64_hard_to_int(&a, rmode, scale, 0, 0x1p32, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
@@ -3555,6 +3682,11 @@ uint64_t float64_to_uint64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                   float_status *s)
 {
     FloatParts64 p;
+    double r;
+
+    if (float64_hard_to_int(&a, rmode, scale, 0, 0x1p64, &r, s)) {
+        return r;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT64_MAX, s);
@@ -4256,6 +4388,28 @@ float128 uint128_to_float128(Int128 a, float_status *status)
  * Minimum and maximum
  */
 
+/*
+ * Choose between two operands that are neither NaN nor denormal, with
+ * the same result as parts_minmax.  Returns true to pick @a.
+ */
+static inline bool hard_minmax_pick_a(double a, double b, int flags)
+{
+    bool ismin = flags & minmax_ismin;
+
+    if (flags & minmax_ismag) {
+        double ma = fabs(a), mb = fabs(b);
+
+        if (ma != mb) {
+            return (ma < mb) == ismin;
+        }
+    }
+    if (a == b) {
+        /* Equal values can only differ in the sign of zero. */
+        return signbit(a) ? ismin : !ismin;
+    }
+    return (a < b) == ismin;
+}
+
 static float16 float16_minmax(float16 a, float16 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
@@ -4279,23 +4433,55 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
     return bfloat16_round_pack_canonical(pr, s);
 }
 
-static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
+static float32 QEMU_FLATTEN
+float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float32 ua, ub;
 
-    float32_unpack_canonical(&pa, a, s);
-    float32_unpack_canonical(&pb, b, s);
+    ua.s = a;
+    ub.s = b;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float32_input_flush2(&ua.s, &ub.s, s);
+    /* Without NaNs or denormals, no flags are raised. */
+    if (likely(f32_is_zon_or_inf2(ua, ub))) {
+        return hard_minmax_pick_a(ua.h, ub.h, flags) ? ua.s : ub.s;
+    }
+
+ soft:
+    float32_unpack_canonical(&pa, ua.s, s);
+    float32_unpack_canonical(&pb, ub.s, s);
     pr = parts_minmax(&pa, &pb, s, flags);
 
     return float32_round_pack_canonical(pr, s);
 }
 
-static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
+static float64 QEMU_FLATTEN
+float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float64 ua, ub;
 
-    float64_unpack_canonical(&pa, a, s);
-    float64_unpack_canonical(&pb, b, s);
+    ua.s = a;
+    ub.s = b;
+
+    if (QEMU_NO_HARDFLOAT) {
+        goto soft;
+    }
+
+    float64_input_flush2(&ua.s, &ub.s, s);
+    /* Without NaNs or denormals, no flags are raised. */
+    if (likely(f64_is_zon_or_inf2(ua, ub))) {
+        return hard_minmax_pick_a(ua.h, ub.h, flags) ? ua.s : ub.s;
+    }
+
+ soft:
+    float64_unpack_canonical(&pa, ua.s, s);
+    float64_unpack_canonical(&pb, ub.s, s);
     pr = parts_minmax(&pa, &pb, s, flags);
 
     return float64_round_pack_canonical(pr, s);
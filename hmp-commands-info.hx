@@ -280,7 +280,10 @@ ERST
 
 SRST
   ``info opcount``
-    Show dynamic compiler opcode counters
+    Show dynamic compiler opcode counters: the average number of TCG ops
+    per translation block before and after optimization, the average
+    host code size, and how often the optimizer forwarded or removed
+    accesses to the CPU state.
 ERST
 
     {
@@ -307,6 +310,9 @@ SRST
     When different objects that share the same call site are coalesced,
     the "Object" field shows---enclosed in brackets---the number of objects
     being coalesced.
+
+    Objects that have a name, such as the locks of memory regions that
+    are accessed without the BQL, show it after the call site.
 ERST
 
     {
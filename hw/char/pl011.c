@@ -30,6 +30,7 @@
 #include "chardev/char-fe.h"
 #include "chardev/char-serial.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "trace.h"
 
@@ -149,6 +150,18 @@ static uint64_t pl011_read(void *opaque, hwaddr offset,
     uint32_t c;
     uint64_t r;
 
+    /*
+     * The region is dispatched without the BQL.  Guests poll UARTFR while
+     * they wait to transmit, so read it without taking the lock; flags are
+     * only ever modified with the BQL held.
+     */
+    if ((offset >> 2) == 6) {
+        r = qatomic_read(&s->flags);
+        trace_pl011_read(offset, r, pl011_regname(offset));
+        return r;
+    }
+
+    BQL_LOCK_GUARD();
     switch (offset >> 2) {
     case 0: /* UARTDR */
         s->flags &= ~PL011_FLAG_RXFF;
@@ -171,9 +184,6 @@ static uint64_t pl011_read(void *opaque, hwaddr offset,
     case 1: /* UARTRSR */
         r = s->rsr;
         break;
-    case 6: /* UARTFR */
-        r = s->flags;
-        break;
     case 8: /* UARTILPR */
         r = s->ilpr;
         break;
@@ -259,6 +269,7 @@ static void pl011_write(void *opaque, hwaddr offset,
 
     trace_pl011_write(offset, value, pl011_regname(offset));
 
+    BQL_LOCK_GUARD();
     switch (offset >> 2) {
     case 0: /* UARTDR */
         /* ??? Check if transmitter is enabled.  */
@@ -471,6 +482,7 @@ static void pl011_init(Object *obj)
     int i;
 
     memory_region_init_io(&s->iomem, OBJECT(s), &pl011_ops, s, "pl011", 0x1000);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(sbd, &s->iomem);
     for (i = 0; i < ARRAY_SIZE(s->irq); i++) {
         sysbus_init_irq(sbd, &s->irq[i]);
@@ -135,6 +135,7 @@ static void cpu_common_reset_hold(Object *obj)
     cpu->exception_index = -1;
     cpu->crash_occurred = false;
     cpu->cflags_next_tb = -1;
+    cpu->trace_pc = -1;
 
     cpu_exec_reset_hold(cpu);
 }
@@ -250,6 +251,7 @@ static void cpu_common_initfn(Object *obj)
     cpu->nr_cores = 1;
     cpu->nr_threads = 1;
     cpu->cflags_next_tb = -1;
+    cpu->trace_pc = -1;
 
     qemu_mutex_init(&cpu->work_mutex);
     qemu_lockcnt_init(&cpu->in_ioctl_lock);
@@ -10,6 +10,7 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/guest-random.h"
+#include "qemu/lockable.h"
 #include "qemu/module.h"
 #include "hw/misc/bcm2835_rng.h"
 #include "migration/vmstate.h"
@@ -112,13 +113,27 @@ static void bcm2835_rng_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &bcm2835_rng_ops, s,
                           TYPE_BCM2835_RNG, 0x10);
+    /*
+     * Guests may read random data in a loop.  The accessors only touch the
+     * device registers, so they do not need to serialize on the BQL.
+     */
+    qemu_mutex_init(&s->lock);
+    memory_region_set_lock(&s->iomem, &s->lock);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
 }
 
+static void bcm2835_rng_finalize(Object *obj)
+{
+    BCM2835RngState *s = BCM2835_RNG(obj);
+
+    qemu_mutex_destroy(&s->lock);
+}
+
 static void bcm2835_rng_reset(DeviceState *dev)
 {
     BCM2835RngState *s = BCM2835_RNG(dev);
 
+    QEMU_LOCK_GUARD(&s->lock);
     s->rng_ctrl = 0;
     s->rng_status = 0;
 }
@@ -137,6 +152,7 @@ static const TypeInfo bcm2835_rng_info = {
     .instance_size = sizeof(BCM2835RngState),
     .class_init    = bcm2835_rng_class_init,
     .instance_init = bcm2835_rng_init,
+    .instance_finalize = bcm2835_rng_finalize,
 };
 
 static void bcm2835_rng_register_types(void)
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/atomic.h"
+#include "qemu/defer-call.h"
 #include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
@@ -2678,7 +2679,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
-static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
+static int32_t virtio_net_do_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -2762,8 +2763,7 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
+        virtqueue_push_batched(q->tx_vq, elem, 0);
         g_free(elem);
 
         if (++num_packets >= n->tx_burst) {
@@ -2773,6 +2773,17 @@ drop:
     return num_packets;
 }
 
+/* Complete the packets of a burst with a single used ring update */
+static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
+{
+    int32_t ret;
+
+    defer_call_begin();
+    ret = virtio_net_do_flush_tx(q);
+    defer_call_end();
+    return ret;
+}
+
 static void virtio_net_tx_timer(void *opaque);
 
 static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
@@ -2946,6 +2957,9 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
                                                   &DEVICE(vdev)->mem_reentrancy_guard);
     }
+    virtio_queue_set_notify_coalescing(n->vqs[index].tx_vq,
+                                       n->net_conf.tx_notify_coalesce_count,
+                                       n->net_conf.tx_notify_coalesce_us);
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
@@ -3938,6 +3952,10 @@ static Property virtio_net_properties[] = {
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_UINT32("tx-notify-coalesce-count", VirtIONet,
+                       net_conf.tx_notify_coalesce_count, 0),
+    DEFINE_PROP_UINT32("tx-notify-coalesce-us", VirtIONet,
+                       net_conf.tx_notify_coalesce_us, 0),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
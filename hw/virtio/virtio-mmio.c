@@ -33,6 +33,7 @@
 #include "hw/virtio/virtio-mmio.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "trace.h"
 
 static bool virtio_mmio_ioeventfd_enabled(DeviceState *d)
@@ -49,11 +50,9 @@ static int virtio_mmio_ioeventfd_assign(DeviceState *d,
     VirtIOMMIOProxy *proxy = VIRTIO_MMIO(d);
 
     if (assign) {
-        memory_region_add_eventfd(&proxy->iomem, VIRTIO_MMIO_QUEUE_NOTIFY, 4,
-                                  true, n, notifier);
+        memory_region_add_eventfd(&proxy->notify, 0, 4, true, n, notifier);
     } else {
-        memory_region_del_eventfd(&proxy->iomem, VIRTIO_MMIO_QUEUE_NOTIFY, 4,
-                                  true, n, notifier);
+        memory_region_del_eventfd(&proxy->notify, 0, 4, true, n, notifier);
     }
     return 0;
 }
@@ -528,6 +527,57 @@ static const MemoryRegionOps virtio_mem_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
+/*
+ * The notify region overlays QueueNotify and is dispatched without the BQL,
+ * so that vCPUs signalling an ioeventfd do not contend on it.  Accesses
+ * that do not hit an ioeventfd are forwarded to the main register bank
+ * with the BQL held.
+ */
+static MemOp virtio_mmio_notify_memop(VirtIOMMIOProxy *proxy, unsigned size)
+{
+    return size_memop(size) |
+           devend_memop(proxy->legacy ? DEVICE_NATIVE_ENDIAN
+                                      : DEVICE_LITTLE_ENDIAN);
+}
+
+static MemTxResult virtio_mmio_notify_read(void *opaque, hwaddr offset,
+                                           uint64_t *data, unsigned size,
+                                           MemTxAttrs attrs)
+{
+    VirtIOMMIOProxy *proxy = opaque;
+
+    BQL_LOCK_GUARD();
+    return memory_region_dispatch_read(&proxy->iomem,
+                                       VIRTIO_MMIO_QUEUE_NOTIFY + offset, data,
+                                       virtio_mmio_notify_memop(proxy, size),
+                                       attrs);
+}
+
+static MemTxResult virtio_mmio_notify_write(void *opaque, hwaddr offset,
+                                            uint64_t data, unsigned size,
+                                            MemTxAttrs attrs)
+{
+    VirtIOMMIOProxy *proxy = opaque;
+
+    BQL_LOCK_GUARD();
+    return memory_region_dispatch_write(&proxy->iomem,
+                                        VIRTIO_MMIO_QUEUE_NOTIFY + offset, data,
+                                        virtio_mmio_notify_memop(proxy, size),
+                                        attrs);
+}
+
+static const MemoryRegionOps virtio_legacy_notify_ops = {
+    .read_with_attrs = virtio_mmio_notify_read,
+    .write_with_attrs = virtio_mmio_notify_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static const MemoryRegionOps virtio_notify_ops = {
+    .read_with_attrs = virtio_mmio_notify_read,
+    .write_with_attrs = virtio_mmio_notify_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+};
+
 static void virtio_mmio_update_irq(DeviceState *opaque, uint16_t vector)
 {
     VirtIOMMIOProxy *proxy = VIRTIO_MMIO(opaque);
@@ -770,11 +820,20 @@ static void virtio_mmio_realizefn(DeviceState *d, Error **errp)
         memory_region_init_io(&proxy->iomem, OBJECT(d),
                               &virtio_legacy_mem_ops, proxy,
                               TYPE_VIRTIO_MMIO, 0x200);
+        memory_region_init_io(&proxy->notify, OBJECT(d),
+                              &virtio_legacy_notify_ops, proxy,
+                              TYPE_VIRTIO_MMIO "-notify", 4);
     } else {
         memory_region_init_io(&proxy->iomem, OBJECT(d),
                               &virtio_mem_ops, proxy,
                               TYPE_VIRTIO_MMIO, 0x200);
+        memory_region_init_io(&proxy->notify, OBJECT(d),
+                              &virtio_notify_ops, proxy,
+                              TYPE_VIRTIO_MMIO "-notify", 4);
     }
+    memory_region_clear_global_locking(&proxy->notify);
+    memory_region_add_subregion(&proxy->iomem, VIRTIO_MMIO_QUEUE_NOTIFY,
+                                &proxy->notify);
     sysbus_init_mmio(sbd, &proxy->iomem);
 }
 
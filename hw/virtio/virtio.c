@@ -30,6 +30,7 @@
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio-access.h"
 #include "sysemu/dma.h"
+#include "sysemu/iothread.h"
 #include "sysemu/runstate.h"
 #include "virtio-qmp.h"
 
@@ -145,6 +146,16 @@ struct VirtQueue
 
     unsigned int inuse;
 
+    /* Used elements filled by virtqueue_push_batched() but not flushed */
+    unsigned int batched;
+
+    /* Notification coalescing, see virtio_queue_set_notify_coalescing() */
+    uint32_t coalesce_max_pending;
+    int64_t coalesce_delay_ns;
+    uint32_t coalesce_pending;
+    QEMUTimer *coalesce_timer;
+    AioContext *coalesce_ctx;
+
     uint16_t vector;
     VirtIOHandleOutput handle_output;
     VirtIODevice *vdev;
@@ -987,14 +998,52 @@ void virtqueue_flush(VirtQueue *vq, unsigned int count)
     }
 }
 
+/* Make the elements staged by virtqueue_push_batched() visible */
+static unsigned int virtqueue_flush_batched(VirtQueue *vq)
+{
+    unsigned int count = vq->batched;
+
+    if (count) {
+        RCU_READ_LOCK_GUARD();
+        vq->batched = 0;
+        virtqueue_flush(vq, count);
+    }
+    return count;
+}
+
 void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
                     unsigned int len)
 {
+    virtqueue_flush_batched(vq);
+
     RCU_READ_LOCK_GUARD();
     virtqueue_fill(vq, elem, len, 0);
     virtqueue_flush(vq, 1);
 }
 
+static void virtio_notify_coalesced(VirtQueue *vq, unsigned int count);
+static void virtio_notify_coalesced_reset(VirtQueue *vq);
+
+static void virtqueue_push_batched_deferred_fn(void *opaque)
+{
+    VirtQueue *vq = opaque;
+    unsigned int count = virtqueue_flush_batched(vq);
+
+    trace_virtqueue_push_batched_deferred_fn(vq->vdev, vq, count);
+    if (count) {
+        virtio_notify_coalesced(vq, count);
+    }
+}
+
+void virtqueue_push_batched(VirtQueue *vq, const VirtQueueElement *elem,
+                            unsigned int len)
+{
+    WITH_RCU_READ_LOCK_GUARD() {
+        virtqueue_fill(vq, elem, len, vq->batched++);
+    }
+    defer_call(virtqueue_push_batched_deferred_fn, vq);
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -2087,6 +2136,8 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].notification = true;
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
+    vdev->vq[i].batched = 0;
+    virtio_notify_coalesced_reset(&vdev->vq[i]);
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
 }
 
@@ -2345,6 +2396,8 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    vq->batched = 0;
+    virtio_notify_coalesced_reset(vq);
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -2503,6 +2556,99 @@ void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
     virtio_irq(vq);
 }
 
+static void virtio_notify_pending(VirtQueue *vq)
+{
+    vq->coalesce_pending = 0;
+    if (qemu_in_iothread()) {
+        virtio_notify_irqfd(vq->vdev, vq);
+    } else {
+        virtio_notify(vq->vdev, vq);
+    }
+}
+
+static void virtio_notify_coalesce_timer_cb(void *opaque)
+{
+    VirtQueue *vq = opaque;
+
+    trace_virtio_notify_coalesce_timer(vq->vdev, vq, vq->coalesce_pending);
+    if (vq->coalesce_pending) {
+        virtio_notify_pending(vq);
+    }
+}
+
+/*
+ * Notify the guest about @count new used elements, possibly delaying the
+ * notification until more elements are completed, like interrupt
+ * moderation in a NIC.
+ *
+ * Requests still complete while the VM is stopped, e.g. in the drain that
+ * follows the vmstate change handlers.  Neither the pending count nor the
+ * timer is migrated, and the virtual clock does not run, so notify those
+ * completions right away.
+ */
+static void virtio_notify_coalesced(VirtQueue *vq, unsigned int count)
+{
+    AioContext *ctx;
+
+    vq->coalesce_pending += count;
+    if (!vq->coalesce_delay_ns || !vq->vdev->vm_running ||
+        vq->coalesce_pending >= vq->coalesce_max_pending) {
+        if (vq->coalesce_timer) {
+            timer_del(vq->coalesce_timer);
+        }
+        virtio_notify_pending(vq);
+        return;
+    }
+
+    /* The timer must fire in the thread that processes the queue */
+    ctx = qemu_get_current_aio_context();
+    if (vq->coalesce_ctx != ctx) {
+        if (vq->coalesce_timer) {
+            timer_free(vq->coalesce_timer);
+        }
+        vq->coalesce_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL,
+                                           SCALE_NS,
+                                           virtio_notify_coalesce_timer_cb,
+                                           vq);
+        vq->coalesce_ctx = ctx;
+    }
+
+    if (!timer_pending(vq->coalesce_timer)) {
+        timer_mod(vq->coalesce_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  vq->coalesce_delay_ns);
+    }
+}
+
+/* Deliver a notification held back by coalescing right away */
+static void virtio_notify_coalesced_flush(VirtQueue *vq)
+{
+    if (vq->coalesce_timer) {
+        timer_del(vq->coalesce_timer);
+    }
+    if (vq->coalesce_pending) {
+        vq->coalesce_pending = 0;
+        virtio_notify(vq->vdev, vq);
+    }
+}
+
+static void virtio_notify_coalesced_reset(VirtQueue *vq)
+{
+    if (vq->coalesce_timer) {
+        timer_free(vq->coalesce_timer);
+        vq->coalesce_timer = NULL;
+        vq->coalesce_ctx = NULL;
+    }
+    vq->coalesce_pending = 0;
+}
+
+void virtio_queue_set_notify_coalescing(VirtQueue *vq, uint32_t max_pending,
+                                        uint32_t max_usecs)
+{
+    vq->coalesce_max_pending = max_pending ?: UINT32_MAX;
+    vq->coalesce_delay_ns = (int64_t)max_usecs * SCALE_US;
+}
+
 void virtio_notify_config(VirtIODevice *vdev)
 {
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK))
@@ -3199,7 +3345,16 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     }
 
     if (!backend_run) {
+        int i;
+
         virtio_set_status(vdev, vdev->status);
+
+        /* Do not carry notifications held back by coalescing across stop */
+        for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+            if (vdev->vq[i].vring.num) {
+                virtio_notify_coalesced_flush(&vdev->vq[i]);
+            }
+        }
     }
 }
 
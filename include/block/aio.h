@@ -20,6 +20,7 @@
 #include "qemu/coroutine-core.h"
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
 #include "block/graph-lock.h"
@@ -57,6 +58,23 @@ struct ThreadPool;
 struct LinuxAioState;
 typedef struct LuringState LuringState;
 
+/*
+ * Log2 histograms of durations in nanoseconds: bucket 0 counts zero,
+ * bucket i counts [2^(i-1), 2^i) and the last bucket counts everything
+ * from 2^(AIO_POLL_HIST_BUCKETS - 2) up.
+ */
+#define AIO_POLL_HIST_BUCKETS 32
+
+/* Polling statistics, updated by the AioContext's thread */
+typedef struct AioPollStats {
+    /* polling windows that found an event */
+    Stat64 hits;
+    /* polling windows that ran out before an event */
+    Stat64 misses;
+    /* time a blocking aio_poll() waited for an event */
+    Stat64 wait_time[AIO_POLL_HIST_BUCKETS];
+} AioPollStats;
+
 /* Is polling disabled? */
 bool aio_poll_disabled(AioContext *ctx);
 
@@ -232,6 +250,8 @@ struct AioContext {
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
+    int64_t poll_percentile; /* see aio_context_set_poll_percentile() */
+    AioPollStats poll_stats;
 
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
@@ -698,6 +718,20 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_poll_percentile:
+ * @ctx: the aio context
+ * @percentile: share of events, in percent, that polling should catch
+ *
+ * Instead of growing and shrinking the polling time, set it from the
+ * distribution of the time between two events of each polled handler,
+ * so that polling catches @percentile percent of the events of the
+ * busiest handler.  The polling time is still capped by max_ns, and
+ * polling stops if the percentile is beyond it.  0 restores the
+ * grow/shrink behavior.
+ */
+void aio_context_set_poll_percentile(AioContext *ctx, int64_t percentile);
+
 /**
  * aio_context_set_aio_params:
  * @ctx: the aio context
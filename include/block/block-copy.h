@@ -56,6 +56,10 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
  * must be > 0.
  *
  * @max_chunk means maximum length for one IO operation. Zero means unlimited.
+ *
+ * Both are upper bounds: the limits actually used adapt to the observed
+ * throughput and latency, and the call drops to one sub-request at a time
+ * while block_copy() calls are running.
  */
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
@@ -94,6 +98,13 @@ void block_copy_kick(BlockCopyCallState *call_state);
  */
 void block_copy_call_cancel(BlockCopyCallState *call_state);
 
+/*
+ * Report the current adaptive limits of background calls, and throughput
+ * and latency of all copy requests so far.  May be called outside of
+ * coroutine context.
+ */
+void block_copy_get_stats(BlockCopyState *s, BlockJobInfoBackup *stats);
+
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
@@ -73,6 +73,19 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
+
+/*
+ * luring_register_buf: let io_uring use fixed buffer I/O for requests that
+ * fall within [@host, @host + @size).  Calls are reference counted.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
+
+/*
+ * luring_unregister_fd: must be called before closing a file descriptor
+ * that was passed to luring_co_submit().
+ */
+void luring_unregister_fd(int fd);
 #endif
 
 #ifdef _WIN32
@@ -777,6 +777,7 @@ bool memory_get_xlat_addr(IOMMUTLBEntry *iotlb, void **vaddr,
 
 typedef struct CoalescedMemoryRange CoalescedMemoryRange;
 typedef struct MemoryRegionIoeventfd MemoryRegionIoeventfd;
+typedef struct MemoryRegionIoeventfdArray MemoryRegionIoeventfdArray;
 
 /** MemoryRegion:
  *
@@ -823,12 +824,16 @@ struct MemoryRegion {
     QTAILQ_ENTRY(MemoryRegion) subregions_link;
     QTAILQ_HEAD(, CoalescedMemoryRange) coalesced;
     const char *name;
-    unsigned ioeventfd_nb;
-    MemoryRegionIoeventfd *ioeventfds;
+    MemoryRegionIoeventfdArray *ioeventfds; /* RCU-protected */
     RamDiscardManager *rdm; /* Only for RAM */
 
     /* For devices designed to perform re-entrant IO into their own IO MRs */
     bool disable_reentrancy_guard;
+
+    /* Accessors run under the BQL, see memory_region_clear_global_locking() */
+    bool global_locking;
+    /* If not NULL, taken around the accessors instead of the BQL */
+    QemuMutex *lock;
 };
 
 struct IOMMUMemoryRegion {
@@ -2256,6 +2261,38 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_clear_global_locking: Declares that access processing does
+ *                                     not depend on the BQL.
+ *
+ * By default, the accessors of a region are called with the BQL held.
+ * Once cleared, vCPU threads dispatch accesses to @mr without taking it,
+ * and concurrent accesses from several threads are possible.  The
+ * accessors must then take the BQL themselves (BQL_LOCK_GUARD) around
+ * anything that is not thread-safe, for instance raising interrupts.
+ *
+ * The re-entrancy guard of the owning device is not applied to such
+ * regions, since it relies on the BQL for consistency.  ioeventfds
+ * registered on @mr are still matched, without any lock held.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_clear_global_locking(MemoryRegion *mr);
+
+/**
+ * memory_region_set_lock: Serialize accesses with a device-specific lock.
+ *
+ * Like memory_region_clear_global_locking(), but @lock is held around
+ * the accessors of @mr.  The accessors must not take the BQL, as the
+ * BQL is taken before @lock elsewhere.  The lock is named after @mr in
+ * the output of "info sync-profile -n", so that contention on it can
+ * be told apart from the BQL.
+ *
+ * @mr: the memory region to be updated.
+ * @lock: the lock to be held while calling the accessors of @mr.
+ */
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
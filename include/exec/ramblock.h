@@ -66,6 +66,16 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * Bitmap of pages present in the migration file when the mapped-ram
+     * capability is in use, and the file offsets of that bitmap and of
+     * the region reserved for this block's pages.  Only used on the
+     * migration source; the destination reads the bitmap from the file.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    uint64_t pages_offset;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
@@ -0,0 +1,63 @@
+/*
+ * Persistent translation cache for user-mode emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef EXEC_TB_CACHE_H
+#define EXEC_TB_CACHE_H
+
+#include "exec/vaddr.h"
+
+#ifdef CONFIG_USER_ONLY
+/**
+ * tb_cache_init:
+ * @dir: directory holding the cache files
+ * @exec_path: the guest executable
+ * @cpu_model: the -cpu option in effect
+ *
+ * Enable the cache.  Must be called after tcg_prologue_init(), once
+ * guest_base is fixed.  The cache file used is selected by a hash of
+ * the QEMU build, the contents of @exec_path and the CPU configuration.
+ */
+void tb_cache_init(const char *dir, const char *exec_path,
+                   const char *cpu_model);
+
+/* Merge the blocks translated by this process into the cache file. */
+void tb_cache_save(void);
+
+/*
+ * Hooks for tb_gen_code() and tb-maint.c.  tb_cache_load() fills in
+ * @tb from the cache and returns the size of its code plus search data,
+ * or returns -1 if no usable block was found.
+ */
+int tb_cache_load(TranslationBlock *tb, vaddr pc);
+void tb_cache_record(TranslationBlock *tb, vaddr pc, int search_size);
+void tb_cache_invalidate(TranslationBlock *tb);
+void tb_cache_evict(TranslationBlock *tb);
+void tb_cache_flush(void);
+#else
+static inline int tb_cache_load(TranslationBlock *tb, vaddr pc)
+{
+    return -1;
+}
+
+static inline void tb_cache_record(TranslationBlock *tb, vaddr pc,
+                                   int search_size)
+{
+}
+
+static inline void tb_cache_invalidate(TranslationBlock *tb)
+{
+}
+
+static inline void tb_cache_evict(TranslationBlock *tb)
+{
+}
+
+static inline void tb_cache_flush(void)
+{
+}
+#endif
+
+#endif /* EXEC_TB_CACHE_H */
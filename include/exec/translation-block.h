@@ -77,6 +77,7 @@ struct TranslationBlock {
 #define CF_PARALLEL      0x00008000 /* Generate code for a parallel context */
 #define CF_NOIRQ         0x00010000 /* Generate an uninterruptible TB */
 #define CF_PCREL         0x00020000 /* Opcodes in TB are PC-relative */
+#define CF_TRACE         0x00040000 /* Translate as a trace; see tb_hot */
 #define CF_CLUSTER_MASK  0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 
@@ -88,6 +89,12 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Executions left before the block is retranslated as a trace.
+     * Only maintained by blocks translated with a trace threshold set.
+     */
+    uint32_t hot_count;
+
     struct tb_tc tc;
 
     /*
@@ -74,6 +74,13 @@ typedef enum DisasJumpType {
  * @singlestep_enabled: "Hardware" single stepping enabled.
  * @saved_can_do_io: Known value of cpu->neg.can_do_io, or -1 for unknown.
  * @plugin_enabled: TCG plugin enabled in this TB.
+ * @trace: Building a trace, see translator_trace_edge().
+ * @trace_edges: Forward branches the trace may still follow, or -1
+ *               once no branch may be followed.
+ * @trace_slots: goto_tb slots used by the exits of the trace.
+ * @trace_head: Label at the start of the trace.
+ * @trace_next: Label continuing the trace after the current insn.
+ * @trace_dest: Guest address of @trace_next.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -88,6 +95,12 @@ typedef struct DisasContextBase {
     int8_t saved_can_do_io;
     bool plugin_enabled;
     void *host_addr[2];
+    bool trace;
+    int8_t trace_edges;
+    uint8_t trace_slots;
+    struct TCGLabel *trace_head;
+    struct TCGLabel *trace_next;
+    vaddr trace_dest;
 } DisasContextBase;
 
 /**
@@ -113,6 +126,12 @@ typedef struct DisasContextBase {
  *
  * @disas_log:
  *      Print instruction disassembly to log.
+ *
+ * @trace_continue:
+ *      Optional.  Called when a trace continues at db->trace_dest after
+ *      the current insn.  Emit any code still owed by the insn, such as
+ *      the exit of a conditional branch, and reset the state that tracks
+ *      the pc.  Targets without this hook never build traces.
  */
 typedef struct TranslatorOps {
     void (*init_disas_context)(DisasContextBase *db, CPUState *cpu);
@@ -121,6 +140,7 @@ typedef struct TranslatorOps {
     void (*translate_insn)(DisasContextBase *db, CPUState *cpu);
     void (*tb_stop)(DisasContextBase *db, CPUState *cpu);
     void (*disas_log)(const DisasContextBase *db, CPUState *cpu, FILE *f);
+    void (*trace_continue)(DisasContextBase *db, CPUState *cpu);
 } TranslatorOps;
 
 /**
@@ -159,6 +179,43 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_trace_edge
+ * @db: Disassembly context
+ * @dest: Destination of a direct branch
+ *
+ * When building a trace (CF_TRACE), return a label which continues the
+ * trace at @dest, or NULL if the branch must leave the TB as usual.
+ * A branch back to the start of the trace closes a loop; other branches
+ * are followed only forward, within the first page, and at most one per
+ * insn.  As for goto_tb, the caller must bring the cpu state in line
+ * with @dest before branching to the label.
+ */
+struct TCGLabel *translator_trace_edge(DisasContextBase *db, vaddr dest);
+
+/**
+ * translator_trace_slot
+ * @db: Disassembly context
+ * @n: goto_tb slot chosen by the target
+ *
+ * A trace may have more exits than there are goto_tb slots.  Return the
+ * slot to use for an exit, or -1 if both are in use and the exit must
+ * use goto_ptr instead.  Outside of a trace, return @n.
+ */
+int translator_trace_slot(DisasContextBase *db, int n);
+
+/**
+ * translator_trace_stop
+ * @db: Disassembly context
+ *
+ * Do not follow any further branch: the current insn changes state that
+ * the trace would otherwise be translated for.
+ */
+static inline void translator_trace_stop(DisasContextBase *db)
+{
+    db->trace_edges = -1;
+}
+
 /**
  * translator_io_start
  * @db: Disassembly context
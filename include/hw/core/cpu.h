@@ -28,6 +28,7 @@
 #include "exec/tlb-common.h"
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
+#include "qemu/interval-tree.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
@@ -202,6 +203,9 @@ struct CPUClass {
 /* Use a fully associative victim tlb of 8 entries. */
 #define CPU_VTLB_SIZE 8
 
+/* The number of large pages tracked individually per mmu_idx.  */
+#define CPU_TLB_LARGE_PAGES 32
+
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
  * so the layout is not as critical as that of CPUTLBEntry. This is
@@ -270,11 +274,21 @@ typedef struct CPUTLBDesc {
     /*
      * Describe a region covering all of the large pages allocated
      * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * we must check the large pages for an overlap.  The region is
+     * matched if (addr & large_page_mask) == large_page_addr.
      */
     vaddr large_page_addr;
     vaddr large_page_mask;
+    /*
+     * The large pages themselves, so that only those overlapping a
+     * flushed page need to be flushed.  Once more than
+     * CPU_TLB_LARGE_PAGES are in use, large_page_overflow is set and
+     * a flush within the region flushes the entire tlb.
+     */
+    IntervalTreeRoot large_page_root;
+    IntervalTreeNode large_pages[CPU_TLB_LARGE_PAGES];
+    unsigned n_large_pages;
+    bool large_page_overflow;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -308,6 +322,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /* Flushes of one mmu_idx forced by untracked large pages. */
+    size_t large_page_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -481,6 +497,8 @@ struct CPUState {
     bool exit_request;
     int exclusive_context_count;
     uint32_t cflags_next_tb;
+    /* pc at which the next TB miss builds a trace, or -1; see tb_hot */
+    vaddr trace_pc;
     /* updates protected by BQL */
     uint32_t interrupt_request;
     int singlestep_enabled;
@@ -11,6 +11,7 @@
 #define BCM2835_RNG_H
 
 #include "hw/sysbus.h"
+#include "qemu/thread.h"
 #include "qom/object.h"
 
 #define TYPE_BCM2835_RNG "bcm2835-rng"
@@ -20,6 +21,8 @@ struct BCM2835RngState {
     SysBusDevice busdev;
     MemoryRegion iomem;
 
+    /* Held around MMIO accesses instead of the BQL, protects the registers */
+    QemuMutex lock;
     uint32_t rng_ctrl;
     uint32_t rng_status;
 };
@@ -48,6 +48,8 @@ struct VirtIOBlkConf
     uint32_t max_discard_sectors;
     uint32_t max_write_zeroes_sectors;
     bool x_enable_wce_if_config_wce;
+    uint32_t notify_coalesce_count;
+    uint32_t notify_coalesce_us;
 };
 
 struct VirtIOBlockReq;
@@ -57,6 +57,8 @@ struct VirtIOMMIOProxy {
     /* Generic */
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    /* QueueNotify, accessed without the BQL when ioeventfd is in use */
+    MemoryRegion notify;
     qemu_irq irq;
     bool legacy;
     uint32_t flags;
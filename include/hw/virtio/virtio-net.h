@@ -56,6 +56,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    uint32_t tx_notify_coalesce_count;
+    uint32_t tx_notify_coalesce_us;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -254,6 +254,24 @@ void virtio_delete_queue(VirtQueue *vq);
 void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
                     unsigned int len);
 void virtqueue_flush(VirtQueue *vq, unsigned int count);
+
+/**
+ * virtqueue_push_batched() - complete an element and notify the guest
+ * @vq: the virtqueue
+ * @elem: the element that was popped from @vq
+ * @len: number of bytes written to the element's in buffers
+ *
+ * Like virtqueue_push() followed by virtio_notify(), but inside a
+ * defer_call_begin()/defer_call_end() section the used ring index update
+ * and the notification are done once for all elements completed in the
+ * section.  The notification is also subject to the coalescing settings
+ * of virtio_queue_set_notify_coalescing().
+ *
+ * Must not be mixed with virtqueue_fill()/virtqueue_flush() on the same
+ * virtqueue; virtqueue_push() is fine.
+ */
+void virtqueue_push_batched(VirtQueue *vq, const VirtQueueElement *elem,
+                            unsigned int len);
 void virtqueue_detach_element(VirtQueue *vq, const VirtQueueElement *elem,
                               unsigned int len);
 void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
@@ -277,6 +295,19 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq);
 
+/**
+ * virtio_queue_set_notify_coalescing() - moderate notifications
+ * @vq: the virtqueue
+ * @max_pending: notify once this many elements are completed (0 for no limit)
+ * @max_usecs: longest delay of a notification, 0 disables coalescing
+ *
+ * Applies to notifications sent by virtqueue_push_batched().  A notification
+ * is sent when @max_pending elements have been completed since the last one,
+ * or at the latest @max_usecs after the first of them.
+ */
+void virtio_queue_set_notify_coalescing(VirtQueue *vq, uint32_t max_pending,
+                                        uint32_t max_usecs);
+
 int virtio_save(VirtIODevice *vdev, QEMUFile *f);
 
 extern const VMStateInfo virtio_vmstate_info;
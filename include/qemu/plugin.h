@@ -73,6 +73,7 @@ enum plugin_dyn_cb_type {
 
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
+    PLUGIN_CB_COND,
     PLUGIN_CB_INLINE,
     PLUGIN_N_CB_SUBTYPES,
 };
@@ -90,13 +91,48 @@ struct qemu_plugin_dyn_cb {
     enum qemu_plugin_mem_rw rw;
     /* fields specific to each dyn_cb type go here */
     union {
+        /* @entry.score is NULL for ops on a pointer shared by all vCPUs */
         struct {
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
     };
 };
 
+/*
+ * A scoreboard holds one entry of @element_size bytes per vCPU. Entries
+ * are @stride bytes apart, @stride being @element_size rounded up to the
+ * host cache line size, so that vCPUs never share a line when updating
+ * their own entry from translated code.
+ */
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    size_t stride;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * Return where vCPU 0's copy of @entry lives, and in @stride the distance
+ * to the next vCPU's copy. Without a scoreboard, all vCPUs share @ptr.
+ */
+static inline char *plugin_u64_base(qemu_plugin_u64 entry, void *ptr,
+                                    size_t *stride)
+{
+    if (!entry.score) {
+        *stride = 0;
+        return ptr;
+    }
+    *stride = entry.score->stride;
+    return (char *)entry.score->data + entry.offset;
+}
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
@@ -19,6 +19,12 @@ enum QSPSortBy {
 void qsp_report(size_t max, enum QSPSortBy sort_by,
                 bool callsite_coalesce);
 
+/*
+ * Name @obj in reports that do not coalesce objects; a NULL @name
+ * removes the name.
+ */
+void qsp_set_name(const void *obj, const char *name);
+
 bool qsp_is_enabled(void);
 void qsp_enable(void);
 void qsp_disable(void);
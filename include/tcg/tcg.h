@@ -136,7 +136,8 @@ typedef uint64_t TCGRegSet;
 
 #if !defined(TCG_TARGET_HAS_v64) \
     && !defined(TCG_TARGET_HAS_v128) \
-    && !defined(TCG_TARGET_HAS_v256)
+    && !defined(TCG_TARGET_HAS_v256) \
+    && !defined(TCG_TARGET_HAS_v512)
 #define TCG_TARGET_MAYBE_vec            0
 #define TCG_TARGET_HAS_abs_vec          0
 #define TCG_TARGET_HAS_neg_vec          0
@@ -169,6 +170,9 @@ typedef uint64_t TCGRegSet;
 #ifndef TCG_TARGET_HAS_v256
 #define TCG_TARGET_HAS_v256             0
 #endif
+#ifndef TCG_TARGET_HAS_v512
+#define TCG_TARGET_HAS_v512             0
+#endif
 
 typedef enum TCGOpcode {
 #define DEF(name, oargs, iargs, cargs, flags) INDEX_op_ ## name,
@@ -247,9 +251,10 @@ typedef enum TCGType {
     TCG_TYPE_V64,
     TCG_TYPE_V128,
     TCG_TYPE_V256,
+    TCG_TYPE_V512,
 
     /* Number of different types (integer not enum) */
-#define TCG_TYPE_COUNT  (TCG_TYPE_V256 + 1)
+#define TCG_TYPE_COUNT  (TCG_TYPE_V512 + 1)
 
     /* An alias for the size of the host register.  */
 #if TCG_TARGET_REG_BITS == 32
@@ -413,6 +418,11 @@ typedef struct TCGTemp {
     unsigned int mem_allocated:1;
     unsigned int temp_allocated:1;
     unsigned int temp_subindex:2;
+    /*
+     * For TEMP_CONST, the value is a host address that must be described
+     * by a relocation record; see tcg_constant_ptr_int().
+     */
+    unsigned int host_ptr:1;
 
     int64_t val;
     struct TCGTemp *mem_base;
@@ -476,6 +486,46 @@ static inline TCGRegSet output_pref(const TCGOp *op, unsigned i)
     return i < ARRAY_SIZE(op->output_pref) ? op->output_pref[i] : 0;
 }
 
+/*
+ * Host addresses embedded in generated code, recorded so that the code
+ * can be copied elsewhere and fixed up, as done by the linux-user
+ * persistent translation cache.  Only backends that define
+ * TCG_TARGET_RELOC_RECORDS produce these.
+ */
+typedef enum TCGRelocType {
+    TCG_RELOC_PC32,           /* 32-bit displacement from the field end */
+    TCG_RELOC_ABS64,          /* 64-bit absolute address */
+} TCGRelocType;
+
+typedef enum TCGRelocBase {
+    TCG_RELOC_BASE_TB,        /* the TranslationBlock (rx) */
+    TCG_RELOC_BASE_PROLOGUE,  /* tcg_code_gen_epilogue */
+    TCG_RELOC_BASE_IMAGE,     /* the start of the QEMU executable */
+    TCG_RELOC_BASE_NB,
+} TCGRelocBase;
+
+typedef struct TCGRelocRecord {
+    uint32_t offset;          /* of the field, from the start of the code */
+    uint8_t type;             /* TCGRelocType */
+    uint8_t base;             /* TCGRelocBase */
+    uint16_t pad;
+    int64_t addend;           /* target - base */
+} TCGRelocRecord;
+
+/*
+ * Translation statistics, accumulated per context and summed up by
+ * tcg_dump_op_stats() for "info opcount".
+ */
+typedef struct TCGOpStats {
+    size_t tb_count;
+    size_t op_count;          /* ops emitted by the front end */
+    size_t op_count_opt;      /* ops left after optimization and liveness */
+    size_t code_size;         /* host code bytes, excluding search data */
+    size_t ld_forwarded;      /* env loads replaced by a known value */
+    size_t st_removed;        /* env stores found dead or redundant */
+    size_t label_merged;      /* labels that kept optimizer state */
+} TCGOpStats;
+
 struct TCGContext {
     uint8_t *pool_cur, *pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
@@ -532,6 +582,16 @@ struct TCGContext {
 
     TCGLabel *exitreq_label;
 
+    /*
+     * When non-NULL, the TCGRelocRecords for the TB being generated.
+     * tb_uncacheable is set if the TB refers to host addresses that
+     * cannot be described by a record.
+     */
+    GArray *tb_relocs;
+    bool tb_uncacheable;
+
+    TCGOpStats op_stats;
+
 #ifdef CONFIG_PLUGIN
     /*
      * We keep one plugin_tb struct per TCGContext. Note that on every TB
@@ -755,9 +815,11 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+bool tcg_region_evict(GTraverseFunc func, gpointer user_data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
+void tcg_dump_op_stats(GString *buf);
 
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
@@ -787,6 +849,9 @@ static inline void *tcg_malloc(int size)
 void tcg_func_start(TCGContext *s);
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start);
+bool tcg_apply_relocs(void *rw, const TranslationBlock *tb,
+                      const TCGRelocRecord *relocs, unsigned nb_relocs,
+                      size_t code_size);
 
 void tb_target_set_jmp_target(const TranslationBlock *, int,
                               uintptr_t, uintptr_t);
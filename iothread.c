@@ -168,6 +168,7 @@ static void iothread_set_aio_context_params(EventLoopBase *base, Error **errp)
     if (*errp) {
         return;
     }
+    aio_context_set_poll_percentile(iothread->ctx, iothread->poll_percentile);
 
     aio_context_set_aio_params(iothread->ctx,
                                iothread->parent_obj.aio_max_batch);
@@ -222,16 +223,20 @@ static void iothread_init(EventLoopBase *base, Error **errp)
 typedef struct {
     const char *name;
     ptrdiff_t offset; /* field's byte offset in IOThread struct */
+    int64_t max;
 } IOThreadParamInfo;
 
 static IOThreadParamInfo poll_max_ns_info = {
-    "poll-max-ns", offsetof(IOThread, poll_max_ns),
+    "poll-max-ns", offsetof(IOThread, poll_max_ns), INT64_MAX,
 };
 static IOThreadParamInfo poll_grow_info = {
-    "poll-grow", offsetof(IOThread, poll_grow),
+    "poll-grow", offsetof(IOThread, poll_grow), INT64_MAX,
 };
 static IOThreadParamInfo poll_shrink_info = {
-    "poll-shrink", offsetof(IOThread, poll_shrink),
+    "poll-shrink", offsetof(IOThread, poll_shrink), INT64_MAX,
+};
+static IOThreadParamInfo poll_percentile_info = {
+    "poll-percentile", offsetof(IOThread, poll_percentile), 100,
 };
 
 static void iothread_get_param(Object *obj, Visitor *v,
@@ -254,9 +259,9 @@ static bool iothread_set_param(Object *obj, Visitor *v,
         return false;
     }
 
-    if (value < 0) {
+    if (value < 0 || value > info->max) {
         error_setg(errp, "%s value must be in range [0, %" PRId64 "]",
-                   info->name, INT64_MAX);
+                   info->name, info->max);
         return false;
     }
 
@@ -289,6 +294,8 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
                                     iothread->poll_grow,
                                     iothread->poll_shrink,
                                     errp);
+        aio_context_set_poll_percentile(iothread->ctx,
+                                        iothread->poll_percentile);
     }
 }
 
@@ -311,6 +318,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add(klass, "poll-percentile", "int",
+                              iothread_get_poll_param,
+                              iothread_set_poll_param,
+                              NULL, &poll_percentile_info);
 }
 
 static const TypeInfo iothread_info = {
@@ -356,6 +367,7 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    info->poll_percentile = iothread->poll_percentile;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
 
     QAPI_LIST_APPEND(*tail, info);
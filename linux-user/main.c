@@ -40,6 +40,7 @@
 #include "qemu/plugin.h"
 #include "exec/exec-all.h"
 #include "exec/gdbstub.h"
+#include "exec/tb-cache.h"
 #include "gdbstub/user.h"
 #include "tcg/startup.h"
 #include "qemu/timer.h"
@@ -73,6 +74,7 @@ static const char *argv0;
 static const char *gdbstub;
 static envlist_t *envlist;
 static const char *cpu_model;
+static const char *tb_cache_dir;
 static const char *cpu_type;
 static const char *seed_optarg;
 unsigned long mmap_min_addr;
@@ -445,6 +447,11 @@ static void handle_arg_jitdump(const char *arg)
     perf_enable_jitdump();
 }
 
+static void handle_arg_tb_cache(const char *arg)
+{
+    tb_cache_dir = g_strdup(arg);
+}
+
 static QemuPluginList plugins = QTAILQ_HEAD_INITIALIZER(plugins);
 
 #ifdef CONFIG_PLUGIN
@@ -520,6 +527,8 @@ static const struct qemu_argument arg_table[] = {
      "",           "Generate a /tmp/perf-${pid}.map file for perf"},
     {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
      "",           "Generate a jit-${pid}.dump file for perf"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code in 'dir' across runs"},
     {NULL, NULL, false, NULL, NULL, NULL}
 };
 
@@ -730,6 +739,11 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
     trace_init_file();
+    if (tb_cache_dir && (!QTAILQ_EMPTY(&plugins) || gdbstub)) {
+        warn_report("-tb-cache is not compatible with plugins or the "
+                    "gdbstub, disabling it");
+        tb_cache_dir = NULL;
+    }
     qemu_plugin_load_list(&plugins, &error_fatal);
 
     /* Zero out regs */
@@ -994,6 +1008,10 @@ int main(int argc, char **argv, char **envp)
        the real value of GUEST_BASE into account.  */
     tcg_prologue_init();
 
+    if (tb_cache_dir) {
+        tb_cache_init(tb_cache_dir, exec_path, cpu_model);
+    }
+
     target_cpu_copy_regs(env, regs);
 
     if (gdbstub) {
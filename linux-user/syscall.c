@@ -24,6 +24,7 @@
 #include "qemu/queue.h"
 #include "qemu/plugin.h"
 #include "tcg/startup.h"
+#include "exec/tb-cache.h"
 #include "target_mman.h"
 #include <elf.h>
 #include <endian.h>
@@ -8511,6 +8512,8 @@ static int do_execv(CPUArchState *cpu_env, int dirfd,
     if (is_proc_myself(p, "exe")) {
         exe = exec_path;
     }
+    /* The process image is about to be replaced without exit cleanup. */
+    tb_cache_save();
     ret = is_execveat
         ? safe_execveat(dirfd, exe, argp, envp, flags)
         : safe_execve(exe, argp, envp);
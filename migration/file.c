@@ -7,16 +7,25 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qapi/error.h"
+#include "exec/ramblock.h"
 #include "channel.h"
 #include "file.h"
 #include "migration.h"
 #include "io/channel-file.h"
 #include "io/channel-util.h"
+#include "multifd.h"
+#include "options.h"
 #include "trace.h"
 
 #define OFFSET_OPTION ",offset="
 
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -36,6 +45,34 @@ int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
     return 0;
 }
 
+void file_cleanup_outgoing_migration(void)
+{
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = NULL;
+}
+
+/*
+ * Open one more handle on the outgoing migration file for a multifd
+ * channel.  Channels only ever write at explicit offsets, so the file
+ * is neither truncated nor positioned here.
+ */
+QIOChannel *file_send_channel_create(Error **errp)
+{
+    QIOChannelFile *fioc;
+
+    if (!outgoing_args.fname) {
+        error_setg(errp, "Migration file name not set");
+        return NULL;
+    }
+
+    fioc = qio_channel_file_new_path(outgoing_args.fname, O_WRONLY, 0, errp);
+    if (!fioc) {
+        return NULL;
+    }
+
+    return QIO_CHANNEL(fioc);
+}
+
 void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp)
 {
@@ -52,6 +89,8 @@ void file_start_outgoing_migration(MigrationState *s,
         return;
     }
 
+    outgoing_args.fname = g_strdup(filename);
+
     ioc = QIO_CHANNEL(fioc);
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
         return;
@@ -74,22 +113,128 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp)
     g_autofree char *filename = g_strdup(file_args->filename);
     QIOChannelFile *fioc = NULL;
     uint64_t offset = file_args->offset;
-    QIOChannel *ioc;
+    int channels = 1;
+    int i;
 
     trace_migration_file_incoming(filename);
 
-    fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
-    if (!fioc) {
-        return;
+    /*
+     * With multifd each channel gets its own handle on the file.  The
+     * first one to be accepted becomes the main channel, so all of
+     * them are positioned at the start of the stream.
+     */
+    if (migrate_multifd()) {
+        channels += migrate_multifd_channels();
     }
 
-    ioc = QIO_CHANNEL(fioc);
-    if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
-        return;
+    for (i = 0; i < channels; i++) {
+        QIOChannel *ioc;
+
+        fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+        if (!fioc) {
+            return;
+        }
+
+        ioc = QIO_CHANNEL(fioc);
+        if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
+            object_unref(OBJECT(ioc));
+            return;
+        }
+        qio_channel_set_name(ioc, "migration-file-incoming");
+        qio_channel_add_watch_full(ioc, G_IO_IN,
+                                   file_accept_incoming_migration,
+                                   NULL, NULL,
+                                   g_main_context_get_thread_default());
     }
-    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-file-incoming");
-    qio_channel_add_watch_full(ioc, G_IO_IN,
-                               file_accept_incoming_migration,
-                               NULL, NULL,
-                               g_main_context_get_thread_default());
+}
+
+/*
+ * Write the pages described by @iov to their fixed location in the
+ * region reserved for @block.  Elements that are contiguous in guest
+ * memory are coalesced into a single pwritev() call.
+ */
+int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
+                            int niov, RAMBlock *block, Error **errp)
+{
+    ssize_t ret = 0;
+    int i, slice_idx, slice_num;
+    uintptr_t base, next, offset;
+    size_t len;
+
+    slice_idx = 0;
+    slice_num = 1;
+
+    /*
+     * If the iov array doesn't have contiguous elements, we need to
+     * split it in slices because we only have one file offset for the
+     * whole iov. Do this here so callers don't need to break the iov
+     * array themselves.
+     */
+    for (i = 0; i < niov; i++, slice_num++) {
+        base = (uintptr_t) iov[i].iov_base;
+
+        if (i != niov - 1) {
+            len = iov[i].iov_len;
+            next = (uintptr_t) iov[i + 1].iov_base;
+
+            if (base + len == next) {
+                continue;
+            }
+        }
+
+        /*
+         * Use the offset of the first element of the segment that
+         * we're sending.
+         */
+        offset = (uintptr_t) iov[slice_idx].iov_base - (uintptr_t) block->host;
+        if (offset >= block->used_length) {
+            error_setg(errp, "offset %" PRIxPTR
+                       " outside of ramblock %s range", offset, block->idstr);
+            return -1;
+        }
+
+        len = iov_size(&iov[slice_idx], slice_num);
+        ret = qio_channel_pwritev(ioc, &iov[slice_idx], slice_num,
+                                  block->pages_offset + offset, errp);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret != len) {
+            error_setg(errp, "Partial write of size %zd, expected %zu",
+                       ret, len);
+            return -1;
+        }
+
+        slice_idx += slice_num;
+        slice_num = 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Read @size bytes at @file_offset of the migration file straight into
+ * guest memory at @host.
+ */
+int file_read_ramblock(QIOChannel *ioc, void *host, size_t size,
+                       off_t file_offset, Error **errp)
+{
+    ssize_t ret;
+
+    while (size) {
+        ret = qio_channel_pread(ioc, host, size, file_offset, errp);
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            error_setg(errp, "Unexpected end of migration file at offset %"
+                       PRId64, (int64_t)file_offset);
+            return -1;
+        }
+        host = (uint8_t *)host + ret;
+        file_offset += ret;
+        size -= ret;
+    }
+
+    return 0;
 }
@@ -15,4 +15,10 @@ void file_start_incoming_migration(FileMigrationArgs *file_args, Error **errp);
 void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp);
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp);
+void file_cleanup_outgoing_migration(void);
+QIOChannel *file_send_channel_create(Error **errp);
+int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
+                            int niov, RAMBlock *block, Error **errp);
+int file_read_ramblock(QIOChannel *ioc, void *host, size_t size,
+                       off_t file_offset, Error **errp);
 #endif
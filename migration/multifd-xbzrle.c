@@ -0,0 +1,345 @@
+/*
+ * Multifd XBZRLE compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "exec/ramblock.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "options.h"
+#include "multifd.h"
+#include "page_cache.h"
+#include "xbzrle.h"
+
+/*
+ * The data of a packet starts with one be32 per normal page, followed
+ * by the data of each page:
+ *  - 0: the page did not change since it was last sent, no data
+ *  - page_size: the page is sent as is
+ *  - anything else: that many bytes of XBZRLE encoded difference with
+ *    the version of the page that the destination already has
+ */
+
+struct xbzrle_data {
+    /* copy of the guest page being encoded */
+    uint8_t *current_buf;
+    /* page lengths followed by the page data */
+    uint8_t *buf;
+    /* size of buf */
+    uint32_t buf_len;
+};
+
+/*
+ * Pages that were sent, shared by all the send channels.  It is
+ * created with channel 0 and freed with it, after all the channel
+ * threads are gone.
+ *
+ * A given page is never in flight on two channels at once, as the
+ * channels are synchronized between two passes over guest memory.
+ * The lock of the cache shard only has to protect against other
+ * channels inserting pages in the same shard.
+ */
+static PageCache *xbzrle_cache;
+static uint8_t *xbzrle_zero_page;
+
+static uint32_t xbzrle_buf_len(uint32_t page_size, uint32_t page_count)
+{
+    return page_count * (sizeof(uint32_t) + page_size);
+}
+
+/* Multifd XBZRLE compression */
+
+/**
+ * xbzrle_send_setup: setup send side
+ *
+ * Allocate the buffers of the channel, and the shared page cache.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x;
+
+    if (p->id == 0) {
+        xbzrle_cache = cache_init(migrate_xbzrle_cache_size(),
+                                  p->page_size, errp);
+        if (!xbzrle_cache) {
+            return -1;
+        }
+        xbzrle_zero_page = g_malloc0(p->page_size);
+    }
+
+    x = g_new0(struct xbzrle_data, 1);
+    x->buf_len = xbzrle_buf_len(p->page_size, p->page_count);
+    x->buf = g_try_malloc(x->buf_len);
+    x->current_buf = g_try_malloc(p->page_size);
+    if (!x->buf || !x->current_buf) {
+        g_free(x->buf);
+        g_free(x->current_buf);
+        g_free(x);
+        error_setg(errp, "multifd %u: out of memory for xbzrle buffers",
+                   p->id);
+        return -1;
+    }
+    p->data = x;
+    return 0;
+}
+
+/**
+ * xbzrle_send_cleanup: cleanup send side
+ *
+ * Return the memory of the channel, and of the shared page cache.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->data;
+
+    if (p->id == 0 && xbzrle_cache) {
+        cache_fini(xbzrle_cache);
+        xbzrle_cache = NULL;
+        g_free(xbzrle_zero_page);
+        xbzrle_zero_page = NULL;
+    }
+
+    if (x) {
+        g_free(x->buf);
+        g_free(x->current_buf);
+        g_free(x);
+        p->data = NULL;
+    }
+}
+
+/**
+ * xbzrle_send_page: encode one normal page into @out
+ *
+ * Returns the number of bytes written to @out
+ *
+ * @p: Params for the channel that we are using
+ * @offset: offset of the page in its RAMBlock
+ * @generation: current dirty bitmap generation
+ * @out: where to write the page data, with room for a whole page
+ */
+static uint32_t xbzrle_send_page(MultiFDSendParams *p, ram_addr_t offset,
+                                 uint64_t generation, uint8_t *out)
+{
+    struct xbzrle_data *x = p->data;
+    RAMBlock *block = p->pages->block;
+    ram_addr_t addr = block->offset + offset;
+    uint8_t *cached;
+    int len;
+
+    cache_lock(xbzrle_cache, addr);
+
+    if (!cache_is_cached(xbzrle_cache, addr, generation)) {
+        /*
+         * Send the very copy that goes into the cache, as the guest may
+         * be changing the page under our feet.
+         */
+        memcpy(out, block->host + offset, p->page_size);
+        cache_insert(xbzrle_cache, addr, out, generation);
+        cache_unlock(xbzrle_cache, addr);
+        return p->page_size;
+    }
+
+    cached = get_cached_data(xbzrle_cache, addr);
+    memcpy(x->current_buf, block->host + offset, p->page_size);
+
+    /* keep encoded pages shorter than a page, see the format above */
+    len = xbzrle_encode_buffer(cached, x->current_buf, p->page_size,
+                               out, p->page_size - 1);
+    if (len < 0) {
+        /* encoding would not save anything, send the page as is */
+        memcpy(out, x->current_buf, p->page_size);
+        len = p->page_size;
+    }
+    if (len) {
+        memcpy(cached, x->current_buf, p->page_size);
+    }
+
+    cache_unlock(xbzrle_cache, addr);
+    return len;
+}
+
+/**
+ * xbzrle_send_prepare: prepare data to be able to send
+ *
+ * Encode each normal page against its cached version, and make sure
+ * that the pages sent as zero pages are not delta encoded against
+ * stale data later on.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    struct xbzrle_data *x = p->data;
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    uint32_t pos = pages->normal_num * sizeof(uint32_t);
+    uint32_t i;
+
+    multifd_send_prepare_header(p);
+
+    for (i = 0; i < pages->normal_num; i++) {
+        uint32_t len = xbzrle_send_page(p, pages->offset[i], generation,
+                                        x->buf + pos);
+
+        stl_be_p(x->buf + i * sizeof(uint32_t), len);
+        pos += len;
+    }
+
+    for (i = pages->normal_num; i < pages->num; i++) {
+        ram_addr_t addr = pages->block->offset + pages->offset[i];
+
+        cache_lock(xbzrle_cache, addr);
+        if (cache_is_cached(xbzrle_cache, addr, generation)) {
+            cache_insert(xbzrle_cache, addr, xbzrle_zero_page, generation);
+        }
+        cache_unlock(xbzrle_cache, addr);
+    }
+
+    p->iov[p->iovs_num].iov_base = x->buf;
+    p->iov[p->iovs_num].iov_len = pos;
+    p->iovs_num++;
+    p->next_packet_size = pos;
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+
+    multifd_send_fill_packet(p);
+
+    return 0;
+}
+
+/**
+ * xbzrle_recv_setup: setup receive side
+ *
+ * Allocate the buffer the packets are read into.  The destination
+ * needs no cache, the previous version of each page is in guest memory.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *x = g_new0(struct xbzrle_data, 1);
+
+    x->buf_len = xbzrle_buf_len(p->page_size, p->page_count);
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        g_free(x);
+        error_setg(errp, "multifd %u: out of memory for xbzrle buffer",
+                   p->id);
+        return -1;
+    }
+    p->data = x;
+    return 0;
+}
+
+/**
+ * xbzrle_recv_cleanup: cleanup receive side
+ *
+ * @p: Params for the channel that we are using
+ */
+static void xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *x = p->data;
+
+    g_free(x->buf);
+    x->buf = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the packet, and apply each page to guest memory.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct xbzrle_data *x = p->data;
+    uint32_t pos = p->normal_num * sizeof(uint32_t);
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+    if (in_size > x->buf_len || in_size < pos) {
+        error_setg(errp, "multifd %u: invalid packet size %u", p->id, in_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)x->buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t len = ldl_be_p(x->buf + i * sizeof(uint32_t));
+        uint8_t *page = p->host + p->normal[i];
+
+        if (len > in_size - pos) {
+            error_setg(errp, "multifd %u: page %d overruns the packet",
+                       p->id, i);
+            return -1;
+        }
+
+        if (len == p->page_size) {
+            memcpy(page, x->buf + pos, len);
+        } else if (len &&
+                   xbzrle_decode_buffer(x->buf + pos, len, page,
+                                        p->page_size) < 0) {
+            error_setg(errp, "multifd %u: failed to decode page %d",
+                       p->id, i);
+            return -1;
+        }
+        pos += len;
+    }
+
+    if (pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = xbzrle_send_setup,
+    .send_cleanup = xbzrle_send_cleanup,
+    .send_prepare = xbzrle_send_prepare,
+    .recv_setup = xbzrle_recv_setup,
+    .recv_cleanup = xbzrle_recv_cleanup,
+    .recv_pages = xbzrle_recv_pages
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
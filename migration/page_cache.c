@@ -17,32 +17,76 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/thread.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of places in which a given page can be cached */
+#define PAGE_CACHE_WAYS 4
+
+/* upper bound on the number of independently locked shards */
+#define PAGE_CACHE_MAX_SHARDS 64
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
     uint8_t *it_data;
+    /* hit since the clock hand last went over this item */
+    bool it_ref;
 };
 
+/*
+ * Pages are spread over the shards by page number, so that neighbouring
+ * pages, which are likely to be sent by different multifd channels at
+ * the same time, end up under different locks.  Within a shard the
+ * cache is set associative, with a CLOCK replacement policy per set.
+ */
+typedef struct PageCacheShard {
+    QemuMutex lock;
+    /* num_sets * num_ways items, the ways of a set are contiguous */
+    CacheItem *items;
+    /* clock hand of each set */
+    uint8_t *hands;
+    size_t num_items;
+} PageCacheShard;
+
 struct PageCache {
-    CacheItem *page_cache;
+    PageCacheShard *shards;
     size_t page_size;
     size_t max_num_items;
-    size_t num_items;
+    size_t num_shards;
+    /* number of sets in each shard */
+    size_t num_sets;
+    size_t num_ways;
 };
 
+static void cache_shard_fini(PageCache *cache, PageCacheShard *shard)
+{
+    size_t i;
+
+    if (shard->items) {
+        for (i = 0; i < cache->num_sets * cache->num_ways; i++) {
+            g_free(shard->items[i].it_data);
+        }
+    }
+    g_free(shard->items);
+    shard->items = NULL;
+    g_free(shard->hands);
+    shard->hands = NULL;
+    qemu_mutex_destroy(&shard->lock);
+}
+
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
 {
-    int64_t i;
     size_t num_pages = new_size / page_size;
+    size_t shard_items;
     PageCache *cache;
+    size_t i, j;
 
     if (new_size < page_size) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cache size",
@@ -58,30 +102,52 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     }
 
     /* We prefer not to abort if there is no memory */
-    cache = g_try_malloc(sizeof(*cache));
+    cache = g_try_malloc0(sizeof(*cache));
     if (!cache) {
         error_setg(errp, "Failed to allocate cache");
         return NULL;
     }
     cache->page_size = page_size;
-    cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->num_ways = MIN(PAGE_CACHE_WAYS, num_pages);
+    cache->num_shards = MIN(PAGE_CACHE_MAX_SHARDS,
+                            num_pages / cache->num_ways);
+    shard_items = num_pages / cache->num_shards;
+    cache->num_sets = shard_items / cache->num_ways;
 
-    trace_migration_pagecache_init(cache->max_num_items);
+    trace_migration_pagecache_init(cache->max_num_items, cache->num_shards,
+                                   cache->num_ways);
 
     /* We prefer not to abort if there is no memory */
-    cache->page_cache = g_try_malloc((cache->max_num_items) *
-                                     sizeof(*cache->page_cache));
-    if (!cache->page_cache) {
+    cache->shards = g_try_new0(PageCacheShard, cache->num_shards);
+    if (!cache->shards) {
         error_setg(errp, "Failed to allocate page cache");
         g_free(cache);
         return NULL;
     }
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        cache->page_cache[i].it_data = NULL;
-        cache->page_cache[i].it_age = 0;
-        cache->page_cache[i].it_addr = -1;
+    for (i = 0; i < cache->num_shards; i++) {
+        PageCacheShard *shard = &cache->shards[i];
+
+        qemu_mutex_init(&shard->lock);
+        shard->items = g_try_new(CacheItem, shard_items);
+        shard->hands = g_try_new0(uint8_t, cache->num_sets);
+        if (!shard->items || !shard->hands) {
+            error_setg(errp, "Failed to allocate page cache");
+            for (j = 0; j <= i; j++) {
+                cache_shard_fini(cache, &cache->shards[j]);
+            }
+            g_free(cache->shards);
+            g_free(cache);
+            return NULL;
+        }
+
+        for (j = 0; j < shard_items; j++) {
+            shard->items[j].it_data = NULL;
+            shard->items[j].it_age = 0;
+            shard->items[j].it_addr = -1;
+            shard->items[j].it_ref = false;
+        }
     }
 
     return cache;
@@ -89,42 +155,108 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
 
 void cache_fini(PageCache *cache)
 {
-    int64_t i;
+    size_t i;
 
     g_assert(cache);
-    g_assert(cache->page_cache);
+    g_assert(cache->shards);
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        g_free(cache->page_cache[i].it_data);
+    for (i = 0; i < cache->num_shards; i++) {
+        cache_shard_fini(cache, &cache->shards[i]);
     }
 
-    g_free(cache->page_cache);
-    cache->page_cache = NULL;
+    g_free(cache->shards);
+    cache->shards = NULL;
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+static PageCacheShard *cache_get_shard(const PageCache *cache, uint64_t addr)
+{
+    uint64_t page = addr / cache->page_size;
+
+    g_assert(cache->shards);
+    return &cache->shards[page & (cache->num_shards - 1)];
+}
+
+static size_t cache_get_set(const PageCache *cache, uint64_t addr)
+{
+    uint64_t page = addr / cache->page_size;
+
+    return (page / cache->num_shards) & (cache->num_sets - 1);
+}
+
+void cache_lock(PageCache *cache, uint64_t addr)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    qemu_mutex_lock(&cache_get_shard(cache, addr)->lock);
+}
+
+void cache_unlock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_unlock(&cache_get_shard(cache, addr)->lock);
 }
 
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    PageCacheShard *shard;
+    CacheItem *ways;
+    size_t i;
 
     g_assert(cache);
-    g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
+    shard = cache_get_shard(cache, addr);
+    ways = &shard->items[cache_get_set(cache, addr) * cache->num_ways];
 
-    return &cache->page_cache[pos];
+    for (i = 0; i < cache->num_ways; i++) {
+        if (ways[i].it_addr == addr) {
+            return &ways[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Find where to cache @addr: a free way if there is one, otherwise the
+ * first stale page that was not hit since the clock hand last went over
+ * it.  Pages that are still fresh are never replaced.
+ */
+static CacheItem *cache_get_victim(PageCache *cache, uint64_t addr,
+                                   uint64_t current_age)
+{
+    PageCacheShard *shard = cache_get_shard(cache, addr);
+    size_t set = cache_get_set(cache, addr);
+    CacheItem *ways = &shard->items[set * cache->num_ways];
+    uint8_t *hand = &shard->hands[set];
+    size_t i;
+
+    for (i = 0; i < cache->num_ways; i++) {
+        if (!ways[i].it_data) {
+            return &ways[i];
+        }
+    }
+
+    /* two sweeps, so that cleared reference bits get a second look */
+    for (i = 0; i < 2 * cache->num_ways; i++) {
+        CacheItem *it = &ways[*hand];
+
+        *hand = (*hand + 1) & (cache->num_ways - 1);
+
+        if (it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+            /* the cache page is fresh, don't replace it */
+            continue;
+        }
+        if (it->it_ref) {
+            it->it_ref = false;
+            continue;
+        }
+        return it;
+    }
+    return NULL;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -134,9 +266,10 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
+        it->it_ref = true;
         return true;
     }
     return false;
@@ -150,12 +283,13 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
 
     /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        it = cache_get_victim(cache, addr, current_age);
+        if (!it) {
+            return -1;
+        }
     }
+
     /* allocate page */
     if (!it->it_data) {
         it->it_data = g_try_malloc(cache->page_size);
@@ -163,7 +297,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
             trace_migration_pagecache_insert();
             return -1;
         }
-        cache->num_items++;
+        cache_get_shard(cache, addr)->num_items++;
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
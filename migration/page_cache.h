@@ -15,7 +15,16 @@
 #ifndef PAGE_CACHE_H
 #define PAGE_CACHE_H
 
-/* Page cache for storing guest pages */
+/*
+ * Page cache for storing guest pages
+ *
+ * The cache is split in shards, each with its own lock.  Users that
+ * share a cache between threads must hold the lock of the shard an
+ * address belongs to (see cache_lock()) around cache_is_cached(),
+ * get_cached_data(), cache_insert() and any access to the cached data
+ * for that address.  A cache that is only used by one thread at a time
+ * needs no locking.
+ */
 typedef struct PageCache PageCache;
 
 /**
@@ -35,6 +44,22 @@ PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
  */
 void cache_fini(PageCache *cache);
 
+/**
+ * cache_lock: lock the shard that @addr belongs to
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_lock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_unlock: unlock the shard that @addr belongs to
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_unlock(PageCache *cache, uint64_t addr);
+
 /**
  * cache_is_cached: Checks to see if the page is cached
  *
@@ -59,7 +84,9 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
 
 /**
  * cache_insert: insert the page into the cache. the page cache
- * will dup the data on insert. the previous value will be overwritten
+ * will dup the data on insert. the previous value will be overwritten.
+ * If @addr is not cached yet, it replaces a page that was not used
+ * recently, but never one that is still fresh.
  *
  * Returns -1 when the page isn't inserted into cache
  *
@@ -13,12 +13,238 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
+#include "qemu/bswap.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
+/*
+  page = zrun nzrun
+       | zrun nzrun page
+
+  zrun = length
+
+  nzrun = length byte...
+
+  length = uleb128 encoded integer
+ */
+static int
+xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    uint32_t zrun_len = 0, nzrun_len = 0;
+    int d = 0, i = 0;
+    long res;
+    uint8_t *nzrun_start = NULL;
+
+    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
+               sizeof(long)));
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        /* not aligned to sizeof(long) */
+        res = (slen - i) % sizeof(long);
+        while (res && old_buf[i] == new_buf[i]) {
+            zrun_len++;
+            i++;
+            res--;
+        }
+
+        /* word at a time for speed */
+        if (!res) {
+            while (i < slen &&
+                   (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
+                i += sizeof(long);
+                zrun_len += sizeof(long);
+            }
+
+            /* go over the rest */
+            while (i < slen && old_buf[i] == new_buf[i]) {
+                zrun_len++;
+                i++;
+            }
+        }
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        zrun_len = 0;
+        nzrun_start = new_buf + i;
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+        /* not aligned to sizeof(long) */
+        res = (slen - i) % sizeof(long);
+        while (res && old_buf[i] != new_buf[i]) {
+            i++;
+            nzrun_len++;
+            res--;
+        }
+
+        /* word at a time for speed, use of 32-bit long okay */
+        if (!res) {
+            /* truncation to 32-bit long okay */
+            unsigned long mask = (unsigned long)0x0101010101010101ULL;
+            while (i < slen) {
+                unsigned long xor;
+                xor = *(unsigned long *)(old_buf + i)
+                    ^ *(unsigned long *)(new_buf + i);
+                if ((xor - mask) & ~xor & (mask << 7)) {
+                    /* found the end of an nzrun within the current long */
+                    while (old_buf[i] != new_buf[i]) {
+                        nzrun_len++;
+                        i++;
+                    }
+                    break;
+                } else {
+                    i += sizeof(long);
+                    nzrun_len += sizeof(long);
+                }
+            }
+        }
+
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, nzrun_start, nzrun_len);
+        d += nzrun_len;
+        nzrun_len = 0;
+    }
+
+    return d;
+}
+
+/* Encoders that can run on this host, filled in at startup */
+static XbzrleEncoder xbzrle_encoders[3] = {
+    { "int", xbzrle_encode_buffer_int },
+};
+static int xbzrle_nr_encoders = 1;
+
+static void G_GNUC_UNUSED
+xbzrle_add_encoder(const char *name, XbzrleEncodeFunc *encode)
+{
+    assert(xbzrle_nr_encoders < ARRAY_SIZE(xbzrle_encoders));
+    xbzrle_encoders[xbzrle_nr_encoders++] = (XbzrleEncoder) { name, encode };
+}
+
+int xbzrle_get_encoders(const XbzrleEncoder **encoders)
+{
+    *encoders = xbzrle_encoders;
+    return xbzrle_nr_encoders;
+}
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT) || \
+    (defined(__aarch64__) && defined(__ARM_NEON))
+/*
+ * Vector encoders only differ in how they find the end of a run, so
+ * they share the run-level loop below.  @run_len returns the number of
+ * leading bytes of @a and @b (at most @len) that compare equal if @same,
+ * or different otherwise.  The output is byte for byte the same as the
+ * one of xbzrle_encode_buffer_int().
+ */
+typedef int (*xbzrle_run_len_fn)(const uint8_t *a, const uint8_t *b,
+                                 int len, bool same);
+
+static inline int xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen,
+                                     xbzrle_run_len_fn run_len)
+{
+    int d = 0, i = 0;
+    int zrun_len, nzrun_len;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        zrun_len = run_len(old_buf + i, new_buf + i, slen - i, true);
+        i += zrun_len;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        nzrun_len = run_len(old_buf + i, new_buf + i, slen - i, false);
+        d += uleb128_encode_small(dst + d, nzrun_len);
+
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i += nzrun_len;
+    }
+
+    return d;
+}
+#endif
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
 #include <immintrin.h>
 #include "host/cpuinfo.h"
 
+#ifdef CONFIG_AVX2_OPT
+static int __attribute__((target("avx2")))
+xbzrle_run_len_avx2(const uint8_t *a, const uint8_t *b, int len, bool same)
+{
+    uint32_t want = same ? UINT32_MAX : 0;
+    int i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+
+        if (eq != want) {
+            return i + ctz32(eq ^ want);
+        }
+    }
+    while (i < len && (a[i] == b[i]) == same) {
+        i++;
+    }
+    return i;
+}
+
+static int __attribute__((target("avx2")))
+xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_len_avx2);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512BW_OPT
 static int __attribute__((target("avx512bw")))
 xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
                             uint8_t *dst, int dlen)
@@ -137,19 +363,27 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
-static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
-                                    int slen, uint8_t *dst, int dlen);
+#endif /* CONFIG_AVX512BW_OPT */
 
 static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
 
 static void __attribute__((constructor)) init_accel(void)
 {
     unsigned info = cpuinfo_init();
+
+    accel_func = xbzrle_encode_buffer_int;
+#ifdef CONFIG_AVX2_OPT
+    if (info & CPUINFO_AVX2) {
+        accel_func = xbzrle_encode_buffer_avx2;
+        xbzrle_add_encoder("avx2", xbzrle_encode_buffer_avx2);
+    }
+#endif
+#ifdef CONFIG_AVX512BW_OPT
     if (info & CPUINFO_AVX512BW) {
         accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
+        xbzrle_add_encoder("avx512", xbzrle_encode_buffer_avx512);
     }
+#endif
 }
 
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
@@ -157,120 +391,96 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 {
     return accel_func(old_buf, new_buf, slen, dst, dlen);
 }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
 
-#define xbzrle_encode_buffer xbzrle_encode_buffer_int
-#endif
-
-/*
-  page = zrun nzrun
-       | zrun nzrun page
-
-  zrun = length
-
-  nzrun = length byte...
-
-  length = uleb128 encoded integer
- */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+/* NEON is mandatory on AArch64, so there is nothing to dispatch on. */
+static int xbzrle_run_len_neon(const uint8_t *a, const uint8_t *b,
+                               int len, bool same)
 {
-    uint32_t zrun_len = 0, nzrun_len = 0;
-    int d = 0, i = 0;
-    long res;
-    uint8_t *nzrun_start = NULL;
-
-    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
-               sizeof(long)));
-
-    while (i < slen) {
-        /* overflow */
-        if (d + 2 > dlen) {
-            return -1;
-        }
-
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] == new_buf[i]) {
-            zrun_len++;
-            i++;
-            res--;
-        }
+    uint64_t want = same ? UINT64_MAX : 0;
+    int i = 0;
 
-        /* word at a time for speed */
-        if (!res) {
-            while (i < slen &&
-                   (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
-                i += sizeof(long);
-                zrun_len += sizeof(long);
-            }
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        /* narrow the byte mask to 4 bits per byte */
+        uint8x8_t nib = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nib), 0);
 
-            /* go over the rest */
-            while (i < slen && old_buf[i] == new_buf[i]) {
-                zrun_len++;
-                i++;
-            }
+        if (mask != want) {
+            return i + ctz64(mask ^ want) / 4;
         }
+    }
+    while (i < len && (a[i] == b[i]) == same) {
+        i++;
+    }
+    return i;
+}
 
-        /* buffer unchanged */
-        if (zrun_len == slen) {
-            return 0;
-        }
-
-        /* skip last zero run */
-        if (i == slen) {
-            return d;
-        }
-
-        d += uleb128_encode_small(dst + d, zrun_len);
-
-        zrun_len = 0;
-        nzrun_start = new_buf + i;
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_len_neon);
+}
 
-        /* overflow */
-        if (d + 2 > dlen) {
-            return -1;
-        }
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] != new_buf[i]) {
-            i++;
-            nzrun_len++;
-            res--;
-        }
+static void __attribute__((constructor)) init_accel(void)
+{
+    xbzrle_add_encoder("neon", xbzrle_encode_buffer_neon);
+}
 
-        /* word at a time for speed, use of 32-bit long okay */
-        if (!res) {
-            /* truncation to 32-bit long okay */
-            unsigned long mask = (unsigned long)0x0101010101010101ULL;
-            while (i < slen) {
-                unsigned long xor;
-                xor = *(unsigned long *)(old_buf + i)
-                    ^ *(unsigned long *)(new_buf + i);
-                if ((xor - mask) & ~xor & (mask << 7)) {
-                    /* found the end of an nzrun within the current long */
-                    while (old_buf[i] != new_buf[i]) {
-                        nzrun_len++;
-                        i++;
-                    }
-                    break;
-                } else {
-                    i += sizeof(long);
-                    nzrun_len += sizeof(long);
-                }
-            }
-        }
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_neon(old_buf, new_buf, slen, dst, dlen);
+}
+#else
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_int(old_buf, new_buf, slen, dst, dlen);
+}
+#endif
 
-        d += uleb128_encode_small(dst + d, nzrun_len);
-        /* overflow */
-        if (d + nzrun_len > dlen) {
-            return -1;
-        }
-        memcpy(dst + d, nzrun_start, nzrun_len);
-        d += nzrun_len;
-        nzrun_len = 0;
+/*
+ * Copy a nonzero run.  Runs are mostly short (a few changed words in
+ * a page), so handle them with a pair of possibly overlapping wide
+ * loads and stores instead of a call into memcpy.  Nothing outside
+ * [dst, dst + len) is written, as the bytes around it belong to zero
+ * runs and must be left alone.
+ */
+static inline void xbzrle_copy_run(uint8_t *dst, const uint8_t *src,
+                                   uint32_t len)
+{
+    if (len >= 8 && len <= 16) {
+        uint64_t head = ldq_he_p(src);
+        uint64_t tail = ldq_he_p(src + len - 8);
+
+        stq_he_p(dst, head);
+        stq_he_p(dst + len - 8, tail);
+    } else if (len >= 4 && len < 8) {
+        uint32_t head = ldl_he_p(src);
+        uint32_t tail = ldl_he_p(src + len - 4);
+
+        stl_he_p(dst, head);
+        stl_he_p(dst + len - 4, tail);
+    } else if (len < 4) {
+        dst[0] = src[0];
+        dst[len / 2] = src[len / 2];
+        dst[len - 1] = src[len - 1];
+    } else {
+        memcpy(dst, src, len);
     }
+}
 
-    return d;
+/* Inline the common single byte case of uleb128_decode_small() */
+static inline int xbzrle_decode_len(const uint8_t *in, uint32_t *n)
+{
+    if (likely(!(*in & 0x80))) {
+        *n = *in;
+        return 1;
+    }
+    return uleb128_decode_small(in, n);
 }
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
@@ -286,7 +496,7 @@ int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
             return -1;
         }
 
-        ret = uleb128_decode_small(src + i, &count);
+        ret = xbzrle_decode_len(src + i, &count);
         if (ret < 0 || (i && !count)) {
             return -1;
         }
@@ -303,7 +513,7 @@ int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
             return -1;
         }
 
-        ret = uleb128_decode_small(src + i, &count);
+        ret = xbzrle_decode_len(src + i, &count);
         if (ret < 0 || !count) {
             return -1;
         }
@@ -314,7 +524,7 @@ int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
             return -1;
         }
 
-        memcpy(dst + d, src + i, count);
+        xbzrle_copy_run(dst + d, src + i, count);
         d += count;
         i += count;
     }
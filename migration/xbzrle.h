@@ -19,4 +19,19 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 
+typedef int XbzrleEncodeFunc(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                             uint8_t *dst, int dlen);
+
+typedef struct XbzrleEncoder {
+    const char *name;
+    XbzrleEncodeFunc *encode;
+} XbzrleEncoder;
+
+/*
+ * For testing: return the number of encoders that can run on this host
+ * and store them in @encoders.  The first one is the generic encoder,
+ * whose output the others must match byte for byte.
+ */
+int xbzrle_get_encoders(const XbzrleEncoder **encoders);
+
 #endif
@@ -16,10 +16,12 @@
 #include "qemu/config-file.h"
 #include "qapi/error.h"
 #include "qemu/lockable.h"
+#include "qemu/memalign.h"
 #include "qemu/option.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
 #include "qemu/rcu.h"
+#include "qemu/cacheinfo.h"
 #include "hw/core/cpu.h"
 
 #include "exec/exec-all.h"
@@ -208,11 +210,75 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+static void plugin_scoreboard_resize(struct qemu_plugin_scoreboard *score,
+                                     size_t old_size, size_t new_size)
+{
+    char *data = qemu_memalign(qemu_dcache_linesize, score->stride * new_size);
+
+    memcpy(data, score->data, score->stride * old_size);
+    memset(data + score->stride * old_size, 0,
+           score->stride * (new_size - old_size));
+    qemu_vfree(score->data);
+    score->data = data;
+}
+
+/*
+ * Make room for @cpu in all scoreboards. Translated code embeds the
+ * address of the scoreboards, so they can only move while no vCPU runs,
+ * and the code cache must be flushed before any vCPU resumes.
+ *
+ * In system emulation scoreboards are sized for max_cpus upfront (see
+ * qemu_plugin_load_list()), so this only ever moves them for new
+ * linux-user threads, which are created from a vCPU thread.
+ */
+static void plugin_grow_scoreboards(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t size;
+
+    WITH_QEMU_LOCK_GUARD(&plugin.lock) {
+        if (cpu->cpu_index < plugin.scoreboard_alloc_size) {
+            return;
+        }
+        if (QLIST_EMPTY(&plugin.scoreboards)) {
+            /* nothing to move, just size future scoreboards */
+            while (cpu->cpu_index >= plugin.scoreboard_alloc_size) {
+                plugin.scoreboard_alloc_size *= 2;
+            }
+            return;
+        }
+    }
+
+    /*
+     * Locking order: as in qemu_plugin_user_exit(), start_exclusive()
+     * comes before plugin.lock, and tb_flush() runs without plugin.lock.
+     */
+    g_assert(current_cpu);
+    start_exclusive();
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    size = plugin.scoreboard_alloc_size;
+    while (cpu->cpu_index >= size) {
+        size *= 2;
+    }
+    QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+        plugin_scoreboard_resize(score, plugin.scoreboard_alloc_size, size);
+    }
+    plugin.scoreboard_alloc_size = size;
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    tb_flush(current_cpu);
+    end_exclusive();
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_grow_scoreboards(cpu);
+
     qemu_rec_mutex_lock(&plugin.lock);
+    plugin.num_vcpus = MAX(plugin.num_vcpus, cpu->cpu_index + 1);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
@@ -288,6 +354,24 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->userp = ptr;
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = (qemu_plugin_u64) { NULL, 0 };
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
 }
@@ -305,6 +389,25 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -430,14 +533,19 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    size_t stride;
+    char *base = plugin_u64_base(cb->inline_insn.entry, cb->userp, &stride);
+    uint64_t *val = (uint64_t *)(base + cpu_index * stride);
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -465,7 +573,7 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
             break;
         default:
             g_assert_not_reached();
@@ -531,6 +639,38 @@ void qemu_plugin_user_exit(void)
     qemu_plugin_atexit_cb();
 }
 
+int plugin_num_vcpus(void)
+{
+    return qatomic_read(&plugin.num_vcpus);
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score =
+        g_new0(struct qemu_plugin_scoreboard, 1);
+    size_t size;
+
+    score->element_size = element_size;
+    score->stride = ROUND_UP(MAX(element_size, 1), qemu_dcache_linesize);
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    size = score->stride * plugin.scoreboard_alloc_size;
+    score->data = qemu_memalign(qemu_dcache_linesize, size);
+    memset(score->data, 0, size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    WITH_QEMU_LOCK_GUARD(&plugin.lock) {
+        QLIST_REMOVE(score, entry);
+    }
+    qemu_vfree(score->data);
+    g_free(score);
+}
+
 /*
  * Helpers for *-user to ensure locks are sane across fork() events.
  */
@@ -566,6 +706,8 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
+    plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
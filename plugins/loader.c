@@ -299,6 +299,14 @@ int qemu_plugin_load_list(QemuPluginList *head, Error **errp)
     info->system_emulation = true;
     info->system.smp_vcpus = ms->smp.cpus;
     info->system.max_vcpus = ms->smp.max_cpus;
+    /*
+     * vCPUs are only ever hotplugged up to max_cpus: size scoreboards
+     * for all of them, so that they never have to move with the BQL held.
+     */
+    qemu_rec_mutex_lock(&plugin.lock);
+    plugin.scoreboard_alloc_size = MAX(plugin.scoreboard_alloc_size,
+                                       ms->smp.max_cpus);
+    qemu_rec_mutex_unlock(&plugin.lock);
 #else
     info->system_emulation = false;
 #endif
@@ -207,6 +207,8 @@ void help(void)
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
            "       process (defaults to 8)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
+           "  '-j' specifies how many threads compress data in parallel for '-c'\n"
+           "       (qcow2 only)\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
@@ -1694,6 +1696,7 @@ typedef struct ImgConvertState {
     size_t cluster_sectors;
     size_t buf_sectors;
     long num_coroutines;
+    long compress_threads;
     int running_coroutines;
     Coroutine *co[MAX_COROUTINES];
     int64_t wait_sector_num[MAX_COROUTINES];
@@ -1874,6 +1877,31 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
 }
 
 
+/*
+ * Returns whether the first cluster of @buf contains data, and in @pnum the
+ * number of sectors at the start of @buf that are clusters with the same
+ * status.  @buf starts at a cluster boundary.
+ */
+static bool is_allocated_clusters(ImgConvertState *s, const uint8_t *buf,
+                                  int n, int *pnum)
+{
+    int i = MIN(n, s->cluster_sectors);
+    bool allocated = !buffer_is_zero(buf, i * BDRV_SECTOR_SIZE);
+
+    while (i < n) {
+        int len = MIN(n - i, s->cluster_sectors);
+
+        if (buffer_is_zero(buf + i * BDRV_SECTOR_SIZE,
+                           len * BDRV_SECTOR_SIZE) == allocated) {
+            break;
+        }
+        i += len;
+    }
+
+    *pnum = i;
+    return allocated;
+}
+
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
                                          enum ImgConvertBlockStatus status)
@@ -1897,14 +1925,14 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
              * is real non-zero data, we must write it. Otherwise we can treat
              * it as zero sectors.
              * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
+             * case we can only save the write of completely zeroed
+             * clusters. */
             if (!s->min_sparse ||
                 (!s->compressed &&
                  is_allocated_sectors_min(buf, n, &n, s->min_sparse,
                                           sector_num, s->alignment)) ||
                 (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
+                 is_allocated_clusters(s, buf, n, &n)))
             {
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
@@ -2105,14 +2133,30 @@ static int convert_do_copy(ImgConvertState *s)
         bdrv_graph_rdunlock_main_loop();
     }
 
-    /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+    /*
+     * Allocate buffer for copied data. For compressed images, the buffer
+     * must hold whole clusters.  Only drivers that split compressed writes
+     * themselves accept more than one cluster at a time; they compress the
+     * clusters of a request in parallel, so with -j make requests large
+     * enough to keep all compression threads busy.
+     */
     if (s->compressed) {
+        BlockDriver *drv = blk_bs(s->target)->drv;
+
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        if (s->compress_threads && drv->bdrv_co_pwritev_compressed_part) {
+            s->buf_sectors = MAX(s->buf_sectors,
+                                 2 * s->compress_threads * s->cluster_sectors);
+            s->buf_sectors = MIN(s->buf_sectors, MAX_BUF_SECTORS);
+            s->buf_sectors = MAX(QEMU_ALIGN_DOWN(s->buf_sectors,
+                                                 s->cluster_sectors),
+                                 s->cluster_sectors);
+        } else {
+            s->buf_sectors = s->cluster_sectors;
+        }
     }
 
     while (sector_num < s->total_sectors) {
@@ -2277,7 +2321,7 @@ static int img_convert(int argc, char **argv)
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
             {0, 0, 0, 0}
         };
-        c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
+        c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:j:",
                         long_options, NULL);
         if (c == -1) {
             break;
@@ -2374,6 +2418,13 @@ static int img_convert(int argc, char **argv)
         case 'W':
             s.wr_in_order = false;
             break;
+        case 'j':
+            if (qemu_strtol(optarg, NULL, 0, &s.compress_threads) ||
+                s.compress_threads < 1 || s.compress_threads > INT_MAX) {
+                error_report("Invalid number of compression threads");
+                goto fail_getopt;
+            }
+            break;
         case 'U':
             force_share = true;
             break;
@@ -2426,6 +2477,17 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (s.compress_threads && !s.compressed) {
+        error_report("Use of -j requires -c");
+        goto fail_getopt;
+    }
+
+    if (s.compress_threads && skip_create) {
+        error_report("Use of -j requires creating the target image; "
+                     "set compress-threads in the target options instead");
+        goto fail_getopt;
+    }
+
     if (explict_min_sparse && s.copy_range) {
         error_report("Cannot enable copy offloading when -S is used");
         goto fail_getopt;
@@ -2628,6 +2690,14 @@ static int img_convert(int argc, char **argv)
             goto out;
         }
 
+        if (drv && s.compress_threads &&
+            !drv->bdrv_co_pwritev_compressed_part) {
+            error_report("Parallel compression not supported for this file "
+                         "format");
+            ret = -1;
+            goto out;
+        }
+
         if (encryption || encryptfmt) {
             error_report("Compression and encryption not supported at "
                          "the same time");
@@ -2666,6 +2736,9 @@ static int img_convert(int argc, char **argv)
     if (!skip_create) {
         open_opts = qdict_new();
         qemu_opt_foreach(opts, img_add_key_secrets, open_opts, &error_abort);
+        if (s.compress_threads) {
+            qdict_put_int(open_opts, "compress-threads", s.compress_threads);
+        }
 
         /* Create the new image */
         ret = bdrv_create(drv, out_filename, opts, &local_err);
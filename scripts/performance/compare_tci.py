@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+
+#  Compare the speed of the TCG interpreter (TCI) with native TCG by
+#  running the same guest program under two builds of a user-mode QEMU.
+#
+#  Syntax:
+#  compare_tci.py [-h] [-r <runs>] --tci <qemu executable> \
+#                 --jit <qemu executable> -- \
+#                 <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-r] - Number of runs of each build; the fastest one is reported.
+#
+#  Example of usage:
+#  compare_tci.py --tci build-tci/qemu-x86_64 --jit build/qemu-x86_64 -- \
+#      build/tests/tcg/x86_64-linux-user/sha512
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+
+def run_once(qemu, command):
+    """
+    Run the target command once under the given QEMU executable.
+
+    Parameters:
+    qemu (str): QEMU executable
+    command (list): target executable and its options
+
+    Returns:
+    (float): Wall clock time in seconds
+    """
+    start = time.perf_counter()
+    run = subprocess.run([qemu] + command,
+                         stdout=subprocess.DEVNULL,
+                         stderr=subprocess.PIPE,
+                         check=False)
+    elapsed = time.perf_counter() - start
+    if run.returncode:
+        sys.exit("{} failed with exit code {}:\n{}".format(
+            qemu, run.returncode, run.stderr.decode()))
+    return elapsed
+
+
+def best_time(qemu, command, runs):
+    """
+    Return the fastest of several runs of the target command.
+
+    Parameters:
+    qemu (str): QEMU executable
+    command (list): target executable and its options
+    runs (int): number of runs
+
+    Returns:
+    (float): Wall clock time in seconds
+    """
+    return min(run_once(qemu, command) for _ in range(runs))
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='compare_tci.py [-h] [-r <runs>] --tci <qemu executable> '
+        '--jit <qemu executable> -- '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-r', dest='runs', type=int, default=3,
+                        help='number of runs of each build')
+    parser.add_argument('--tci', dest='tci', required=True,
+                        help='QEMU built with --enable-tcg-interpreter')
+    parser.add_argument('--jit', dest='jit', required=True,
+                        help='QEMU built with a native TCG backend')
+    parser.add_argument('command', type=str, nargs='+',
+                        help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+
+    for qemu in (args.tci, args.jit):
+        if not os.path.isfile(qemu) or not os.access(qemu, os.X_OK):
+            sys.exit("{} is not an executable ... Exiting.".format(qemu))
+    if args.runs < 1:
+        sys.exit("The number of runs must be positive ... Exiting.")
+
+    tci = best_time(args.tci, args.command, args.runs)
+    jit = best_time(args.jit, args.command, args.runs)
+
+    print("TCI:      {:>10.3f} s".format(tci))
+    print("JIT:      {:>10.3f} s".format(jit))
+    print("Slowdown: {:>10.2f}x".format(tci / jit))
+
+
+if __name__ == "__main__":
+    main()
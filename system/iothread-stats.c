@@ -0,0 +1,165 @@
+/*
+ * Statistics of IOThread event loops, exported through query-stats
+ *
+ * This is separate from iothread.c, which is also linked into
+ * qemu-storage-daemon where query-stats is not available.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/module.h"
+#include "qom/object.h"
+#include "block/aio.h"
+#include "qapi/qapi-types-stats.h"
+#include "sysemu/iothread.h"
+#include "sysemu/stats.h"
+
+#define IOTHREAD_STAT_POLL_HITS "poll-hits"
+#define IOTHREAD_STAT_POLL_MISSES "poll-misses"
+#define IOTHREAD_STAT_POLL_TIME "poll-time"
+#define IOTHREAD_STAT_WAIT_TIME "wait-time"
+
+typedef struct IOThreadStatsArgs {
+    StatsResultList **result;
+    strList *names;
+} IOThreadStatsArgs;
+
+static StatsList *iothread_stats_add(StatsList *stats_list, strList *names,
+                                     const char *name, StatsValue *value)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        qapi_free_StatsValue(value);
+        return stats_list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = value;
+
+    QAPI_LIST_PREPEND(stats_list, stats);
+    return stats_list;
+}
+
+static StatsValue *iothread_stats_scalar(uint64_t scalar)
+{
+    StatsValue *value = g_new0(StatsValue, 1);
+
+    value->type = QTYPE_QNUM;
+    value->u.scalar = scalar;
+    return value;
+}
+
+static StatsValue *iothread_stats_hist(Stat64 *buckets)
+{
+    StatsValue *value = g_new0(StatsValue, 1);
+    uint64List **tail = &value->u.list;
+
+    value->type = QTYPE_QLIST;
+    for (int i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+        QAPI_LIST_APPEND(tail, stat64_get(&buckets[i]));
+    }
+    return value;
+}
+
+static int iothread_stats_query(Object *obj, void *opaque)
+{
+    IOThreadStatsArgs *args = opaque;
+    IOThread *iothread;
+    AioContext *ctx;
+    StatsList *stats_list = NULL;
+    StatsResult *entry;
+
+    iothread = (IOThread *)object_dynamic_cast(obj, TYPE_IOTHREAD);
+    if (!iothread || !iothread->ctx) {
+        return 0;
+    }
+    ctx = iothread->ctx;
+
+    stats_list = iothread_stats_add(stats_list, args->names,
+                    IOTHREAD_STAT_WAIT_TIME,
+                    iothread_stats_hist(ctx->poll_stats.wait_time));
+    stats_list = iothread_stats_add(stats_list, args->names,
+                    IOTHREAD_STAT_POLL_TIME,
+                    iothread_stats_scalar(qatomic_read(&ctx->poll_ns)));
+    stats_list = iothread_stats_add(stats_list, args->names,
+                    IOTHREAD_STAT_POLL_MISSES,
+                    iothread_stats_scalar(stat64_get(&ctx->poll_stats.misses)));
+    stats_list = iothread_stats_add(stats_list, args->names,
+                    IOTHREAD_STAT_POLL_HITS,
+                    iothread_stats_scalar(stat64_get(&ctx->poll_stats.hits)));
+    if (!stats_list) {
+        return 0;
+    }
+
+    entry = g_new0(StatsResult, 1);
+    entry->provider = STATS_PROVIDER_IOTHREAD;
+    entry->qom_path = object_get_canonical_path(obj);
+    entry->stats = stats_list;
+    QAPI_LIST_PREPEND(*args->result, entry);
+    return 0;
+}
+
+static void iothread_stats_cb(StatsResultList **result, StatsTarget target,
+                              strList *names, strList *targets, Error **errp)
+{
+    IOThreadStatsArgs args = {
+        .result = result,
+        .names = names,
+    };
+
+    if (target != STATS_TARGET_IOTHREAD) {
+        return;
+    }
+
+    object_child_foreach(object_get_objects_root(), iothread_stats_query,
+                         &args);
+}
+
+static StatsSchemaValueList *iothread_schemas_add(StatsSchemaValueList *list,
+                                                  const char *name,
+                                                  StatsType type,
+                                                  bool nanoseconds)
+{
+    StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+    value->name = g_strdup(name);
+    value->type = type;
+    if (nanoseconds) {
+        value->has_unit = true;
+        value->unit = STATS_UNIT_SECONDS;
+        value->base = 10;
+        value->exponent = -9;
+    }
+
+    QAPI_LIST_PREPEND(list, value);
+    return list;
+}
+
+static void iothread_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    list = iothread_schemas_add(list, IOTHREAD_STAT_WAIT_TIME,
+                                STATS_TYPE_LOG2_HISTOGRAM, true);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_TIME,
+                                STATS_TYPE_INSTANT, true);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_MISSES,
+                                STATS_TYPE_CUMULATIVE, false);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_HITS,
+                                STATS_TYPE_CUMULATIVE, false);
+
+    add_stats_schema(result, STATS_PROVIDER_IOTHREAD, STATS_TARGET_IOTHREAD,
+                     list);
+}
+
+static void iothread_stats_register(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_IOTHREAD, iothread_stats_cb,
+                        iothread_schemas_cb);
+}
+
+module_init(iothread_stats_register, MODULE_INIT_QOM);
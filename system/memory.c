@@ -171,6 +171,16 @@ struct MemoryRegionIoeventfd {
     EventNotifier *e;
 };
 
+/*
+ * The ioeventfds of a region are replaced as a whole, so that they can be
+ * matched without the BQL when the region does not use global locking.
+ */
+struct MemoryRegionIoeventfdArray {
+    struct rcu_head rcu;
+    unsigned nb;
+    MemoryRegionIoeventfd fds[];
+};
+
 static bool memory_region_ioeventfd_before(MemoryRegionIoeventfd *a,
                                            MemoryRegionIoeventfd *b)
 {
@@ -547,8 +557,12 @@ static MemTxResult access_with_adjusted_size(hwaddr addr,
         access_size_max = 4;
     }
 
-    /* Do not allow more than one simultaneous access to a device's IO Regions */
-    if (mr->dev && !mr->disable_reentrancy_guard &&
+    /*
+     * Do not allow more than one simultaneous access to a device's IO Regions.
+     * The guard is protected by the BQL, so it is not available to regions
+     * that are accessed without it.
+     */
+    if (mr->dev && mr->global_locking && !mr->disable_reentrancy_guard &&
         !mr->ram_device && !mr->ram && !mr->rom_device && !mr->readonly) {
         if (mr->dev->mem_reentrancy_guard.engaged_in_io) {
             warn_report_once("Blocked re-entrant IO on MemoryRegion: "
@@ -846,6 +860,7 @@ static void address_space_update_ioeventfds(AddressSpace *as)
     unsigned ioeventfd_nb = 0;
     unsigned ioeventfd_max;
     MemoryRegionIoeventfd *ioeventfds;
+    MemoryRegionIoeventfdArray *mrfds;
     AddrRange tmp;
     unsigned i;
 
@@ -863,8 +878,9 @@ static void address_space_update_ioeventfds(AddressSpace *as)
 
     view = address_space_get_flatview(as);
     FOR_EACH_FLAT_RANGE(fr, view) {
-        for (i = 0; i < fr->mr->ioeventfd_nb; ++i) {
-            tmp = addrrange_shift(fr->mr->ioeventfds[i].addr,
+        mrfds = fr->mr->ioeventfds;
+        for (i = 0; mrfds && i < mrfds->nb; ++i) {
+            tmp = addrrange_shift(mrfds->fds[i].addr,
                                   int128_sub(fr->addr.start,
                                              int128_make64(fr->offset_in_region)));
             if (addrrange_intersects(fr->addr, tmp)) {
@@ -874,7 +890,7 @@ static void address_space_update_ioeventfds(AddressSpace *as)
                     ioeventfds = g_realloc(ioeventfds,
                             ioeventfd_max * sizeof(*ioeventfds));
                 }
-                ioeventfds[ioeventfd_nb-1] = fr->mr->ioeventfds[i];
+                ioeventfds[ioeventfd_nb-1] = mrfds->fds[i];
                 ioeventfds[ioeventfd_nb-1].addr = tmp;
             }
         }
@@ -1276,6 +1292,7 @@ static void memory_region_initfn(Object *obj)
     mr->ops = &unassigned_mem_ops;
     mr->enabled = true;
     mr->romd_mode = true;
+    mr->global_locking = true;
     mr->destructor = memory_region_destructor_none;
     QTAILQ_INIT(&mr->subregions);
     QTAILQ_INIT(&mr->coalesced);
@@ -1456,7 +1473,13 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
+    if (mr->lock) {
+        qemu_mutex_lock(mr->lock);
+    }
     r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    if (mr->lock) {
+        qemu_mutex_unlock(mr->lock);
+    }
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1472,13 +1495,16 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
         .addr = addrrange_make(int128_make64(addr), int128_make64(size)),
         .data = data,
     };
+    MemoryRegionIoeventfdArray *mrfds;
     unsigned i;
 
-    for (i = 0; i < mr->ioeventfd_nb; i++) {
-        ioeventfd.match_data = mr->ioeventfds[i].match_data;
-        ioeventfd.e = mr->ioeventfds[i].e;
+    RCU_READ_LOCK_GUARD();
+    mrfds = qatomic_rcu_read(&mr->ioeventfds);
+    for (i = 0; mrfds && i < mrfds->nb; i++) {
+        ioeventfd.match_data = mrfds->fds[i].match_data;
+        ioeventfd.e = mrfds->fds[i].e;
 
-        if (memory_region_ioeventfd_equal(&ioeventfd, &mr->ioeventfds[i])) {
+        if (memory_region_ioeventfd_equal(&ioeventfd, &mrfds->fds[i])) {
             event_notifier_set(ioeventfd.e);
             return true;
         }
@@ -1487,6 +1513,28 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
+static MemTxResult memory_region_dispatch_write1(MemoryRegion *mr,
+                                                 hwaddr addr,
+                                                 uint64_t data,
+                                                 unsigned int size,
+                                                 MemTxAttrs attrs)
+{
+    if (mr->ops->write) {
+        return access_with_adjusted_size(addr, &data, size,
+                                         mr->ops->impl.min_access_size,
+                                         mr->ops->impl.max_access_size,
+                                         memory_region_write_accessor, mr,
+                                         attrs);
+    } else {
+        return
+            access_with_adjusted_size(addr, &data, size,
+                                      mr->ops->impl.min_access_size,
+                                      mr->ops->impl.max_access_size,
+                                      memory_region_write_with_attrs_accessor,
+                                      mr, attrs);
+    }
+}
+
 MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          hwaddr addr,
                                          uint64_t data,
@@ -1494,6 +1542,7 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
+    MemTxResult r;
 
     if (mr->alias) {
         return memory_region_dispatch_write(mr->alias,
@@ -1517,20 +1566,14 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
         return MEMTX_OK;
     }
 
-    if (mr->ops->write) {
-        return access_with_adjusted_size(addr, &data, size,
-                                         mr->ops->impl.min_access_size,
-                                         mr->ops->impl.max_access_size,
-                                         memory_region_write_accessor, mr,
-                                         attrs);
-    } else {
-        return
-            access_with_adjusted_size(addr, &data, size,
-                                      mr->ops->impl.min_access_size,
-                                      mr->ops->impl.max_access_size,
-                                      memory_region_write_with_attrs_accessor,
-                                      mr, attrs);
+    if (mr->lock) {
+        qemu_mutex_lock(mr->lock);
+    }
+    r = memory_region_dispatch_write1(mr, addr, data, size, attrs);
+    if (mr->lock) {
+        qemu_mutex_unlock(mr->lock);
     }
+    return r;
 }
 
 void memory_region_init_io(MemoryRegion *mr,
@@ -1791,6 +1834,9 @@ static void memory_region_finalize(Object *obj)
     memory_region_clear_coalescing(mr);
     g_free((char *)mr->name);
     g_free(mr->ioeventfds);
+    if (mr->lock) {
+        qsp_set_name(mr->lock, NULL);
+    }
 }
 
 Object *memory_region_owner(MemoryRegion *mr)
@@ -2556,6 +2602,34 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_clear_global_locking(MemoryRegion *mr)
+{
+    mr->global_locking = false;
+}
+
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock)
+{
+    mr->global_locking = false;
+    mr->lock = lock;
+    qsp_set_name(lock, memory_region_name(mr));
+}
+
+/*
+ * Publish a new set of ioeventfds for @mr.  Readers that run without the
+ * BQL may still be looking at the old array, so free it after a grace
+ * period.
+ */
+static void memory_region_replace_ioeventfds(MemoryRegion *mr,
+                                             MemoryRegionIoeventfdArray *new)
+{
+    MemoryRegionIoeventfdArray *old = mr->ioeventfds;
+
+    qatomic_rcu_set(&mr->ioeventfds, new);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
 void memory_region_add_eventfd(MemoryRegion *mr,
                                hwaddr addr,
                                unsigned size,
@@ -2570,23 +2644,28 @@ void memory_region_add_eventfd(MemoryRegion *mr,
         .data = data,
         .e = e,
     };
+    MemoryRegionIoeventfdArray *old = mr->ioeventfds;
+    MemoryRegionIoeventfdArray *new;
+    unsigned nb = old ? old->nb : 0;
     unsigned i;
 
     if (size) {
         adjust_endianness(mr, &mrfd.data, size_memop(size) | MO_TE);
     }
     memory_region_transaction_begin();
-    for (i = 0; i < mr->ioeventfd_nb; ++i) {
-        if (memory_region_ioeventfd_before(&mrfd, &mr->ioeventfds[i])) {
+    for (i = 0; i < nb; ++i) {
+        if (memory_region_ioeventfd_before(&mrfd, &old->fds[i])) {
             break;
         }
     }
-    ++mr->ioeventfd_nb;
-    mr->ioeventfds = g_realloc(mr->ioeventfds,
-                                  sizeof(*mr->ioeventfds) * mr->ioeventfd_nb);
-    memmove(&mr->ioeventfds[i+1], &mr->ioeventfds[i],
-            sizeof(*mr->ioeventfds) * (mr->ioeventfd_nb-1 - i));
-    mr->ioeventfds[i] = mrfd;
+    new = g_malloc(sizeof(*new) + sizeof(new->fds[0]) * (nb + 1));
+    new->nb = nb + 1;
+    if (old) {
+        memcpy(&new->fds[0], &old->fds[0], sizeof(new->fds[0]) * i);
+        memcpy(&new->fds[i + 1], &old->fds[i], sizeof(new->fds[0]) * (nb - i));
+    }
+    new->fds[i] = mrfd;
+    memory_region_replace_ioeventfds(mr, new);
     ioeventfd_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2605,23 +2684,29 @@ void memory_region_del_eventfd(MemoryRegion *mr,
         .data = data,
         .e = e,
     };
+    MemoryRegionIoeventfdArray *old = mr->ioeventfds;
+    MemoryRegionIoeventfdArray *new = NULL;
+    unsigned nb = old ? old->nb : 0;
     unsigned i;
 
     if (size) {
         adjust_endianness(mr, &mrfd.data, size_memop(size) | MO_TE);
     }
     memory_region_transaction_begin();
-    for (i = 0; i < mr->ioeventfd_nb; ++i) {
-        if (memory_region_ioeventfd_equal(&mrfd, &mr->ioeventfds[i])) {
+    for (i = 0; i < nb; ++i) {
+        if (memory_region_ioeventfd_equal(&mrfd, &old->fds[i])) {
             break;
         }
     }
-    assert(i != mr->ioeventfd_nb);
-    memmove(&mr->ioeventfds[i], &mr->ioeventfds[i+1],
-            sizeof(*mr->ioeventfds) * (mr->ioeventfd_nb - (i+1)));
-    --mr->ioeventfd_nb;
-    mr->ioeventfds = g_realloc(mr->ioeventfds,
-                                  sizeof(*mr->ioeventfds)*mr->ioeventfd_nb + 1);
+    assert(i != nb);
+    if (nb > 1) {
+        new = g_malloc(sizeof(*new) + sizeof(new->fds[0]) * (nb - 1));
+        new->nb = nb - 1;
+        memcpy(&new->fds[0], &old->fds[0], sizeof(new->fds[0]) * i);
+        memcpy(&new->fds[i], &old->fds[i + 1],
+               sizeof(new->fds[0]) * (nb - 1 - i));
+    }
+    memory_region_replace_ioeventfds(mr, new);
     ioeventfd_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2410,6 +2410,11 @@ static subpage_t *subpage_init(FlatView *fv, hwaddr base)
     memory_region_init_io(&mmio->iomem, NULL, &subpage_ops, mmio,
                           NULL, TARGET_PAGE_SIZE);
     mmio->iomem.subpage = true;
+    /*
+     * Accesses are forwarded to flatview_read/write, which take the BQL
+     * if the target region needs it.
+     */
+    memory_region_clear_global_locking(&mmio->iomem);
 #if defined(DEBUG_SUBPAGE)
     printf("%s: %p base " HWADDR_FMT_plx " len %08x\n", __func__,
            mmio, base, TARGET_PAGE_SIZE);
@@ -2639,7 +2644,7 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!bql_locked()) {
+    if (mr->global_locking && !bql_locked()) {
         bql_lock();
         release_lock = true;
     }
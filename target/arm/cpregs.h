@@ -126,6 +126,12 @@ enum {
      * equivalent EL1 register when FEAT_NV2 is enabled.
      */
     ARM_CP_NV2_REDIRECT          = 1 << 20,
+    /*
+     * Flag: the read and write hooks of this ARM_CP_IO register are
+     * thread-safe, so the helpers may call them without taking the BQL.
+     * Typically used for counter registers which only sample a clock.
+     */
+    ARM_CP_NO_BQL                = 1 << 21,
 };
 
 /*
@@ -1059,6 +1065,15 @@ static inline bool cpreg_field_is_64bit(const ARMCPRegInfo *ri)
     return (ri->state == ARM_CP_STATE_AA64) || (ri->type & ARM_CP_64BIT);
 }
 
+/*
+ * Return true if the read or write hooks of this register must be
+ * called with the BQL held.
+ */
+static inline bool cpreg_needs_bql(const ARMCPRegInfo *ri)
+{
+    return (ri->type & (ARM_CP_IO | ARM_CP_NO_BQL)) == ARM_CP_IO;
+}
+
 static inline bool cp_access_ok(int current_el,
                                 const ARMCPRegInfo *ri, int isread)
 {
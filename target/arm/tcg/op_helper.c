@@ -874,7 +874,7 @@ void HELPER(set_cp_reg)(CPUARMState *env, const void *rip, uint32_t value)
 {
     const ARMCPRegInfo *ri = rip;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cpreg_needs_bql(ri)) {
         bql_lock();
         ri->writefn(env, ri, value);
         bql_unlock();
@@ -888,7 +888,7 @@ uint32_t HELPER(get_cp_reg)(CPUARMState *env, const void *rip)
     const ARMCPRegInfo *ri = rip;
     uint32_t res;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cpreg_needs_bql(ri)) {
         bql_lock();
         res = ri->readfn(env, ri);
         bql_unlock();
@@ -903,7 +903,7 @@ void HELPER(set_cp_reg64)(CPUARMState *env, const void *rip, uint64_t value)
 {
     const ARMCPRegInfo *ri = rip;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cpreg_needs_bql(ri)) {
         bql_lock();
         ri->writefn(env, ri, value);
         bql_unlock();
@@ -917,7 +917,7 @@ uint64_t HELPER(get_cp_reg64)(CPUARMState *env, const void *rip)
     const ARMCPRegInfo *ri = rip;
     uint64_t res;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cpreg_needs_bql(ri)) {
         bql_lock();
         res = ri->readfn(env, ri);
         bql_unlock();
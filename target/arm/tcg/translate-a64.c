@@ -492,7 +492,24 @@ static inline bool use_goto_tb(DisasContext *s, uint64_t dest)
 
 static void gen_goto_tb(DisasContext *s, int n, int64_t diff)
 {
+    TCGLabel *trace = translator_trace_edge(&s->base, s->pc_curr + diff);
+
+    if (trace) {
+        /* Stay within the trace; see aarch64_tr_trace_continue. */
+        if (tb_cflags(s->base.tb) & CF_PCREL) {
+            gen_a64_update_pc(s, diff);
+        }
+        tcg_gen_br(trace);
+        s->base.is_jmp = DISAS_NORETURN;
+        return;
+    }
     if (use_goto_tb(s, s->pc_curr + diff)) {
+        n = translator_trace_slot(&s->base, n);
+    } else {
+        n = -1;
+    }
+
+    if (n >= 0) {
         /*
          * For pcrel, the pc must always be up-to-date on entry to
          * the linked TB, so that it can use simple additions for all
@@ -1848,6 +1865,7 @@ static bool trans_ISB(DisasContext *s, arg_ISB *a)
      * any pending interrupts immediately.
      */
     reset_btype(s);
+    translator_trace_stop(&s->base);
     gen_goto_tb(s, 0, 4);
     return true;
 }
@@ -1862,6 +1880,7 @@ static bool trans_SB(DisasContext *s, arg_SB *a)
      * MB and end the TB instead.
      */
     tcg_gen_mb(TCG_MO_ALL | TCG_BAR_SC);
+    translator_trace_stop(&s->base);
     gen_goto_tb(s, 0, 4);
     return true;
 }
@@ -14162,6 +14181,7 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     /* If architectural single step active, limit to 1.  */
     if (dc->ss_active) {
         bound = 1;
+        dc->base.trace = false;
     }
     dc->base.max_insns = MIN(dc->base.max_insns, bound);
 }
@@ -14363,6 +14383,14 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
     }
 }
 
+static void aarch64_tr_trace_continue(DisasContextBase *dcbase, CPUState *cpu)
+{
+    DisasContext *dc = container_of(dcbase, DisasContext, base);
+
+    /* For CF_PCREL, gen_goto_tb updated the pc before the branch. */
+    dc->pc_save = dc->base.trace_dest;
+}
+
 static void aarch64_tr_disas_log(const DisasContextBase *dcbase,
                                  CPUState *cpu, FILE *logfile)
 {
@@ -14379,4 +14407,5 @@ const TranslatorOps aarch64_translator_ops = {
     .translate_insn     = aarch64_tr_translate_insn,
     .tb_stop            = aarch64_tr_tb_stop,
     .disas_log          = aarch64_tr_disas_log,
+    .trace_continue     = aarch64_tr_trace_continue,
 };
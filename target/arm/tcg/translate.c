@@ -2534,7 +2534,24 @@ static void gen_goto_ptr(void)
  */
 static void gen_goto_tb(DisasContext *s, int n, target_long diff)
 {
+    TCGLabel *trace = translator_trace_edge(&s->base, s->pc_curr + diff);
+
+    if (trace) {
+        /* Stay within the trace; see arm_tr_trace_continue. */
+        if (tb_cflags(s->base.tb) & CF_PCREL) {
+            gen_update_pc(s, diff);
+        }
+        tcg_gen_br(trace);
+        s->base.is_jmp = DISAS_NORETURN;
+        return;
+    }
     if (translator_use_goto_tb(&s->base, s->pc_curr + diff)) {
+        n = translator_trace_slot(&s->base, n);
+    } else {
+        n = -1;
+    }
+
+    if (n >= 0) {
         /*
          * For pcrel, the pc must always be up-to-date on entry to
          * the linked TB, so that it can use simple additions for all
@@ -8170,6 +8187,8 @@ static bool trans_BLX_i(DisasContext *s, arg_BLX_i *a)
     }
     gen_pc_plus_diff(s, cpu_R[14], curr_insn_len(s) | s->thumb);
     store_cpu_field_constant(!s->thumb, thumb);
+    /* The destination is in the other instruction set. */
+    translator_trace_stop(&s->base);
     /* This jump is computed from an aligned PC: subtract off the low bits. */
     gen_jmp(s, jmp_diff(s, a->imm - (s->pc_curr & 3)));
     return true;
@@ -8276,6 +8295,8 @@ static bool trans_WLS(DisasContext *s, arg_WLS *a)
     if (!dc_isar_feature(aa32_lob, s)) {
         return false;
     }
+    /* Loop state may feed into the TB flags: don't trace past it. */
+    translator_trace_stop(&s->base);
     if (a->rn == 13 || a->rn == 15) {
         /*
          * For WLSTP rn == 15 is a related encoding (LE); the
@@ -8356,6 +8377,8 @@ static bool trans_LE(DisasContext *s, arg_LE *a)
     if (!dc_isar_feature(aa32_lob, s)) {
         return false;
     }
+    /* Loop state may feed into the TB flags: don't trace past it. */
+    translator_trace_stop(&s->base);
     if (a->f && a->tp) {
         return false;
     }
@@ -9196,6 +9219,13 @@ static void arm_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
      *   end the TB
      */
     dc->ss_active = EX_TBFLAG_ANY(tb_flags, SS_ACTIVE);
+    /*
+     * A trace loops back to its start with the IT and ECI state clear,
+     * so only start one outside of those.
+     */
+    if (dc->ss_active || dc->condexec_mask || dc->eci) {
+        dc->base.trace = false;
+    }
     dc->pstate_ss = EX_TBFLAG_ANY(tb_flags, PSTATE__SS);
     dc->is_ldex = false;
 
@@ -9669,6 +9699,20 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
     }
 }
 
+static void arm_tr_trace_continue(DisasContextBase *dcbase, CPUState *cpu)
+{
+    DisasContext *dc = container_of(dcbase, DisasContext, base);
+
+    /* "Condition failed" exit of a conditional branch the trace follows */
+    if (dc->condjmp) {
+        set_disas_label(dc, dc->condlabel);
+        gen_goto_tb(dc, 1, curr_insn_len(dc));
+        dc->condjmp = 0;
+    }
+    /* For CF_PCREL, gen_goto_tb updated the pc before the branch. */
+    dc->pc_save = dc->base.trace_dest;
+}
+
 static void arm_tr_disas_log(const DisasContextBase *dcbase,
                              CPUState *cpu, FILE *logfile)
 {
@@ -9685,6 +9729,7 @@ static const TranslatorOps arm_translator_ops = {
     .translate_insn     = arm_tr_translate_insn,
     .tb_stop            = arm_tr_tb_stop,
     .disas_log          = arm_tr_disas_log,
+    .trace_continue     = arm_tr_trace_continue,
 };
 
 static const TranslatorOps thumb_translator_ops = {
@@ -9694,6 +9739,7 @@ static const TranslatorOps thumb_translator_ops = {
     .translate_insn     = thumb_tr_translate_insn,
     .tb_stop            = arm_tr_tb_stop,
     .disas_log          = arm_tr_disas_log,
+    .trace_continue     = arm_tr_trace_continue,
 };
 
 /* generate intermediate code for basic block 'tb'.  */
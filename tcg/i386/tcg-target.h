@@ -204,6 +204,9 @@ typedef enum {
 #define TCG_TARGET_HAS_v64              have_avx1
 #define TCG_TARGET_HAS_v128             have_avx1
 #define TCG_TARGET_HAS_v256             have_avx2
+/* The 512-bit ops rely on AVX512BW for bytes and AVX512DQ for vpmovm2d/q. */
+#define TCG_TARGET_HAS_v512 \
+    (TCG_TARGET_REG_BITS == 64 && have_avx512bw && have_avx512dq)
 
 #define TCG_TARGET_HAS_andc_vec         1
 #define TCG_TARGET_HAS_orc_vec          have_avx512vl
@@ -248,5 +251,13 @@ typedef enum {
 #define TCG_TARGET_DEFAULT_MO (TCG_MO_ALL & ~TCG_MO_ST_LD)
 #define TCG_TARGET_NEED_LDST_LABELS
 #define TCG_TARGET_NEED_POOL_LABELS
+/*
+ * Only the linux-user translation cache consumes relocation records, and
+ * TCG_RELOC_BASE_IMAGE relies on the ELF linker symbols __ehdr_start/_end.
+ */
+#if TCG_TARGET_REG_BITS == 64 && defined(CONFIG_USER_ONLY) && \
+    defined(CONFIG_LINUX)
+#define TCG_TARGET_RELOC_RECORDS
+#endif
 
 #endif
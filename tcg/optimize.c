@@ -43,6 +43,7 @@ typedef struct MemCopyInfo {
     QSIMPLEQ_ENTRY (MemCopyInfo) next;
     TCGTemp *ts;
     TCGType type;
+    uint32_t seq;     /* op at which the copy was recorded */
 } MemCopyInfo;
 
 typedef struct TempOptInfo {
@@ -53,16 +54,48 @@ typedef struct TempOptInfo {
     uint64_t val;
     uint64_t z_mask;  /* mask bit is 0 if and only if value bit is 0 */
     uint64_t s_mask;  /* a left-aligned mask of clrsb(value) bits. */
+    uint32_t seq;     /* op at which the temp was last written */
 } TempOptInfo;
 
+/*
+ * Forward branches seen so far to a label.  When all of the label's
+ * branches have been seen by the time the label is reached, knowledge
+ * about temps and memory that predates the first of them is still valid.
+ */
+typedef struct LabelOptInfo {
+    uint32_t seq;     /* of the first branch, 0 if none */
+    uint32_t nb_branches;
+} LabelOptInfo;
+
+/*
+ * A store to env whose value has not been observed yet; a later store
+ * covering the same bytes makes it dead.
+ */
+typedef struct PendingStore {
+    TCGOp *op;
+    intptr_t start, last;
+} PendingStore;
+
+#define MAX_PENDING_STORES  8
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
     TCGTempSet temps_used;
+    uint32_t seq;
 
     IntervalTreeRoot mem_copy;
     QSIMPLEQ_HEAD(, MemCopyInfo) mem_free;
 
+    LabelOptInfo *labels;
+    PendingStore stores[MAX_PENDING_STORES];
+    int nb_stores;
+
+    /* Totals for TCGOpStats. */
+    size_t ld_forwarded;
+    size_t st_removed;
+    size_t label_merged;
+
     /* In flight values from optimization. */
     uint64_t a_mask;  /* mask bit is 0 iff value identical to first input */
     uint64_t z_mask;  /* mask bit is 0 iff value bit is 0 */
@@ -169,8 +202,9 @@ static void init_ts_info(OptContext *ctx, TCGTemp *ts)
 
     ti->next_copy = ts;
     ti->prev_copy = ts;
+    ti->seq = 0;
     QSIMPLEQ_INIT(&ti->mem_copy);
-    if (ts->kind == TEMP_CONST) {
+    if (ts->kind == TEMP_CONST && !ts->host_ptr) {
         ti->is_const = true;
         ti->val = ts->val;
         ti->z_mask = ts->val;
@@ -266,6 +300,7 @@ static void reset_ts(OptContext *ctx, TCGTemp *ts)
     ti->is_const = false;
     ti->z_mask = -1;
     ti->s_mask = 0;
+    ti->seq = ctx->seq;
 
     if (!QSIMPLEQ_EMPTY(&ti->mem_copy)) {
         if (ts == nts) {
@@ -303,6 +338,7 @@ static void record_mem_copy(OptContext *ctx, TCGType type,
     mc->itree.start = start;
     mc->itree.last = last;
     mc->type = type;
+    mc->seq = ctx->seq;
     interval_tree_insert(&mc->itree, &ctx->mem_copy);
 
     ts = find_better_copy(ts);
@@ -311,6 +347,111 @@ static void record_mem_copy(OptContext *ctx, TCGType type,
     QSIMPLEQ_INSERT_TAIL(&ti->mem_copy, mc, next);
 }
 
+/*
+ * Forget what was learned at or after op @seq, along with everything
+ * about TEMP_EBB temps, which do not survive the end of a basic block.
+ */
+static void reset_temps_since(OptContext *ctx, uint32_t seq)
+{
+    TCGContext *s = ctx->tcg;
+    int nb_temps = s->nb_temps;
+    MemCopyInfo *mc, *next;
+    int i;
+
+    for (mc = mem_copy_first(ctx, 0, -1); mc; mc = next) {
+        next = mem_copy_next(mc, 0, -1);
+        if (mc->seq >= seq) {
+            remove_mem_copy(ctx, mc);
+        }
+    }
+
+    for (i = find_first_bit(ctx->temps_used.l, nb_temps);
+         i < nb_temps;
+         i = find_next_bit(ctx->temps_used.l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (ts->kind == TEMP_EBB || ts_info(ts)->seq >= seq) {
+            reset_ts(ctx, ts);
+        }
+    }
+}
+
+static void note_branch(OptContext *ctx, TCGLabel *l)
+{
+    LabelOptInfo *li = &ctx->labels[l->id];
+
+    if (li->seq == 0) {
+        li->seq = ctx->seq;
+    }
+    li->nb_branches++;
+}
+
+static void merge_label(OptContext *ctx, TCGLabel *l)
+{
+    LabelOptInfo *li = &ctx->labels[l->id];
+    TCGLabelUse *use;
+    uint32_t n = 0;
+
+    QSIMPLEQ_FOREACH(use, &l->branches, next) {
+        n++;
+    }
+
+    if (n != li->nb_branches) {
+        /* A backward branch: we know nothing about the loop body. */
+        memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        remove_mem_copy_all(ctx);
+        return;
+    }
+
+    reset_temps_since(ctx, n ? li->seq : UINT32_MAX);
+    ctx->label_merged++;
+}
+
+static void forget_stores_in(OptContext *ctx, intptr_t s, intptr_t l)
+{
+    int i, j;
+
+    for (i = j = 0; i < ctx->nb_stores; i++) {
+        PendingStore *ps = &ctx->stores[i];
+        if (ps->last < s || ps->start > l) {
+            ctx->stores[j++] = *ps;
+        }
+    }
+    ctx->nb_stores = j;
+}
+
+static void record_store(OptContext *ctx, TCGOp *op, intptr_t s, intptr_t l)
+{
+    int i, j;
+
+    for (i = j = 0; i < ctx->nb_stores; i++) {
+        PendingStore *ps = &ctx->stores[i];
+        if (ps->start >= s && ps->last <= l) {
+            tcg_op_remove(ctx->tcg, ps->op);
+            ctx->st_removed++;
+        } else {
+            ctx->stores[j++] = *ps;
+        }
+    }
+    if (j == MAX_PENDING_STORES) {
+        memmove(&ctx->stores[0], &ctx->stores[1],
+                sizeof(PendingStore) * --j);
+    }
+    ctx->stores[j++] = (PendingStore){ .op = op, .start = s, .last = l };
+    ctx->nb_stores = j;
+}
+
+/* Note a host memory load of @size bytes, which may read pending stores. */
+static void observe_load(OptContext *ctx, TCGOp *op, int size)
+{
+    if (op->args[1] == tcgv_ptr_arg(tcg_env)) {
+        intptr_t ofs = op->args[2];
+        forget_stores_in(ctx, ofs, ofs + size - 1);
+    } else {
+        ctx->nb_stores = 0;
+    }
+}
+
 static bool ts_are_copies(TCGTemp *ts1, TCGTemp *ts2)
 {
     TCGTemp *i;
@@ -398,6 +539,7 @@ static bool tcg_opt_gen_mov(OptContext *ctx, TCGOp *op, TCGArg dst, TCGArg src)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         /* TCGOP_VECL and TCGOP_VECE remain unchanged.  */
         new_op = INDEX_op_mov_vec;
         break;
@@ -970,14 +1112,33 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     int i, nb_oargs;
 
     /*
-     * We only optimize extended basic blocks.  If the opcode ends a BB
-     * and is not a conditional branch, reset all temp data.
+     * Knowledge flows through conditional branches, as within an extended
+     * basic block, and into a label when every branch to it is a forward
+     * one; only what changed since the first such branch is dropped.
+     * Pending stores may be read wherever control goes next.
      */
     if (def->flags & TCG_OPF_BB_END) {
         ctx->prev_mb = NULL;
-        if (!(def->flags & TCG_OPF_COND_BRANCH)) {
-            memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
-            remove_mem_copy_all(ctx);
+        ctx->nb_stores = 0;
+
+        switch (op->opc) {
+        case INDEX_op_set_label:
+            merge_label(ctx, arg_label(op->args[0]));
+            break;
+        CASE_OP_32_64(brcond):
+            note_branch(ctx, arg_label(op->args[3]));
+            break;
+        case INDEX_op_brcond2_i32:
+            note_branch(ctx, arg_label(op->args[5]));
+            break;
+        case INDEX_op_br:
+            note_branch(ctx, arg_label(op->args[0]));
+            reset_temps_since(ctx, UINT32_MAX);
+            break;
+        default:
+            /* exit_tb, goto_tb and goto_ptr end the lifetime of EBB temps. */
+            reset_temps_since(ctx, UINT32_MAX);
+            break;
         }
         return;
     }
@@ -1097,6 +1258,7 @@ static bool fold_to_not(OptContext *ctx, TCGOp *op, int idx)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         not_op = INDEX_op_not_vec;
         have_not = TCG_TARGET_HAS_not_vec;
         break;
@@ -1530,6 +1692,9 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         remove_mem_copy_all(ctx);
     }
 
+    /* Any helper may read env, and may raise an exception. */
+    ctx->nb_stores = 0;
+
     /* Reset temp data for outputs. */
     for (i = 0; i < nb_oargs; i++) {
         reset_temp(ctx, op->args[i]);
@@ -1673,6 +1838,12 @@ static bool fold_dup2(OptContext *ctx, TCGOp *op)
     return false;
 }
 
+static bool fold_dupm(OptContext *ctx, TCGOp *op)
+{
+    observe_load(ctx, op, 1 << TCGOP_VECE(op));
+    return false;
+}
+
 static bool fold_eqv(OptContext *ctx, TCGOp *op)
 {
     if (fold_const2_commutative(ctx, op) ||
@@ -2081,6 +2252,8 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    /* A fault unwinds to the cpu loop, which reads env. */
+    ctx->nb_stores = 0;
     return false;
 }
 
@@ -2088,6 +2261,8 @@ static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+    /* A fault unwinds to the cpu loop, which reads env. */
+    ctx->nb_stores = 0;
     return false;
 }
 
@@ -2407,6 +2582,7 @@ static bool fold_sub_to_neg(OptContext *ctx, TCGOp *op)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         neg_op = INDEX_op_neg_vec;
         have_neg = (TCG_TARGET_HAS_neg_vec &&
                     tcg_can_emit_vec_op(neg_op, ctx->type, TCGOP_VECE(op)) > 0);
@@ -2457,32 +2633,41 @@ static bool fold_sub2(OptContext *ctx, TCGOp *op)
 
 static bool fold_tcg_ld(OptContext *ctx, TCGOp *op)
 {
+    int size;
+
     /* We can't do any folding with a load, but we can record bits. */
     switch (op->opc) {
     CASE_OP_32_64(ld8s):
         ctx->s_mask = MAKE_64BIT_MASK(8, 56);
+        size = 1;
         break;
     CASE_OP_32_64(ld8u):
         ctx->z_mask = MAKE_64BIT_MASK(0, 8);
         ctx->s_mask = MAKE_64BIT_MASK(9, 55);
+        size = 1;
         break;
     CASE_OP_32_64(ld16s):
         ctx->s_mask = MAKE_64BIT_MASK(16, 48);
+        size = 2;
         break;
     CASE_OP_32_64(ld16u):
         ctx->z_mask = MAKE_64BIT_MASK(0, 16);
         ctx->s_mask = MAKE_64BIT_MASK(17, 47);
+        size = 2;
         break;
     case INDEX_op_ld32s_i64:
         ctx->s_mask = MAKE_64BIT_MASK(32, 32);
+        size = 4;
         break;
     case INDEX_op_ld32u_i64:
         ctx->z_mask = MAKE_64BIT_MASK(0, 32);
         ctx->s_mask = MAKE_64BIT_MASK(33, 31);
+        size = 4;
         break;
     default:
         g_assert_not_reached();
     }
+    observe_load(ctx, op, size);
     return false;
 }
 
@@ -2493,6 +2678,7 @@ static bool fold_tcg_ld_memcopy(OptContext *ctx, TCGOp *op)
     TCGType type;
 
     if (op->args[1] != tcgv_ptr_arg(tcg_env)) {
+        ctx->nb_stores = 0;
         return false;
     }
 
@@ -2501,9 +2687,12 @@ static bool fold_tcg_ld_memcopy(OptContext *ctx, TCGOp *op)
     dst = arg_temp(op->args[0]);
     src = find_mem_copy_for(ctx, type, ofs);
     if (src && src->base_type == type) {
+        /* The load goes away, so it does not observe pending stores. */
+        ctx->ld_forwarded++;
         return tcg_opt_gen_mov(ctx, op, temp_arg(dst), temp_arg(src));
     }
 
+    observe_load(ctx, op, tcg_type_size(type));
     reset_ts(ctx, dst);
     record_mem_copy(ctx, type, dst, ofs, ofs + tcg_type_size(type) - 1);
     return true;
@@ -2540,6 +2729,7 @@ static bool fold_tcg_st(OptContext *ctx, TCGOp *op)
         g_assert_not_reached();
     }
     remove_mem_copy_in(ctx, ofs, ofs + lm1);
+    record_store(ctx, op, ofs, ofs + lm1);
     return false;
 }
 
@@ -2566,6 +2756,7 @@ static bool fold_tcg_st_memcopy(OptContext *ctx, TCGOp *op)
         TCGTemp *prev = find_mem_copy_for(ctx, type, ofs);
         if (src == prev) {
             tcg_op_remove(ctx->tcg, op);
+            ctx->st_removed++;
             return true;
         }
     }
@@ -2573,6 +2764,7 @@ static bool fold_tcg_st_memcopy(OptContext *ctx, TCGOp *op)
     last = ofs + tcg_type_size(type) - 1;
     remove_mem_copy_in(ctx, ofs, last);
     record_mem_copy(ctx, type, src, ofs, last);
+    record_store(ctx, op, ofs, last);
     return false;
 }
 
@@ -2601,6 +2793,9 @@ void tcg_optimize(TCGContext *s)
 
     QSIMPLEQ_INIT(&ctx.mem_free);
 
+    ctx.labels = tcg_malloc(sizeof(LabelOptInfo) * s->nb_labels);
+    memset(ctx.labels, 0, sizeof(LabelOptInfo) * s->nb_labels);
+
     /* Array VALS has an element for each temp.
        If this temp holds a constant then its value is kept in VALS' element.
        If this temp is a copy of other ones then the other copies are
@@ -2616,6 +2811,8 @@ void tcg_optimize(TCGContext *s)
         const TCGOpDef *def;
         bool done = false;
 
+        ctx.seq++;
+
         /* Calls are special. */
         if (opc == INDEX_op_call) {
             fold_call(&ctx, op);
@@ -2691,6 +2888,9 @@ void tcg_optimize(TCGContext *s)
         case INDEX_op_dup2_vec:
             done = fold_dup2(&ctx, op);
             break;
+        case INDEX_op_dupm_vec:
+            done = fold_dupm(&ctx, op);
+            break;
         CASE_OP_32_64_VEC(eqv):
             done = fold_eqv(&ctx, op);
             break;
@@ -2836,4 +3036,11 @@ void tcg_optimize(TCGContext *s)
             finish_folding(&ctx, op);
         }
     }
+
+    qatomic_set(&s->op_stats.ld_forwarded,
+                s->op_stats.ld_forwarded + ctx.ld_forwarded);
+    qatomic_set(&s->op_stats.st_removed,
+                s->op_stats.st_removed + ctx.st_removed);
+    qatomic_set(&s->op_stats.label_merged,
+                s->op_stats.label_merged + ctx.label_merged);
 }
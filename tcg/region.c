@@ -72,6 +72,19 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /*
+     * Regions that have been filled and are no longer used by any
+     * context, oldest first, as a ring of @n entries starting at
+     * @full_head.  These are the candidates for eviction.
+     */
+    size_t *full;
+    size_t full_head;
+    size_t n_full;
+    size_t *full_size; /* contribution to agg_size_full, by region index */
+    /* Regions emptied by eviction, to be reused before @current. */
+    size_t *free;
+    size_t n_free;
 };
 
 static struct tcg_region_state region;
@@ -191,10 +204,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, within the rw buffer. */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    if (p < region.start_aligned) {
+        return 0;
+    } else {
+        ptrdiff_t offset = p - region.start_aligned;
 
+        if (offset > region.stride * (region.n - 1)) {
+            return region.n - 1;
+        }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -205,19 +231,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
             return NULL;
         }
     }
-
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -359,6 +373,10 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
+    if (region.n_free) {
+        tcg_region_assign(s, region.free[--region.n_free]);
+        return false;
+    }
     if (region.current == region.n) {
         return true;
     }
@@ -377,10 +395,16 @@ bool tcg_region_alloc(TCGContext *s)
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
 
+    size_t prev = tcg_region_index(s->code_gen_buffer);
+
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
+        size_t i = (region.full_head + region.n_full++) % region.n;
+
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.full[i] = prev;
+        region.full_size[prev] = size_full - TCG_HIGHWATER;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -412,6 +436,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.full_head = 0;
+    region.n_full = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,34 +449,71 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Evict the least recently filled region that no context is using:
+ * call @func on each TB within it, forget those TBs and make the region
+ * available for reuse.  Call from a safe-work context, so that no TB
+ * in the region can be executing.
+ * Returns false if there is no such region.
+ */
+bool tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt;
+    size_t idx;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.n_full == 0) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+    idx = region.full[region.full_head];
+    region.full_head = (region.full_head + 1) % region.n;
+    region.n_full--;
+    region.agg_size_full -= region.full_size[idx];
+    qemu_mutex_unlock(&region.lock);
+
+    rt = region_trees + idx * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, func, user_data);
+    /* Increment the refcount first so that destroy acts as a reset */
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    qemu_mutex_lock(&region.lock);
+    region.free[region.n_free++] = idx;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
+/* The number of regions to use when there is a single context.  */
+#define TCG_EVICT_REGIONS  8
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
-#ifdef CONFIG_USER_ONLY
-    return 1;
-#else
-    size_t n_regions;
+    /* Try for regions of at least 2 MB.  */
+    size_t n_regions = tb_size / (2 * MiB);
 
-    /*
-     * It is likely that some vCPUs will translate more code than others,
-     * so we first try to set more regions than max_cpus, with those regions
-     * being of reasonable size. If that's not possible we make do by evenly
-     * dividing the code_gen_buffer among the vCPUs.
-     */
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+#ifndef CONFIG_USER_ONLY
+    if (max_cpus > 1 && qemu_tcg_mttcg_enabled()) {
+        /*
+         * It is likely that some vCPUs will translate more code than
+         * others, so we first try to set more regions than max_cpus.
+         * If that's not possible we make do by evenly dividing the
+         * code_gen_buffer among the vCPUs.
+         */
+        if (n_regions <= max_cpus) {
+            return max_cpus;
+        }
+        return MIN(n_regions, max_cpus * 8);
     }
+#endif
 
     /*
-     * Try to have more regions than max_cpus, with each region being >= 2 MB.
-     * If we can't, then just allocate one region per vCPU thread.
+     * Even with a single context, split the buffer so that once it
+     * fills we can evict the oldest code one region at a time.
      */
-    n_regions = tb_size / (2 * MiB);
-    if (n_regions <= max_cpus) {
-        return max_cpus;
-    }
-    return MIN(n_regions, max_cpus * 8);
-#endif
+    return MAX(1, MIN(n_regions, TCG_EVICT_REGIONS));
 }
 
 /*
@@ -851,6 +915,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     }
 
     tcg_region_trees_init();
+    region.full = g_new(size_t, region.n);
+    region.full_size = g_new0(size_t, region.n);
+    region.free = g_new(size_t, region.n);
 
     /*
      * Leave the initial context initialized to the first region.
@@ -28,6 +28,7 @@
 #undef DEBUG_JIT
 
 #include "qemu/error-report.h"
+#include "qemu/bswap.h"
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
 #include "qemu/qemu-print.h"
@@ -178,6 +179,17 @@ static bool tcg_target_const_match(int64_t val, int ct,
 #ifdef TCG_TARGET_NEED_LDST_LABELS
 static int tcg_out_ldst_finalize(TCGContext *s);
 #endif
+#ifdef TCG_TARGET_RELOC_RECORDS
+static void tcg_record_reloc(TCGContext *s, tcg_insn_unit *field,
+                             TCGRelocType type, uintptr_t target);
+static void tcg_out_movi_reloc(TCGContext *s, TCGReg ret, uintptr_t arg);
+
+/* Whether the backend must describe host addresses in the current TB. */
+static inline bool tcg_reloc_recording(TCGContext *s)
+{
+    return s->tb_relocs && s->gen_tb;
+}
+#endif
 
 #ifndef CONFIG_USER_ONLY
 #define guest_base  ({ qemu_build_not_reached(); (uintptr_t)0; })
@@ -1684,6 +1696,7 @@ TCGTemp *tcg_temp_new_internal(TCGType type, TCGTempKind kind)
     case TCG_TYPE_V64:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         n = 1;
         break;
     case TCG_TYPE_I64:
@@ -1775,6 +1788,9 @@ TCGv_vec tcg_temp_new_vec(TCGType type)
     case TCG_TYPE_V256:
         assert(TCG_TARGET_HAS_v256);
         break;
+    case TCG_TYPE_V512:
+        assert(TCG_TARGET_HAS_v512);
+        break;
     default:
         g_assert_not_reached();
     }
@@ -1907,6 +1923,25 @@ TCGv_i64 tcg_constant_i64(int64_t val)
 
 TCGv_ptr tcg_constant_ptr_int(intptr_t val)
 {
+#ifdef TCG_TARGET_RELOC_RECORDS
+    /*
+     * The value is a host address.  While relocations are being recorded,
+     * give it a constant of its own that is not shared with integers of
+     * the same value and not folded by the optimizer; the register
+     * allocator then loads it with tcg_out_movi_reloc().
+     */
+    if (val && tcg_reloc_recording(tcg_ctx)) {
+        TCGTemp *ts = tcg_temp_alloc(tcg_ctx);
+
+        ts->base_type = TCG_TYPE_PTR;
+        ts->type = TCG_TYPE_PTR;
+        ts->kind = TEMP_CONST;
+        ts->temp_allocated = 1;
+        ts->host_ptr = 1;
+        ts->val = val;
+        return temp_tcgv_ptr(ts);
+    }
+#endif
     return temp_tcgv_ptr(tcg_constant_internal(TCG_TYPE_PTR, val));
 }
 
@@ -1948,7 +1983,8 @@ TCGTemp *tcgv_i32_temp(TCGv_i32 v)
 bool tcg_op_supported(TCGOpcode op)
 {
     const bool have_vec
-        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256;
+        = TCG_TARGET_HAS_v64 | TCG_TARGET_HAS_v128 | TCG_TARGET_HAS_v256
+        | TCG_TARGET_HAS_v512;
 
     switch (op) {
     case INDEX_op_discard:
@@ -2453,6 +2489,7 @@ static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
         case TCG_TYPE_V64:
         case TCG_TYPE_V128:
         case TCG_TYPE_V256:
+        case TCG_TYPE_V512:
             snprintf(buf, buf_size, "v%d$0x%" PRIx64,
                      64 << (ts->type - TCG_TYPE_V64), ts->val);
             break;
@@ -4115,8 +4152,9 @@ static void temp_allocate_frame(TCGContext *s, TCGTemp *ts)
     case TCG_TYPE_I128:
     case TCG_TYPE_V128:
     case TCG_TYPE_V256:
+    case TCG_TYPE_V512:
         /*
-         * Note that we do not require aligned storage for V256,
+         * Note that we do not require aligned storage for V256 or V512,
          * and that we provide alignment for I128 to match V128,
          * even if that's above what the host ABI requires.
          */
@@ -4244,7 +4282,7 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
             /* If we're going to free the temp immediately, then we won't
                require it later in a register, so attempt to store the
                constant to memory directly.  */
-            if (free_or_dead
+            if (free_or_dead && !ts->host_ptr
                 && tcg_out_sti(s, ts->type, ts->val,
                                ts->mem_base->reg, ts->mem_offset)) {
                 break;
@@ -4412,7 +4450,13 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
     case TEMP_VAL_CONST:
         reg = tcg_reg_alloc(s, desired_regs, allocated_regs,
                             preferred_regs, ts->indirect_base);
-        if (ts->type <= TCG_TYPE_I64) {
+        if (unlikely(ts->host_ptr)) {
+#ifdef TCG_TARGET_RELOC_RECORDS
+            tcg_out_movi_reloc(s, reg, ts->val);
+#else
+            g_assert_not_reached();
+#endif
+        } else if (ts->type <= TCG_TYPE_I64) {
             tcg_out_movi(s, ts->type, reg, ts->val);
         } else {
             uint64_t val = ts->val;
@@ -4586,7 +4630,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
     otype = ots->type;
     itype = ts->type;
 
-    if (ts->val_type == TEMP_VAL_CONST) {
+    if (ts->val_type == TEMP_VAL_CONST && !ts->host_ptr) {
         /* propagate constant or generate sti */
         tcg_target_ulong val = ts->val;
         if (IS_DEAD_ARG(1)) {
@@ -4600,7 +4644,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
        to have it in a register in order to perform the copy.  Copy
        the SOURCE value into its own register first, that way we
        don't have to reload SOURCE the next time it is used. */
-    if (ts->val_type == TEMP_VAL_MEM) {
+    if (ts->val_type != TEMP_VAL_REG) {
         temp_load(s, ts, tcg_target_available_regs[itype],
                   allocated_regs, preferred_regs);
     }
@@ -4839,7 +4883,7 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
         arg_ct = &def->args_ct[i];
         ts = arg_temp(arg);
 
-        if (ts->val_type == TEMP_VAL_CONST
+        if (ts->val_type == TEMP_VAL_CONST && !ts->host_ptr
             && tcg_target_const_match(ts->val, arg_ct->ct, ts->type,
                                       op_cond, TCGOP_VECE(op))) {
             /* constant is OK for instruction */
@@ -6064,7 +6108,7 @@ static void tcg_out_st_helper_args(TCGContext *s, const TCGLabelQemuLdst *ldst,
 
 int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
 {
-    int i, start_words, num_insns;
+    int i, start_words, num_insns, nb_ops_in;
     TCGOp *op;
 
     if (unlikely(qemu_loglevel_mask(CPU_LOG_TB_OP)
@@ -6095,6 +6139,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     }
 #endif
 
+    nb_ops_in = s->nb_ops;
     tcg_optimize(s);
 
     reachable_code_pass(s);
@@ -6124,7 +6169,8 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
                  && qemu_log_in_addr_range(pc_start))) {
         FILE *logfile = qemu_log_trylock();
         if (logfile) {
-            fprintf(logfile, "OP after optimization and liveness analysis:\n");
+            fprintf(logfile, "OP after optimization and liveness analysis "
+                    "(%d of %d ops):\n", s->nb_ops, nb_ops_in);
             tcg_dump_ops(s, logfile, true);
             fprintf(logfile, "\n");
             qemu_log_unlock(logfile);
@@ -6147,6 +6193,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     s->code_buf = tcg_splitwx_to_rw(tb->tc.ptr);
     s->code_ptr = s->code_buf;
 
+    if (s->tb_relocs) {
+        g_array_set_size(s->tb_relocs, 0);
+    }
+
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_INIT(&s->ldst_labels);
 #endif
@@ -6255,9 +6305,167 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
                         tcg_ptr_byte_diff(s->code_ptr, s->code_buf));
 #endif
 
+    /* Only the owning thread writes; readers tolerate torn totals. */
+    qatomic_set(&s->op_stats.tb_count, s->op_stats.tb_count + 1);
+    qatomic_set(&s->op_stats.op_count, s->op_stats.op_count + nb_ops_in);
+    qatomic_set(&s->op_stats.op_count_opt,
+                s->op_stats.op_count_opt + s->nb_ops);
+    qatomic_set(&s->op_stats.code_size,
+                s->op_stats.code_size + tcg_current_code_size(s));
+
     return tcg_current_code_size(s);
 }
 
+void tcg_dump_op_stats(GString *buf)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    TCGOpStats tot = { };
+
+    for (unsigned int i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+        const TCGOpStats *st = &s->op_stats;
+
+        tot.tb_count += qatomic_read(&st->tb_count);
+        tot.op_count += qatomic_read(&st->op_count);
+        tot.op_count_opt += qatomic_read(&st->op_count_opt);
+        tot.code_size += qatomic_read(&st->code_size);
+        tot.ld_forwarded += qatomic_read(&st->ld_forwarded);
+        tot.st_removed += qatomic_read(&st->st_removed);
+        tot.label_merged += qatomic_read(&st->label_merged);
+    }
+
+    g_string_append_printf(buf, "translated TBs      %zu\n", tot.tb_count);
+    g_string_append_printf(buf, "avg ops/TB          %0.1f before opt, "
+                           "%0.1f after (%0.1f%% removed)\n",
+                           tot.tb_count ?
+                           (double)tot.op_count / tot.tb_count : 0,
+                           tot.tb_count ?
+                           (double)tot.op_count_opt / tot.tb_count : 0,
+                           tot.op_count ?
+                           100.0 - (double)tot.op_count_opt * 100 /
+                           tot.op_count : 0);
+    g_string_append_printf(buf, "avg host code/TB    %zu bytes\n",
+                           tot.tb_count ? tot.code_size / tot.tb_count : 0);
+    g_string_append_printf(buf, "env loads forwarded %zu\n",
+                           tot.ld_forwarded);
+    g_string_append_printf(buf, "env stores removed  %zu\n", tot.st_removed);
+    g_string_append_printf(buf, "labels merged       %zu\n",
+                           tot.label_merged);
+}
+
+#ifdef TCG_TARGET_RELOC_RECORDS
+/* Provided by the linker: the extent of the QEMU executable image. */
+extern const char __ehdr_start[], _end[];
+
+static uintptr_t tcg_reloc_base(TCGRelocBase base, const void *tb_rx)
+{
+    switch (base) {
+    case TCG_RELOC_BASE_TB:
+        return (uintptr_t)tb_rx;
+    case TCG_RELOC_BASE_PROLOGUE:
+        return (uintptr_t)tcg_code_gen_epilogue;
+    case TCG_RELOC_BASE_IMAGE:
+        return (uintptr_t)__ehdr_start;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/*
+ * Describe the host address @target, stored in the field at @field
+ * of the TB being generated, relative to something that can be located
+ * again when the code is copied into another process.
+ */
+static void tcg_record_reloc(TCGContext *s, tcg_insn_unit *field,
+                             TCGRelocType type, uintptr_t target)
+{
+    const void *tb_rx = tcg_splitwx_to_rx(s->gen_tb);
+    uintptr_t code_rx = (uintptr_t)tcg_splitwx_to_rx(s->code_buf);
+    TCGRelocRecord r = {
+        .offset = tcg_ptr_byte_diff(field, s->code_buf),
+        .type = type,
+    };
+
+    if (target - (uintptr_t)tb_rx < sizeof(TranslationBlock)) {
+        r.base = TCG_RELOC_BASE_TB;
+    } else if (target - code_rx <= tcg_current_code_size(s)) {
+        /* Branches within the TB are position independent. */
+        if (type != TCG_RELOC_PC32) {
+            s->tb_uncacheable = true;
+        }
+        return;
+    } else if (in_code_gen_buffer((const void *)target)) {
+        /* TBs never refer to other TBs, only to the prologue. */
+        r.base = TCG_RELOC_BASE_PROLOGUE;
+    } else if (target - (uintptr_t)__ehdr_start <
+               (uintptr_t)(_end - __ehdr_start)) {
+        r.base = TCG_RELOC_BASE_IMAGE;
+    } else {
+        s->tb_uncacheable = true;
+        return;
+    }
+    r.addend = target - tcg_reloc_base(r.base, tb_rx);
+    g_array_append_val(s->tb_relocs, r);
+}
+#endif
+
+/**
+ * tcg_apply_relocs:
+ * @rw: writable copy of the code of @tb
+ * @tb: the TB, whose tc.ptr is the executable address of the code
+ * @relocs: the records produced when the code was generated
+ * @nb_relocs: number of @relocs
+ * @code_size: size of the code, to bounds-check the records
+ *
+ * Fix up code generated in another process for its new location.
+ * Returns false if some record is invalid or its target is out of
+ * range, in which case the code must not be executed.
+ */
+bool tcg_apply_relocs(void *rw, const TranslationBlock *tb,
+                      const TCGRelocRecord *relocs, unsigned nb_relocs,
+                      size_t code_size)
+{
+#ifdef TCG_TARGET_RELOC_RECORDS
+    const void *tb_rx = tcg_splitwx_to_rx((void *)tb);
+
+    for (unsigned i = 0; i < nb_relocs; i++) {
+        const TCGRelocRecord *r = &relocs[i];
+        uintptr_t target, field_rx;
+        intptr_t disp;
+
+        if (r->base >= TCG_RELOC_BASE_NB) {
+            return false;
+        }
+        target = tcg_reloc_base(r->base, tb_rx) + r->addend;
+
+        switch (r->type) {
+        case TCG_RELOC_PC32:
+            if (r->offset + 4 > code_size) {
+                return false;
+            }
+            field_rx = (uintptr_t)tb->tc.ptr + r->offset;
+            disp = target - (field_rx + 4);
+            if (disp != (int32_t)disp) {
+                return false;
+            }
+            stl_he_p(rw + r->offset, disp);
+            break;
+        case TCG_RELOC_ABS64:
+            if (r->offset + 8 > code_size) {
+                return false;
+            }
+            stq_he_p(rw + r->offset, target);
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 #ifdef ELF_HOST_MACHINE
 /* In order to use this feature, the backend needs to do three things:
 
@@ -0,0 +1,159 @@
+/*
+ * XBZRLE encode/decode speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+#define XBZRLE_NR_PAGES  256
+
+/*
+ * A dirty pattern: @nr_runs runs of @run_len changed bytes spread over
+ * each page, the rest of the page being left unchanged.
+ */
+typedef struct XbzrleBenchOpts {
+    const char *name;
+    int nr_runs;
+    int run_len;
+} XbzrleBenchOpts;
+
+typedef struct XbzrleBenchData {
+    uint8_t *old_pages;
+    uint8_t *new_pages;
+    uint8_t *encoded;
+    int *encoded_len;
+} XbzrleBenchData;
+
+static void bench_data_init(XbzrleBenchData *data,
+                            const XbzrleBenchOpts *opts)
+{
+    size_t size = XBZRLE_NR_PAGES * XBZRLE_PAGE_SIZE;
+
+    data->old_pages = g_malloc(size);
+    data->new_pages = g_malloc(size);
+    data->encoded = g_malloc(size);
+    data->encoded_len = g_new0(int, XBZRLE_NR_PAGES);
+
+    for (size_t i = 0; i < size; i++) {
+        data->old_pages[i] = g_test_rand_int();
+    }
+    memcpy(data->new_pages, data->old_pages, size);
+
+    for (int p = 0; p < XBZRLE_NR_PAGES; p++) {
+        uint8_t *page = data->new_pages + p * XBZRLE_PAGE_SIZE;
+
+        for (int r = 0; r < opts->nr_runs; r++) {
+            int start = g_test_rand_int_range(0,
+                                              XBZRLE_PAGE_SIZE - opts->run_len);
+
+            for (int i = start; i < start + opts->run_len; i++) {
+                page[i] ^= g_test_rand_int_range(1, 256);
+            }
+        }
+    }
+}
+
+static void bench_data_free(XbzrleBenchData *data)
+{
+    g_free(data->old_pages);
+    g_free(data->new_pages);
+    g_free(data->encoded);
+    g_free(data->encoded_len);
+}
+
+static void test_xbzrle_encode_speed(const void *opaque)
+{
+    const XbzrleBenchOpts *opts = opaque;
+    const size_t total = 1 * GiB;
+    XbzrleBenchData data;
+    size_t done = 0;
+
+    bench_data_init(&data, opts);
+
+    g_test_timer_start();
+    while (done < total) {
+        for (int p = 0; p < XBZRLE_NR_PAGES; p++) {
+            size_t off = p * XBZRLE_PAGE_SIZE;
+
+            data.encoded_len[p] =
+                xbzrle_encode_buffer(data.old_pages + off,
+                                     data.new_pages + off, XBZRLE_PAGE_SIZE,
+                                     data.encoded + off, XBZRLE_PAGE_SIZE);
+        }
+        done += XBZRLE_NR_PAGES * XBZRLE_PAGE_SIZE;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("encode(%s): %.2f MB/sec", opts->name,
+                   done / MiB / g_test_timer_last());
+
+    bench_data_free(&data);
+}
+
+static void test_xbzrle_decode_speed(const void *opaque)
+{
+    const XbzrleBenchOpts *opts = opaque;
+    const size_t total = 1 * GiB;
+    XbzrleBenchData data;
+    size_t done = 0;
+
+    bench_data_init(&data, opts);
+
+    for (int p = 0; p < XBZRLE_NR_PAGES; p++) {
+        size_t off = p * XBZRLE_PAGE_SIZE;
+
+        data.encoded_len[p] =
+            xbzrle_encode_buffer(data.old_pages + off, data.new_pages + off,
+                                 XBZRLE_PAGE_SIZE, data.encoded + off,
+                                 XBZRLE_PAGE_SIZE);
+    }
+
+    g_test_timer_start();
+    while (done < total) {
+        for (int p = 0; p < XBZRLE_NR_PAGES; p++) {
+            size_t off = p * XBZRLE_PAGE_SIZE;
+
+            /* pages that overflowed are sent in full and not decoded */
+            if (data.encoded_len[p] > 0) {
+                xbzrle_decode_buffer(data.encoded + off, data.encoded_len[p],
+                                     data.old_pages + off, XBZRLE_PAGE_SIZE);
+            }
+        }
+        done += XBZRLE_NR_PAGES * XBZRLE_PAGE_SIZE;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("decode(%s): %.2f MB/sec", opts->name,
+                   done / MiB / g_test_timer_last());
+
+    bench_data_free(&data);
+}
+
+static const XbzrleBenchOpts bench_opts[] = {
+    { .name = "unchanged", .nr_runs = 0, .run_len = 0 },
+    { .name = "sparse-words", .nr_runs = 8, .run_len = 8 },
+    { .name = "dense-words", .nr_runs = 64, .run_len = 8 },
+    { .name = "short-runs", .nr_runs = 16, .run_len = 64 },
+    { .name = "long-runs", .nr_runs = 2, .run_len = 1024 },
+};
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    for (int i = 0; i < ARRAY_SIZE(bench_opts); i++) {
+        g_autofree char *enc = g_strdup_printf("/xbzrle/benchmark/encode/%s",
+                                               bench_opts[i].name);
+        g_autofree char *dec = g_strdup_printf("/xbzrle/benchmark/decode/%s",
+                                               bench_opts[i].name);
+
+        g_test_add_data_func(enc, &bench_opts[i], test_xbzrle_encode_speed);
+        g_test_add_data_func(dec, &bench_opts[i], test_xbzrle_decode_speed);
+    }
+
+    return g_test_run();
+}
@@ -13,6 +13,7 @@
 #include "qemu/osdep.h"
 #include <math.h>
 #include <fenv.h>
+#include "qemu/bitops.h"
 #include "qemu/timer.h"
 #include "qemu/int128.h"
 #include "fpu/softfloat.h"
@@ -34,6 +35,9 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_MAX,
+    OP_ROUND_TO_INT,
+    OP_TO_I64,
     OP_MAX_NR,
 };
 
@@ -45,6 +49,9 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_MAX] = "max",
+    [OP_ROUND_TO_INT] = "roundToInt",
+    [OP_TO_I64] = "to_i64",
     [OP_MAX_NR] = NULL,
 };
 
@@ -191,12 +198,18 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * With @int_range, replace the exponent so that the magnitude of
+ * each operand is in [1, 2^62) and converts to int64 without overflow.
+ */
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        bool no_neg, bool int_range)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
+        int exp = random_ops[i] % 62;
+
         switch (prec) {
         case PREC_SINGLE:
         case PREC_FLOAT32:
@@ -204,6 +217,10 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
             if (no_neg && float32_is_neg(ops[i].f32)) {
                 ops[i].f32 = float32_chs(ops[i].f32);
             }
+            if (int_range) {
+                ops[i].f32 = make_float32(deposit32(float32_val(ops[i].f32),
+                                                    23, 8, 0x7f + exp));
+            }
             break;
         case PREC_DOUBLE:
         case PREC_FLOAT64:
@@ -211,6 +228,10 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
             if (no_neg && float64_is_neg(ops[i].f64)) {
                 ops[i].f64 = float64_chs(ops[i].f64);
             }
+            if (int_range) {
+                ops[i].f64 = make_float64(deposit64(float64_val(ops[i].f64),
+                                                    52, 11, 0x3ff + exp));
+            }
             break;
         case PREC_QUAD:
         case PREC_FLOAT128:
@@ -218,6 +239,11 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
             if (no_neg && float128_is_neg(ops[i].f128)) {
                 ops[i].f128 = float128_chs(ops[i].f128);
             }
+            if (int_range) {
+                exp = ops[i].f128.low % 62;
+                ops[i].f128.high = deposit64(ops[i].f128.high,
+                                             48, 15, 0x3fff + exp);
+            }
             break;
         default:
             g_assert_not_reached();
@@ -241,7 +267,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TO_I64);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +296,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAX:
+                    res.f = fmaxf(a, b);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f = rintf(a);
+                    break;
+                case OP_TO_I64:
+                    res.u64 = llrintf(a);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TO_I64);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,13 +340,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAX:
+                    res.d = fmax(a, b);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.d = rint(a);
+                    break;
+                case OP_TO_I64:
+                    res.u64 = llrint(a);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TO_I64);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -340,13 +384,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f32 = float32_maxnum(a, b, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f32 = float32_round_to_int(a, &soft_status);
+                    break;
+                case OP_TO_I64:
+                    res.u64 = float32_to_int64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TO_I64);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -375,13 +428,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f64 = float64_maxnum(a, b, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f64 = float64_round_to_int(a, &soft_status);
+                    break;
+                case OP_TO_I64:
+                    res.u64 = float64_to_int64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TO_I64);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
@@ -410,6 +472,15 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAX:
+                    res.f128 = float128_maxnum(a, b, &soft_status);
+                    break;
+                case OP_ROUND_TO_INT:
+                    res.f128 = float128_round_to_int(a, &soft_status);
+                    break;
+                case OP_TO_I64:
+                    res.u64 = float128_to_int64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -448,6 +519,9 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(max, OP_MAX, 2)
+GEN_BENCH_ALL_TYPES(round_to_int, OP_ROUND_TO_INT, 1)
+GEN_BENCH_ALL_TYPES(to_i64, OP_TO_I64, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -480,6 +554,9 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(max, OP_MAX),
+    GEN_BENCH_FUNCS(round_to_int, OP_ROUND_TO_INT),
+    GEN_BENCH_FUNCS(to_i64, OP_TO_I64),
 };
 
 #undef GEN_BENCH_FUNCS
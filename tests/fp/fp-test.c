@@ -103,6 +103,7 @@ static const char commands_string[] =
     "options:\n"
     " -e = max error count per test. Default: 20. Set no limit with 0\n"
     " -f = initial FP exception flags (vioux). Default: none\n"
+    "      With 'x', softfloat can take its host FPU (hardfloat) paths\n"
     " -l = thoroughness level (1 (default), 2)\n"
     " -r = rounding mode (even (default), zero, down, up, tieaway, odd)\n"
     "      Set to 'all' to test all rounding modes, if applicable\n"
@@ -0,0 +1,160 @@
+/*
+ * Check that per-vCPU inline operations and conditional callbacks count
+ * exactly what regular callbacks count.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* the conditional callback fires every COND_PERIOD block executions */
+#define COND_PERIOD 64
+
+typedef struct {
+    uint64_t tb_count;
+    uint64_t tb_count_inline;
+    uint64_t tb_countdown;
+    uint64_t tb_cond_hits;
+    uint64_t last_tb;
+    uint64_t insn_count;
+    uint64_t insn_count_inline;
+    uint64_t mem_count;
+    uint64_t mem_count_inline;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 tb_count;
+static qemu_plugin_u64 tb_count_inline;
+static qemu_plugin_u64 tb_countdown;
+static qemu_plugin_u64 tb_cond_hits;
+static qemu_plugin_u64 last_tb;
+static qemu_plugin_u64 insn_count;
+static qemu_plugin_u64 insn_count_inline;
+static qemu_plugin_u64 mem_count;
+static qemu_plugin_u64 mem_count_inline;
+
+static void plugin_exit(qemu_plugin_id_t id, void *udata)
+{
+    g_autoptr(GString) out = g_string_new("");
+
+    for (int i = 0; i < qemu_plugin_num_vcpus(); i++) {
+        uint64_t tbs = qemu_plugin_u64_get(tb_count, i);
+
+        g_assert(qemu_plugin_u64_get(tb_count_inline, i) == tbs);
+        g_assert(qemu_plugin_u64_get(tb_cond_hits, i) == tbs / COND_PERIOD);
+        g_assert(qemu_plugin_u64_get(tb_countdown, i) == tbs % COND_PERIOD);
+        g_assert(qemu_plugin_u64_get(insn_count_inline, i) ==
+                 qemu_plugin_u64_get(insn_count, i));
+        g_assert(qemu_plugin_u64_get(mem_count_inline, i) ==
+                 qemu_plugin_u64_get(mem_count, i));
+    }
+
+    g_string_printf(out, "tb: %" PRIu64 ", cond: %" PRIu64 "\n",
+                    qemu_plugin_u64_sum(tb_count),
+                    qemu_plugin_u64_sum(tb_cond_hits));
+    g_string_append_printf(out, "insn: %" PRIu64 "\n",
+                           qemu_plugin_u64_sum(insn_count));
+    g_string_append_printf(out, "mem: %" PRIu64 "\n",
+                           qemu_plugin_u64_sum(mem_count));
+    qemu_plugin_outs(out->str);
+
+    qemu_plugin_scoreboard_free(counts);
+}
+
+static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(tb_count, cpu_index, 1);
+}
+
+static void vcpu_tb_cond_exec(unsigned int cpu_index, void *udata)
+{
+    /* inline ops of the block ran before this callback */
+    g_assert(qemu_plugin_u64_get(tb_countdown, cpu_index) == COND_PERIOD);
+    g_assert((uintptr_t) qemu_plugin_u64_get(last_tb, cpu_index) ==
+             (uintptr_t) udata);
+
+    qemu_plugin_u64_set(tb_countdown, cpu_index, 0);
+    qemu_plugin_u64_add(tb_cond_hits, cpu_index, 1);
+}
+
+static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
+{
+    qemu_plugin_u64_add(insn_count, cpu_index, 1);
+}
+
+static void vcpu_mem_access(unsigned int cpu_index,
+                            qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_add(mem_count, cpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t pc = qemu_plugin_tb_vaddr(tb);
+    size_t n = qemu_plugin_tb_n_insns(tb);
+
+    qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
+                                         QEMU_PLUGIN_CB_NO_REGS, NULL);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_count_inline, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, tb_countdown, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_STORE_U64, last_tb, pc);
+    qemu_plugin_register_vcpu_tb_exec_cond_cb(
+        tb, vcpu_tb_cond_exec, QEMU_PLUGIN_CB_NO_REGS,
+        QEMU_PLUGIN_COND_GE, tb_countdown, COND_PERIOD,
+        (void *)(uintptr_t) pc);
+
+    for (size_t i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
+                                               QEMU_PLUGIN_CB_NO_REGS, NULL);
+        qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+            insn, QEMU_PLUGIN_INLINE_ADD_U64, insn_count_inline, 1);
+        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                         QEMU_PLUGIN_CB_NO_REGS,
+                                         QEMU_PLUGIN_MEM_RW, NULL);
+        qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+            insn, QEMU_PLUGIN_MEM_RW, QEMU_PLUGIN_INLINE_ADD_U64,
+            mem_count_inline, 1);
+    }
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    tb_count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_count);
+    tb_count_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_count_inline);
+    tb_countdown = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_countdown);
+    tb_cond_hits = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, tb_cond_hits);
+    last_tb = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, last_tb);
+    insn_count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_count);
+    insn_count_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_count_inline);
+    mem_count = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_count);
+    mem_count_inline = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, mem_count_inline);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * QTest testcase for the BCM2835 random number generator (on Raspberry Pi 3)
+ *
+ * The device registers are accessed with a device lock instead of the BQL,
+ * which also shows up under the device's name in the sync profiler.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* Offset in raspi3b platform: */
+#define RASPI3_RNG_BASE 0x3f104000
+
+#define RNG_CTRL        0x0
+#define RNG_STATUS      0x4
+#define RNG_DATA        0x8
+
+#define RNG_STATUS_READY (1 << 24)
+
+static void test_registers(void)
+{
+    QTestState *qts = qtest_init("-M raspi3b");
+    uint32_t data[8];
+    bool differ = false;
+    int i;
+
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_CTRL), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_STATUS), ==,
+                    RNG_STATUS_READY);
+
+    qtest_writel(qts, RASPI3_RNG_BASE + RNG_CTRL, 1);
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_CTRL), ==, 1);
+
+    /* Only the 20 low bits of the status register are writable */
+    qtest_writel(qts, RASPI3_RNG_BASE + RNG_STATUS, 0xfff12345);
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_STATUS), ==,
+                    RNG_STATUS_READY | 0x12345);
+
+    for (i = 0; i < ARRAY_SIZE(data); i++) {
+        data[i] = qtest_readl(qts, RASPI3_RNG_BASE + RNG_DATA);
+        differ |= i > 0 && data[i] != data[0];
+    }
+    g_assert(differ);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'system_reset' }");
+    qtest_qmp_eventwait(qts, "RESET");
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_CTRL), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, RASPI3_RNG_BASE + RNG_STATUS), ==,
+                    RNG_STATUS_READY);
+
+    qtest_quit(qts);
+}
+
+static void test_sync_profile(void)
+{
+    QTestState *qts = qtest_init("-M raspi3b");
+    char *report;
+    int i;
+
+    g_free(qtest_hmp(qts, "sync-profile on"));
+    for (i = 0; i < 16; i++) {
+        qtest_readl(qts, RASPI3_RNG_BASE + RNG_DATA);
+    }
+
+    /* Without coalescing, the lock is reported under the region's name */
+    report = qtest_hmp(qts, "info sync-profile -n 1000");
+    g_assert(strstr(report, "(bcm2835-rng)"));
+    g_free(report);
+
+    g_free(qtest_hmp(qts, "sync-profile off"));
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/bcm2835/rng/registers", test_registers);
+    qtest_add_func("/bcm2835/rng/sync-profile", test_sync_profile);
+
+    return g_test_run();
+}
@@ -0,0 +1,172 @@
+/*
+ * QTest testcase for the statistics and polling properties of IOThreads
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
+#include "qapi/qmp/qstring.h"
+
+#define POLL_MAX_NS     100000
+
+/* Must match AIO_POLL_HIST_BUCKETS */
+#define WAIT_TIME_BUCKETS   32
+
+static QTestState *iothread_stats_start(void)
+{
+    return qtest_init("-machine none -object iothread,id=iot0,"
+                      "poll-max-ns=" stringify(POLL_MAX_NS) ","
+                      "poll-percentile=90");
+}
+
+/* Returns the stats of /objects/iot0 in a query-stats @response. */
+static QList *iothread_stats_find(QDict *response)
+{
+    QList *results = qdict_get_qlist(response, "return");
+    QListEntry *e;
+
+    g_assert(results);
+    QLIST_FOREACH_ENTRY(results, e) {
+        QDict *result = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (!strcmp(qdict_get_str(result, "qom-path"), "/objects/iot0")) {
+            g_assert_cmpstr(qdict_get_str(result, "provider"), ==,
+                            "iothread");
+            return qdict_get_qlist(result, "stats");
+        }
+    }
+    g_assert_not_reached();
+}
+
+static QObject *iothread_stats_value(QList *stats, const char *name)
+{
+    QListEntry *e;
+
+    QLIST_FOREACH_ENTRY(stats, e) {
+        QDict *stat = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (!strcmp(qdict_get_str(stat, "name"), name)) {
+            return qdict_get(stat, "value");
+        }
+    }
+    return NULL;
+}
+
+static void test_query_stats(void)
+{
+    QTestState *qts = iothread_stats_start();
+    QDict *response;
+    QList *stats, *wait_time;
+    QObject *value;
+    uint64_t poll_time;
+
+    response = qtest_qmp(qts, "{ 'execute': 'query-stats', "
+                         "'arguments': { 'target': 'iothread' } }");
+    stats = iothread_stats_find(response);
+
+    value = iothread_stats_value(stats, "poll-hits");
+    g_assert(value && qobject_to(QNum, value));
+    value = iothread_stats_value(stats, "poll-misses");
+    g_assert(value && qobject_to(QNum, value));
+
+    /* The percentile controller never polls for longer than poll-max-ns */
+    value = iothread_stats_value(stats, "poll-time");
+    g_assert(value);
+    g_assert(qnum_get_try_uint(qobject_to(QNum, value), &poll_time));
+    g_assert_cmpuint(poll_time, <=, POLL_MAX_NS);
+
+    value = iothread_stats_value(stats, "wait-time");
+    wait_time = qobject_to(QList, value);
+    g_assert(wait_time);
+    g_assert_cmpint(qlist_size(wait_time), ==, WAIT_TIME_BUCKETS);
+    qobject_unref(response);
+
+    /* Filter by name */
+    response = qtest_qmp(qts, "{ 'execute': 'query-stats', "
+                         "'arguments': { 'target': 'iothread', "
+                         "'providers': [ { 'provider': 'iothread', "
+                         "'names': [ 'poll-time' ] } ] } }");
+    stats = iothread_stats_find(response);
+    g_assert_cmpint(qlist_size(stats), ==, 1);
+    g_assert(iothread_stats_value(stats, "poll-time"));
+    qobject_unref(response);
+
+    qtest_quit(qts);
+}
+
+static void test_query_stats_schemas(void)
+{
+    QTestState *qts = iothread_stats_start();
+    const char *names[] = {
+        "poll-hits", "poll-misses", "poll-time", "wait-time",
+    };
+    QDict *response, *schema;
+    QList *schemas, *values;
+    QListEntry *e;
+
+    response = qtest_qmp(qts, "{ 'execute': 'query-stats-schemas', "
+                         "'arguments': { 'provider': 'iothread' } }");
+    schemas = qdict_get_qlist(response, "return");
+    g_assert_cmpint(qlist_size(schemas), ==, 1);
+    schema = qobject_to(QDict, qlist_peek(schemas));
+    g_assert_cmpstr(qdict_get_str(schema, "target"), ==, "iothread");
+
+    values = qdict_get_qlist(schema, "stats");
+    g_assert_cmpint(qlist_size(values), ==, ARRAY_SIZE(names));
+    for (int i = 0; i < ARRAY_SIZE(names); i++) {
+        bool found = false;
+
+        QLIST_FOREACH_ENTRY(values, e) {
+            QDict *value = qobject_to(QDict, qlist_entry_obj(e));
+
+            found |= !strcmp(qdict_get_str(value, "name"), names[i]);
+        }
+        g_assert(found);
+    }
+    qobject_unref(response);
+
+    qtest_quit(qts);
+}
+
+static void test_poll_percentile(void)
+{
+    QTestState *qts = iothread_stats_start();
+    QDict *response;
+
+    response = qtest_qmp(qts, "{ 'execute': 'qom-get', 'arguments': "
+                         "{ 'path': '/objects/iot0', "
+                         "'property': 'poll-percentile' } }");
+    g_assert_cmpint(qdict_get_int(response, "return"), ==, 90);
+    qobject_unref(response);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'qom-set', 'arguments': "
+                             "{ 'path': '/objects/iot0', "
+                             "'property': 'poll-percentile', "
+                             "'value': 0 } }");
+
+    response = qtest_qmp(qts, "{ 'execute': 'qom-set', 'arguments': "
+                         "{ 'path': '/objects/iot0', "
+                         "'property': 'poll-percentile', "
+                         "'value': 101 } }");
+    g_assert(qdict_haskey(response, "error"));
+    qobject_unref(response);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/iothread/stats/query-stats", test_query_stats);
+    qtest_add_func("/iothread/stats/query-stats-schemas",
+                   test_query_stats_schemas);
+    qtest_add_func("/iothread/poll-percentile", test_poll_percentile);
+
+    return g_test_run();
+}
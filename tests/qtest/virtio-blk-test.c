@@ -771,6 +771,107 @@ static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/*
+ * Add a one-sector write request to @vq without kicking.  Returns the guest
+ * address of the request; its status byte is at offset 528.
+ */
+static uint64_t coalesce_add_write(QVirtioDevice *dev, QGuestAllocator *alloc,
+                                   QVirtQueue *vq, uint64_t sector,
+                                   uint32_t *head)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    QTestState *qts = global_qtest;
+
+    req.type = VIRTIO_BLK_T_OUT;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(512);
+    snprintf(req.data, 512, "TEST%" PRIu64, sector);
+
+    req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    *head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+
+    return req_addr;
+}
+
+#define COALESCE_COUNT  4
+#define COALESCE_US     60000000    /* 60 s of virtual time */
+
+/*
+ * The device is created with notify-coalesce-count=COALESCE_COUNT, so one
+ * kick that completes COALESCE_COUNT requests raises a single interrupt.
+ * Fewer completions are only signalled once notify-coalesce-us have passed.
+ */
+static void coalesce(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QTestState *qts = global_qtest;
+    uint64_t req_addr[COALESCE_COUNT];
+    uint32_t head[COALESCE_COUNT];
+    uint32_t desc_idx;
+    uint64_t features;
+    QVirtQueue *vq;
+    uint8_t status;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                    (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                    (1u << VIRTIO_RING_F_EVENT_IDX) |
+                    (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+
+    qvirtio_set_driver_ok(dev);
+
+    /* Several completions per kick: one notification for all of them */
+    for (i = 0; i < COALESCE_COUNT; i++) {
+        req_addr[i] = coalesce_add_write(dev, t_alloc, vq, i, &head[i]);
+    }
+    qvirtqueue_kick(qts, dev, vq, head[0]);
+
+    qvirtio_wait_queue_isr(qts, dev, vq, QVIRTIO_BLK_TIMEOUT_US);
+    for (i = 0; i < COALESCE_COUNT; i++) {
+        g_assert(qvirtqueue_get_buf(qts, vq, &desc_idx, NULL));
+        g_assert_cmpint(desc_idx, ==, head[i]);
+        status = readb(req_addr[i] + 528);
+        g_assert_cmpint(status, ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    /* Below the count, the notification waits for the timer */
+    for (i = 0; i < COALESCE_COUNT - 1; i++) {
+        req_addr[i] = coalesce_add_write(dev, t_alloc, vq, i, &head[i]);
+    }
+    qvirtqueue_kick(qts, dev, vq, head[0]);
+
+    for (i = 0; i < COALESCE_COUNT - 1; i++) {
+        status = qvirtio_wait_status_byte_no_isr(qts, dev, vq,
+                                                 req_addr[i] + 528,
+                                                 QVIRTIO_BLK_TIMEOUT_US);
+        g_assert_cmpint(status, ==, 0);
+    }
+    g_assert(!dev->bus->get_queue_isr_status(dev, vq));
+
+    qtest_clock_step(qts, (int64_t)COALESCE_US * 1000);
+    qvirtio_wait_queue_isr(qts, dev, vq, QVIRTIO_BLK_TIMEOUT_US);
+    for (i = 0; i < COALESCE_COUNT - 1; i++) {
+        g_assert(qvirtqueue_get_buf(qts, vq, &desc_idx, NULL));
+        g_assert_cmpint(desc_idx, ==, head[i]);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
 static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
 {
     char *tmp_path = drive_create();
@@ -785,6 +886,106 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static bool io_uring_available(void)
+{
+    /* Invalid arguments, but the error tells whether io_uring exists */
+    int ret = syscall(__NR_io_uring_setup, 0, NULL);
+
+    return ret < 0 && errno != ENOSYS && errno != EPERM;
+}
+
+static void *virtio_blk_io_uring_test_setup(GString *cmd_line, void *arg)
+{
+    char *tmp_path = drive_create();
+    char *tmp_path1 = drive_create();
+
+    g_string_append_printf(cmd_line,
+                           " -drive if=none,id=drive0,file=%s,"
+                           "format=raw,aio=io_uring,cache.direct=on,"
+                           "auto-read-only=off "
+                           "-drive if=none,id=drive1,file=%s,"
+                           "format=raw,aio=io_uring,cache.direct=on ",
+                           tmp_path, tmp_path1);
+
+    return g_strdup(tmp_path1);
+}
+
+/*
+ * Guest RAM is registered with io_uring by virtio-blk, so requests use
+ * fixed buffers and the image is accessed as a fixed file.
+ */
+static void io_uring_basic(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtQueue *vq;
+
+    g_free(data);
+    vq = test_basic(blk_if->vdev, t_alloc);
+    qvirtqueue_cleanup(blk_if->vdev->bus, vq, t_alloc);
+}
+
+/* Whether an OFD lock is held on the file at @path, per /proc/locks */
+static bool file_is_locked(const char *path)
+{
+    g_autofree char *locks = NULL;
+    g_autofree char *id = NULL;
+    struct stat st;
+
+    g_assert(stat(path, &st) == 0);
+    g_assert(g_file_get_contents("/proc/locks", &locks, NULL, NULL));
+    id = g_strdup_printf(" %02x:%02x:%" PRIu64 " ", major(st.st_dev),
+                         minor(st.st_dev), (uint64_t)st.st_ino);
+    return strstr(locks, id) != NULL;
+}
+
+/*
+ * The fixed file slot of an image holds a reference to the open file.
+ * Check that unplugging the disk really closes the file, which also
+ * releases its image locks.
+ */
+static void io_uring_hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *dev1 = obj;
+    QVirtioPCIDevice *dev;
+    QTestState *qts = dev1->pdev->bus->qts;
+    g_autofree char *path = data;
+    QVirtQueue *vq;
+
+    if (dev1->pdev->bus->not_hotpluggable) {
+        g_test_skip("pci bus does not support hotplug");
+        return;
+    }
+
+    /* Some I/O through the ring, so that drive0 gets a fixed file slot */
+    vq = test_basic(&dev1->vdev, t_alloc);
+    qvirtqueue_cleanup(dev1->vdev.bus, vq, t_alloc);
+
+    qtest_qmp_device_add(qts, "virtio-blk-pci", "drv1",
+                         "{'addr': %s, 'drive': 'drive1'}",
+                         stringify(PCI_SLOT_HP) ".0");
+
+    dev = virtio_pci_new(dev1->pdev->bus, &(QPCIAddress) {
+                             .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0) });
+    g_assert_nonnull(dev);
+    qvirtio_pci_device_enable(dev);
+    qvirtio_start_device(&dev->vdev);
+    vq = test_basic(&dev->vdev, t_alloc);
+    qvirtqueue_cleanup(dev->vdev.bus, vq, t_alloc);
+    qvirtio_pci_device_disable(dev);
+    qos_object_destroy((QOSGraphObject *)dev);
+
+    if (!file_is_locked(path)) {
+        g_test_skip("image locking is not in use");
+        return;
+    }
+
+    /* The unplug deletes drive1 */
+    qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
+    g_assert(!file_is_locked(path));
+}
+#endif
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -796,12 +997,27 @@ static void register_virtio_blk_test(void)
     qos_add_test("basic", "virtio-blk", basic, &opts);
     qos_add_test("resize", "virtio-blk", resize, &opts);
 
+    opts.edge.extra_device_opts =
+        "notify-coalesce-count=" stringify(COALESCE_COUNT)
+        ",notify-coalesce-us=" stringify(COALESCE_US);
+    qos_add_test("coalesce", "virtio-blk", coalesce, &opts);
+    opts.edge.extra_device_opts = NULL;
+
     /* tests just for virtio-blk-pci */
     qos_add_test("msix", "virtio-blk-pci", msix, &opts);
     qos_add_test("idx", "virtio-blk-pci", idx, &opts);
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (io_uring_available()) {
+        opts.before = virtio_blk_io_uring_test_setup;
+        qos_add_test("io_uring-basic", "virtio-blk", io_uring_basic, &opts);
+        qos_add_test("io_uring-hotplug", "virtio-blk-pci", io_uring_hotplug,
+                     &opts);
+    }
+#endif
 }
 
 libqos_init(register_virtio_blk_test);
@@ -0,0 +1,190 @@
+/*
+ * Compare unpredicated SVE vector operations with a scalar reference
+ *
+ * SVE operations on whole registers are expanded with gvec, whose
+ * operation size is the vector length.  Run them for every vector length
+ * from 16 to 256 bytes, so that hosts with 512-bit vectors also go
+ * through the 256, 128 and 64-bit remainders, on element counts that are
+ * not a multiple of the vector length and on unaligned buffers.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <arm_sve.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#define MAX_VL      256
+#define MAX_ELEMS   (2 * MAX_VL + 3)
+#define MAX_OFFSET  4
+#define BUF_BYTES   ((MAX_ELEMS + MAX_OFFSET + 1) * 8)
+
+static uint64_t buf_a[BUF_BYTES / 8];
+static uint64_t buf_b[BUF_BYTES / 8];
+static uint64_t buf_r[BUF_BYTES / 8];
+
+#define SAT_ADD(T, MIN, MAX, x, y) ({                       \
+            T s_;                                           \
+            __builtin_add_overflow(x, y, &s_)               \
+                ? ((y) < 0 ? (MIN) : (MAX)) : s_;           \
+        })
+
+#define SAT_SUB(T, MIN, MAX, x, y) ({                       \
+            T d_;                                           \
+            __builtin_sub_overflow(x, y, &d_)               \
+                ? ((y) < 0 ? (MAX) : (MIN)) : d_;           \
+        })
+
+/*
+ * Define test_NAME_T, which applies VEXPR to va and vb (all lanes active
+ * through pt) and checks each element against SEXPR of a[i] and b[i].
+ * Elements past the end must not be written.
+ */
+#define DEF_TEST(NAME, T, BITS, SVT, VEXPR, SEXPR)                          \
+static bool test_##NAME##_##T(int vl)                                       \
+{                                                                           \
+    int64_t elems = vl / sizeof(T);                                         \
+    svbool_t pt = svptrue_b##BITS();                                        \
+    bool ok = true;                                                         \
+    T guard;                                                                \
+    int64_t n, i;                                                           \
+    int off;                                                                \
+                                                                            \
+    (void)pt; /* not used by the saturating operations */                   \
+    memset(&guard, 0x55, sizeof(guard));                                    \
+    for (off = 0; off < MAX_OFFSET; off++) {                                \
+        const T *a = (const T *)buf_a + off;                                \
+        const T *b = (const T *)buf_b + off;                                \
+        T *r = (T *)buf_r + off;                                            \
+                                                                            \
+        for (n = 0; n <= 2 * elems + 3; n++) {                              \
+            memset(buf_r, 0x55, sizeof(buf_r));                             \
+            for (i = 0; i < n; i += elems) {                                \
+                svbool_t pg = svwhilelt_b##BITS(i, n);                      \
+                SVT va = svld1(pg, a + i);                                  \
+                SVT vb = svld1(pg, b + i);                                  \
+                                                                            \
+                (void)vb; /* not used by the immediate operations */        \
+                svst1(pg, r + i, VEXPR);                                    \
+            }                                                               \
+            for (i = 0; i < n; i++) {                                       \
+                T expect = SEXPR;                                           \
+                                                                            \
+                if (r[i] != expect) {                                       \
+                    printf("FAIL: " #NAME " " #T " vl %d offset %d "        \
+                           "count %lld element %lld: %llx != %llx\n",       \
+                           vl, off, (long long)n, (long long)i,             \
+                           (unsigned long long)r[i],                        \
+                           (unsigned long long)expect);                     \
+                    return false;                                           \
+                }                                                           \
+            }                                                               \
+            if (r[n] != guard) {                                            \
+                printf("FAIL: " #NAME " " #T " vl %d offset %d "            \
+                       "count %lld: wrote past the end\n",                  \
+                       vl, off, (long long)n);                              \
+                ok = false;                                                 \
+            }                                                               \
+        }                                                                   \
+    }                                                                       \
+    return ok;                                                              \
+}
+
+#define DEF_TESTS(T, BITS, SVT, MIN, MAX, SVSHR)                            \
+    DEF_TEST(add, T, BITS, SVT, svadd_x(pt, va, vb), (T)(a[i] + b[i]))      \
+    DEF_TEST(addi, T, BITS, SVT, svadd_x(pt, va, 7), (T)(a[i] + 7))         \
+    DEF_TEST(sub, T, BITS, SVT, svsub_x(pt, va, vb), (T)(a[i] - b[i]))      \
+    DEF_TEST(and, T, BITS, SVT, svand_x(pt, va, vb), a[i] & b[i])           \
+    DEF_TEST(orr, T, BITS, SVT, svorr_x(pt, va, vb), a[i] | b[i])           \
+    DEF_TEST(eor, T, BITS, SVT, sveor_x(pt, va, vb), a[i] ^ b[i])           \
+    DEF_TEST(bic, T, BITS, SVT, svbic_x(pt, va, vb), a[i] & ~b[i])          \
+    DEF_TEST(qadd, T, BITS, SVT, svqadd(va, vb),                            \
+             SAT_ADD(T, MIN, MAX, a[i], b[i]))                              \
+    DEF_TEST(qsub, T, BITS, SVT, svqsub(va, vb),                            \
+             SAT_SUB(T, MIN, MAX, a[i], b[i]))                              \
+    DEF_TEST(shl, T, BITS, SVT, svlsl_x(pt, va, 3), (T)(a[i] << 3))         \
+    DEF_TEST(shr, T, BITS, SVT, SVSHR(pt, va, 3), (T)(a[i] >> 3))           \
+    DEF_TEST(max, T, BITS, SVT, svmax_x(pt, va, vb),                        \
+             a[i] > b[i] ? a[i] : b[i])                                     \
+    static bool (* const tests_##T[])(int) = {                              \
+        test_add_##T, test_addi_##T, test_sub_##T, test_and_##T,            \
+        test_orr_##T, test_eor_##T, test_bic_##T, test_qadd_##T,            \
+        test_qsub_##T, test_shl_##T, test_shr_##T, test_max_##T,            \
+    };
+
+DEF_TESTS(uint8_t, 8, svuint8_t, 0, UINT8_MAX, svlsr_x)
+DEF_TESTS(uint16_t, 16, svuint16_t, 0, UINT16_MAX, svlsr_x)
+DEF_TESTS(uint32_t, 32, svuint32_t, 0, UINT32_MAX, svlsr_x)
+DEF_TESTS(uint64_t, 64, svuint64_t, 0, UINT64_MAX, svlsr_x)
+DEF_TESTS(int8_t, 8, svint8_t, INT8_MIN, INT8_MAX, svasr_x)
+DEF_TESTS(int16_t, 16, svint16_t, INT16_MIN, INT16_MAX, svasr_x)
+DEF_TESTS(int32_t, 32, svint32_t, INT32_MIN, INT32_MAX, svasr_x)
+DEF_TESTS(int64_t, 64, svint64_t, INT64_MIN, INT64_MAX, svasr_x)
+
+#define RUN_TESTS(T, vl) ({                                                 \
+            bool ok_ = true;                                                \
+            for (int t_ = 0; t_ < sizeof(tests_##T) / sizeof(tests_##T[0]); \
+                 t_++) {                                                    \
+                ok_ &= tests_##T[t_](vl);                                   \
+            }                                                               \
+            ok_;                                                            \
+        })
+
+/* Random data, with a bias towards values that saturate */
+static void fill(uint64_t *buf, uint64_t seed)
+{
+    uint8_t *p = (uint8_t *)buf;
+    int i;
+
+    for (i = 0; i < BUF_BYTES; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        switch ((seed >> 60) & 3) {
+        case 0:
+            p[i] = 0xff;
+            break;
+        case 1:
+            p[i] = 0x80;
+            break;
+        default:
+            p[i] = seed >> 32;
+            break;
+        }
+    }
+}
+
+int main(void)
+{
+    bool ok = true;
+    int vl;
+
+    fill(buf_a, 1);
+    fill(buf_b, 2);
+
+    for (vl = 16; vl <= MAX_VL; vl += 16) {
+        int ret = prctl(PR_SVE_SET_VL, vl, 0, 0, 0, 0);
+
+        if (ret < 0) {
+            printf("SKIP: cannot set the vector length to %d\n", vl);
+            break;
+        }
+        if ((ret & 0xffff) != vl) {
+            /* Not supported by this CPU */
+            continue;
+        }
+
+        ok &= RUN_TESTS(uint8_t, vl);
+        ok &= RUN_TESTS(uint16_t, vl);
+        ok &= RUN_TESTS(uint32_t, vl);
+        ok &= RUN_TESTS(uint64_t, vl);
+        ok &= RUN_TESTS(int8_t, vl);
+        ok &= RUN_TESTS(int16_t, vl);
+        ok &= RUN_TESTS(int32_t, vl);
+        ok &= RUN_TESTS(int64_t, vl);
+    }
+
+    printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+/*
+ * Large page TLB invalidation test
+ *
+ * Map 2MB blocks at alias addresses, fill the TLB with their pages and
+ * remap some of them.  Invalidating any page of a block must drop all
+ * the pages of that block from the TLB, while aliases that were not
+ * remapped keep working.  More blocks are used than QEMU tracks
+ * individually per mmu_idx, to also go through its fallback path.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+/* grabbed from Linux */
+#define __stringify_1(x...) #x
+#define __stringify(x...)   __stringify_1(x)
+
+#define read_sysreg(r) ({                                           \
+            uint64_t __val;                                         \
+            asm volatile("mrs %0, " __stringify(r) : "=r" (__val)); \
+            __val;                                                  \
+})
+
+#define PAGE_SIZE       4096UL
+#define BLOCK_SIZE      (1UL << 21)
+#define PAGES_PER_BLOCK (BLOCK_SIZE / PAGE_SIZE)
+#define TABLE_MASK      0xfffffffff000UL
+
+/* Blocks of RAM past the test image, identity mapped to fill them */
+#define DATA_PA         0x40800000UL
+#define N_DATA          4
+
+/* Aliases of the data blocks, more than CPU_TLB_LARGE_PAGES */
+#define ALIAS_VA        0x60000000UL
+#define N_ALIAS         40
+
+#define BLOCK_ATTR      ((3UL << 53) | 0x401) /* NX, AF, block */
+
+static uint64_t *l2_table;
+
+static uint64_t tag(int block, int page)
+{
+    return 0xa5a5000000000000UL | ((uint64_t)block << 32) | page;
+}
+
+static void map_block(uint64_t va, uint64_t pa)
+{
+    l2_table[(va >> 21) & 511] = pa | BLOCK_ATTR;
+    asm volatile("dsb ishst" : : : "memory");
+}
+
+static void flush_page(uint64_t va)
+{
+    asm volatile("tlbi vaae1, %0\n\t"
+                 "dsb ish\n\t"
+                 "isb"
+                 : : "r" (va >> 12) : "memory");
+}
+
+static void flush_all(void)
+{
+    asm volatile("tlbi vmalle1\n\t"
+                 "dsb ish\n\t"
+                 "isb"
+                 : : : "memory");
+}
+
+static uint64_t alias(int i)
+{
+    return ALIAS_VA + i * BLOCK_SIZE;
+}
+
+static void fill_data(void)
+{
+    int b, p;
+
+    for (b = 0; b < N_DATA; b++) {
+        uint64_t pa = DATA_PA + b * BLOCK_SIZE;
+
+        map_block(pa, pa);
+    }
+    flush_all();
+
+    for (b = 0; b < N_DATA; b++) {
+        for (p = 0; p < PAGES_PER_BLOCK; p++) {
+            uint64_t *word = (uint64_t *)(DATA_PA + b * BLOCK_SIZE +
+                                          p * PAGE_SIZE);
+            *word = tag(b, p);
+        }
+    }
+}
+
+/* Load from every page of alias @i, which maps data block @block */
+static bool check_alias(int i, int block)
+{
+    int p;
+
+    for (p = 0; p < PAGES_PER_BLOCK; p++) {
+        uint64_t *word = (uint64_t *)(alias(i) + p * PAGE_SIZE);
+
+        if (*word != tag(block, p)) {
+            ml_printf("FAIL: alias %d page %d: %lx, expected %lx\n",
+                      i, p, *word, tag(block, p));
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Remap one block and invalidate it by a page in its start, middle or end */
+static bool test_remap_one(void)
+{
+    static const int flush_pages[] = { 0, 5, PAGES_PER_BLOCK - 1 };
+    bool ok = true;
+    int i;
+
+    for (i = 0; i < sizeof(flush_pages) / sizeof(flush_pages[0]); i++) {
+        map_block(alias(0), DATA_PA);
+        flush_all();
+        ok &= check_alias(0, 0);
+
+        map_block(alias(0), DATA_PA + BLOCK_SIZE);
+        flush_page(alias(0) + flush_pages[i] * PAGE_SIZE);
+        ok &= check_alias(0, 1);
+    }
+    return ok;
+}
+
+/* Remap some of many blocks whose pages are all in the TLB */
+static bool test_remap_many(void)
+{
+    int block[N_ALIAS];
+    bool ok = true;
+    int i;
+
+    for (i = 0; i < N_ALIAS; i++) {
+        block[i] = i % N_DATA;
+        map_block(alias(i), DATA_PA + block[i] * BLOCK_SIZE);
+    }
+    flush_all();
+    for (i = 0; i < N_ALIAS; i++) {
+        ok &= check_alias(i, block[i]);
+    }
+
+    for (i = 0; i < N_ALIAS; i += 3) {
+        block[i] = (block[i] + 1) % N_DATA;
+        map_block(alias(i), DATA_PA + block[i] * BLOCK_SIZE);
+        flush_page(alias(i) + (i * 7 % PAGES_PER_BLOCK) * PAGE_SIZE);
+    }
+    for (i = 0; i < N_ALIAS; i++) {
+        ok &= check_alias(i, block[i]);
+    }
+    return ok;
+}
+
+int main(void)
+{
+    uint64_t *l1 = (uint64_t *)(read_sysreg(ttbr0_el1) & TABLE_MASK);
+    bool ok;
+
+    /* boot.S maps the first GB of RAM through a single level 2 table */
+    l2_table = (uint64_t *)(l1[1] & TABLE_MASK);
+
+    fill_data();
+    ok = test_remap_one();
+    ok &= test_remap_many();
+
+    ml_printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
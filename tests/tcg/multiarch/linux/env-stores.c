@@ -0,0 +1,152 @@
+/*
+ * Check that guest state written back to env survives the optimizer
+ *
+ * The TCG optimizer drops stores to env that are overwritten before
+ * anything observes them, and keeps what it knows about temps across
+ * labels.  Stores must be kept when a label can be reached from a path
+ * that did not see the later store, when a helper may read env, and when
+ * the TB is left, for example to deliver a signal.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <fenv.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Values merged at labels from several paths */
+static int __attribute__((noinline)) merge(int x, int y)
+{
+    int r = x;
+
+    if (x > y) {
+        r = x - y;
+    } else if (x < y) {
+        r = y - x;
+    }
+    if (r & 1) {
+        r = r * 3 + 1;
+    } else {
+        r >>= 1;
+    }
+    return r;
+}
+
+static bool test_merge(void)
+{
+    static const struct {
+        int x, y, r;
+    } cases[] = {
+        { 5, 3, 1 },
+        { 3, 5, 1 },
+        { 4, 4, 2 },
+        { 7, 0, 22 },
+        { 0, 9, 28 },
+        { -3, 2, 16 },
+        { 10, -1, 34 },
+    };
+    bool ok = true;
+    int i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int r = merge(cases[i].x, cases[i].y);
+
+        if (r != cases[i].r) {
+            printf("FAIL: merge(%d, %d) = %d, expected %d\n",
+                   cases[i].x, cases[i].y, r, cases[i].r);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/*
+ * Changing the rounding mode writes the guest's FP control state, which
+ * the helpers for the following FP operations read from env.
+ */
+static bool test_rounding(void)
+{
+#if defined(FE_UPWARD) && defined(FE_DOWNWARD)
+    volatile double one = 1.0, three = 3.0; /* not folded at build time */
+    double up, down;
+
+    if (fesetround(FE_UPWARD)) {
+        printf("SKIP: FE_UPWARD not supported\n");
+        return true;
+    }
+    up = one / three;
+    if (fesetround(FE_DOWNWARD)) {
+        printf("SKIP: FE_DOWNWARD not supported\n");
+        fesetround(FE_TONEAREST);
+        return true;
+    }
+    down = one / three;
+    fesetround(FE_TONEAREST);
+
+    if (!(up > down)) {
+        printf("FAIL: 1/3 rounded up %a, rounded down %a\n", up, down);
+        return false;
+    }
+#endif
+    return true;
+}
+
+static volatile int alarms; /* written by the signal handler */
+
+static void alarm_handler(int sig)
+{
+    alarms++;
+}
+
+/*
+ * Interrupt a loop with signals, which leave the TB wherever the loop
+ * is.  Two accumulators computed differently must still agree.
+ */
+static bool test_interrupted_loop(void)
+{
+    struct itimerval it = {
+        .it_interval = { .tv_sec = 0, .tv_usec = 500 },
+        .it_value = { .tv_sec = 0, .tv_usec = 500 },
+    };
+    struct sigaction sa;
+    unsigned int a = 0, b = 0, i;
+    bool ok = true;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = alarm_handler;
+    sigaction(SIGALRM, &sa, NULL);
+    setitimer(ITIMER_REAL, &it, NULL);
+
+    for (i = 0; alarms < 20 && i < 100000000; i++) {
+        a += i;
+        b -= -i;
+        if (a & 1) {
+            a ^= 0x5a5a;
+            b = (b & ~0x5a5aU) | (~b & 0x5a5aU);
+        }
+    }
+
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_REAL, &it, NULL);
+
+    if (a != b) {
+        printf("FAIL: after %u iterations and %d signals: %x != %x\n",
+               i, alarms, a, b);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(void)
+{
+    bool ok = test_merge();
+
+    ok &= test_rounding();
+    ok &= test_interrupted_loop();
+
+    printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/*
+ * Stress guest page flag lookups against concurrent mmap updates.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * Checker threads pass valid and unmapped buffers to read(), so that
+ * every syscall validates the buffer against the guest page flags.
+ * Meanwhile a mapper thread maps, mprotects and unmaps a large region
+ * in small steps, and the main thread keeps creating threads.  The
+ * elapsed time is printed, for comparing lookup scalability.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define N_CHECKERS 4
+#define N_CHECKS 20000
+#define N_THREADS 200
+#define MAP_PAGES 256
+
+struct context {
+    int pagesize;
+    int dev_zero_fd;
+    char *buf;
+    char * volatile hole;       /* keep NULL hidden from the compiler */
+    volatile bool run;          /* polled by the mapper thread */
+};
+
+static void *thread_check(void *arg)
+{
+    struct context *ctx = arg;
+    ssize_t sret;
+    int i;
+
+    for (i = 0; i < N_CHECKS; i++) {
+        /* Mapped: must succeed. */
+        sret = read(ctx->dev_zero_fd, ctx->buf, ctx->pagesize);
+        assert(sret == ctx->pagesize);
+
+        /* Never mapped: must fail. */
+        sret = read(ctx->dev_zero_fd, ctx->hole, ctx->pagesize);
+        assert(sret == -1 && errno == EFAULT);
+    }
+
+    return NULL;
+}
+
+static void *thread_mapper(void *arg)
+{
+    struct context *ctx = arg;
+    size_t len = (size_t)MAP_PAGES * ctx->pagesize;
+    char *p;
+    int i, ret;
+
+    while (ctx->run) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(p != MAP_FAILED);
+
+        /* Split the region into many nodes, then merge it in one call. */
+        for (i = 0; i < MAP_PAGES; i += 2) {
+            ret = mprotect(p + (size_t)i * ctx->pagesize, ctx->pagesize,
+                           PROT_READ);
+            assert(ret == 0);
+        }
+        ret = mprotect(p, len, PROT_READ | PROT_WRITE);
+        assert(ret == 0);
+
+        ret = munmap(p, len);
+        assert(ret == 0);
+    }
+
+    return NULL;
+}
+
+static void *thread_dummy(void *arg)
+{
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t checkers[N_CHECKERS], mapper, dummy;
+    struct context ctx;
+    struct timespec t0, t1;
+    int i, ret;
+
+    ctx.pagesize = getpagesize();
+    ctx.dev_zero_fd = open("/dev/zero", O_RDONLY);
+    assert(ctx.dev_zero_fd >= 0);
+    ctx.run = true;
+
+    ctx.buf = mmap(NULL, ctx.pagesize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(ctx.buf != MAP_FAILED);
+
+    /* The first page is never mapped, unlike any hole we could make. */
+    ctx.hole = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    ret = pthread_create(&mapper, NULL, thread_mapper, &ctx);
+    assert(ret == 0);
+    for (i = 0; i < N_CHECKERS; i++) {
+        ret = pthread_create(&checkers[i], NULL, thread_check, &ctx);
+        assert(ret == 0);
+    }
+
+    for (i = 0; i < N_THREADS; i++) {
+        ret = pthread_create(&dummy, NULL, thread_dummy, NULL);
+        assert(ret == 0);
+        ret = pthread_join(dummy, NULL);
+        assert(ret == 0);
+    }
+
+    for (i = 0; i < N_CHECKERS; i++) {
+        ret = pthread_join(checkers[i], NULL);
+        assert(ret == 0);
+    }
+    ctx.run = false;
+    ret = pthread_join(mapper, NULL);
+    assert(ret == 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("%d checks in %.3f s\n", 2 * N_CHECKERS * N_CHECKS,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+
+    return EXIT_SUCCESS;
+}
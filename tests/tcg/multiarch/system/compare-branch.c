@@ -0,0 +1,264 @@
+/*
+ * Compare-and-branch and add-immediate test
+ *
+ * Check conditional branches on every comparison for values around the
+ * signed and unsigned boundaries, and additions of immediates around the
+ * 16 bit boundary.  Some TCG backends, such as TCI, have dedicated code
+ * paths for branches on a comparison of two registers and for small
+ * immediates, which this exercises.
+ *
+ * We don't have the benefit of libc, just builtin C primitives and
+ * whatever is in minilib.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+#define ARRAY_SIZE(x) ((sizeof(x) / sizeof((x)[0])))
+
+enum {
+    C_EQ, C_NE, C_LT, C_LE, C_GT, C_GE, C_LTU, C_LEU, C_GTU, C_GEU,
+};
+
+/*
+ * The empty asm statement keeps the compiler from turning the branch into
+ * a setcond or a conditional move.
+ */
+#define TAKEN(mask, c) \
+    do { \
+        asm volatile("" : : : "memory"); \
+        (mask) |= 1u << (c); \
+    } while (0)
+
+/*
+ * Values in ascending signed order, together with their position in
+ * ascending unsigned order.  The expected result of each comparison is
+ * derived from the positions.
+ */
+typedef struct {
+    uint64_t val;
+    int urank;
+} Value64;
+
+static const Value64 values64[] = {
+    { 0x8000000000000000ull, 7 },
+    { 0xffffffffffff8000ull, 8 },
+    { 0xffffffffffffffffull, 9 },
+    { 0, 0 },
+    { 1, 1 },
+    { 0x7fff, 2 },
+    { 0x8000, 3 },
+    { 0xffffffffull, 4 },
+    { 0x100000000ull, 5 },
+    { 0x7fffffffffffffffull, 6 },
+};
+
+typedef struct {
+    uint32_t val;
+    int urank;
+} Value32;
+
+static const Value32 values32[] = {
+    { 0x80000000u, 6 },
+    { 0xffff8000u, 7 },
+    { 0xffffffffu, 8 },
+    { 0, 0 },
+    { 1, 1 },
+    { 0x7fff, 2 },
+    { 0x8000, 3 },
+    { 0xffff, 4 },
+    { 0x7fffffffu, 5 },
+};
+
+static unsigned expected_mask(int i, int j, int ui, int uj)
+{
+    return (i == j) << C_EQ | (i != j) << C_NE |
+           (i < j) << C_LT | (i <= j) << C_LE |
+           (i > j) << C_GT | (i >= j) << C_GE |
+           (ui < uj) << C_LTU | (ui <= uj) << C_LEU |
+           (ui > uj) << C_GTU | (ui >= uj) << C_GEU;
+}
+
+static __attribute__((noinline)) unsigned branch64(uint64_t a, uint64_t b)
+{
+    unsigned mask = 0;
+
+    if (a == b) {
+        TAKEN(mask, C_EQ);
+    }
+    if (a != b) {
+        TAKEN(mask, C_NE);
+    }
+    if ((int64_t)a < (int64_t)b) {
+        TAKEN(mask, C_LT);
+    }
+    if ((int64_t)a <= (int64_t)b) {
+        TAKEN(mask, C_LE);
+    }
+    if ((int64_t)a > (int64_t)b) {
+        TAKEN(mask, C_GT);
+    }
+    if ((int64_t)a >= (int64_t)b) {
+        TAKEN(mask, C_GE);
+    }
+    if (a < b) {
+        TAKEN(mask, C_LTU);
+    }
+    if (a <= b) {
+        TAKEN(mask, C_LEU);
+    }
+    if (a > b) {
+        TAKEN(mask, C_GTU);
+    }
+    if (a >= b) {
+        TAKEN(mask, C_GEU);
+    }
+    return mask;
+}
+
+static __attribute__((noinline)) unsigned branch32(uint32_t a, uint32_t b)
+{
+    unsigned mask = 0;
+
+    if (a == b) {
+        TAKEN(mask, C_EQ);
+    }
+    if (a != b) {
+        TAKEN(mask, C_NE);
+    }
+    if ((int32_t)a < (int32_t)b) {
+        TAKEN(mask, C_LT);
+    }
+    if ((int32_t)a <= (int32_t)b) {
+        TAKEN(mask, C_LE);
+    }
+    if ((int32_t)a > (int32_t)b) {
+        TAKEN(mask, C_GT);
+    }
+    if ((int32_t)a >= (int32_t)b) {
+        TAKEN(mask, C_GE);
+    }
+    if (a < b) {
+        TAKEN(mask, C_LTU);
+    }
+    if (a <= b) {
+        TAKEN(mask, C_LEU);
+    }
+    if (a > b) {
+        TAKEN(mask, C_GTU);
+    }
+    if (a >= b) {
+        TAKEN(mask, C_GEU);
+    }
+    return mask;
+}
+
+static bool test_branches(void)
+{
+    bool ok = true;
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(values64); i++) {
+        for (j = 0; j < ARRAY_SIZE(values64); j++) {
+            unsigned expect = expected_mask(i, j, values64[i].urank,
+                                            values64[j].urank);
+            unsigned got = branch64(values64[i].val, values64[j].val);
+
+            if (got != expect) {
+                ml_printf("FAIL: branch64 %llx, %llx: %x != %x\n",
+                          values64[i].val, values64[j].val, got, expect);
+                ok = false;
+            }
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(values32); i++) {
+        for (j = 0; j < ARRAY_SIZE(values32); j++) {
+            unsigned expect = expected_mask(i, j, values32[i].urank,
+                                            values32[j].urank);
+            unsigned got = branch32(values32[i].val, values32[j].val);
+
+            if (got != expect) {
+                ml_printf("FAIL: branch32 %x, %x: %x != %x\n",
+                          values32[i].val, values32[j].val, got, expect);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+/*
+ * Compare additions of an immediate against additions of the same value
+ * loaded from memory, which the compiler cannot fold into the insn.
+ */
+#define CHECK_ADDI(type, fmt, x, imm) \
+    do { \
+        volatile type v = (type)(imm); /* not an immediate */ \
+        type r = (x) + (type)(imm); \
+        if (r != (type)((x) + v)) { \
+            ml_printf("FAIL: " fmt " + %s = " fmt "\n", (x), #imm, r); \
+            ok = false; \
+        } \
+    } while (0)
+
+#define CHECK_ADDI_ALL(type, fmt, x) \
+    do { \
+        CHECK_ADDI(type, fmt, x, 1); \
+        CHECK_ADDI(type, fmt, x, -1); \
+        CHECK_ADDI(type, fmt, x, 32767); \
+        CHECK_ADDI(type, fmt, x, -32768); \
+        CHECK_ADDI(type, fmt, x, 32768); \
+        CHECK_ADDI(type, fmt, x, -32769); \
+        CHECK_ADDI(type, fmt, x, 0x12345); \
+    } while (0)
+
+static bool test_add_immediate(void)
+{
+    bool ok = true;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(values64); i++) {
+        uint64_t x = values64[i].val;
+
+        CHECK_ADDI_ALL(uint64_t, "%llx", x);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(values32); i++) {
+        uint32_t x = values32[i].val;
+
+        CHECK_ADDI_ALL(uint32_t, "%x", x);
+    }
+    return ok;
+}
+
+/* A counted loop, whose backward branch is taken many times */
+static bool test_loop(void)
+{
+    volatile int n = 1000; /* keep the loop from being folded */
+    int64_t sum = 0;
+    int i;
+
+    for (i = n; i > 0; i--) {
+        sum += i;
+    }
+    if (sum != 500500) {
+        ml_printf("FAIL: loop sum %lld\n", sum);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    bool ok = test_branches();
+
+    ok &= test_add_immediate();
+    ok &= test_loop();
+
+    ml_printf("Test complete: %s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -398,6 +398,28 @@ static void test_hbitmap_reset_all(TestHBitmapData *data,
     hbitmap_test_reset_all(data);
 }
 
+static void test_hbitmap_sparse_leaves(TestHBitmapData *data,
+                                       const void *unused)
+{
+    /* Fill, punch and empty ranges spanning many last-level leaves.  */
+    hbitmap_test_init(data, L3 * 2 + 23, 0);
+    hbitmap_test_set(data, 0, L3 * 2);
+    hbitmap_test_reset(data, L2, L3);
+    hbitmap_test_set(data, L2 + 1, L1 * 3);
+    hbitmap_test_reset(data, 0, L3 * 2 + 23);
+    hbitmap_test_set(data, L3 - 1, 2);
+    hbitmap_test_set(data, L3 * 2 + 22, 1);
+    hbitmap_test_check_get(data);
+
+    hbitmap_deserialize_ones(data->hb, 0, L3, true);
+    bitmap_set(data->bits, 0, L3);
+    hbitmap_test_check(data, 0);
+    hbitmap_deserialize_zeroes(data->hb, L2, L2 * 2, true);
+    bitmap_clear(data->bits, L2, L2 * 2);
+    hbitmap_test_check(data, 0);
+    hbitmap_test_check_get(data);
+}
+
 static void test_hbitmap_granularity(TestHBitmapData *data,
                                      const void *unused)
 {
@@ -1061,6 +1083,7 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/reset/empty", test_hbitmap_reset_empty);
     hbitmap_test_add("/hbitmap/reset/general", test_hbitmap_reset);
     hbitmap_test_add("/hbitmap/reset/all", test_hbitmap_reset_all);
+    hbitmap_test_add("/hbitmap/reset/sparse", test_hbitmap_sparse_leaves);
     hbitmap_test_add("/hbitmap/granularity", test_hbitmap_granularity);
 
     hbitmap_test_add("/hbitmap/truncate/nop", test_hbitmap_truncate_nop);
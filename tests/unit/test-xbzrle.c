@@ -16,6 +16,26 @@
 
 #define XBZRLE_PAGE_SIZE 4096
 
+static const XbzrleEncoder *encoders;
+
+/*
+ * Encode with @enc, checking that the result is the same as the one of
+ * the generic encoder, including on overflow.
+ */
+static int encode(const XbzrleEncoder *enc, uint8_t *old_buf,
+                  uint8_t *new_buf, int slen, uint8_t *dst, int dlen)
+{
+    g_autofree uint8_t *ref = g_malloc(dlen);
+    int ref_len = encoders[0].encode(old_buf, new_buf, slen, ref, dlen);
+    int len = enc->encode(old_buf, new_buf, slen, dst, dlen);
+
+    g_assert_cmpint(len, ==, ref_len);
+    if (len > 0) {
+        g_assert(memcmp(dst, ref, len) == 0);
+    }
+    return len;
+}
+
 static void test_uleb(void)
 {
     uint32_t i, val;
@@ -38,8 +58,9 @@ static void test_uleb(void)
     g_assert(val == 0);
 }
 
-static void test_encode_decode_zero(void)
+static void test_encode_decode_zero(gconstpointer opaque)
 {
+    const XbzrleEncoder *enc = opaque;
     uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *compressed = g_malloc0(XBZRLE_PAGE_SIZE);
     int i = 0;
@@ -54,16 +75,17 @@ static void test_encode_decode_zero(void)
     buffer[1000 + diff_len + 5] = 105;
 
     /* encode zero page */
-    dlen = xbzrle_encode_buffer(buffer, buffer, XBZRLE_PAGE_SIZE,
-                                compressed, XBZRLE_PAGE_SIZE);
+    dlen = encode(enc, buffer, buffer, XBZRLE_PAGE_SIZE,
+                  compressed, XBZRLE_PAGE_SIZE);
     g_assert(dlen == 0);
 
     g_free(buffer);
     g_free(compressed);
 }
 
-static void test_encode_decode_unchanged(void)
+static void test_encode_decode_unchanged(gconstpointer opaque)
 {
+    const XbzrleEncoder *enc = opaque;
     uint8_t *compressed = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *test = g_malloc0(XBZRLE_PAGE_SIZE);
     int i = 0;
@@ -78,16 +100,17 @@ static void test_encode_decode_unchanged(void)
     test[1000 + diff_len + 5] = 109;
 
     /* test unchanged buffer */
-    dlen = xbzrle_encode_buffer(test, test, XBZRLE_PAGE_SIZE,
-                                compressed, XBZRLE_PAGE_SIZE);
+    dlen = encode(enc, test, test, XBZRLE_PAGE_SIZE,
+                  compressed, XBZRLE_PAGE_SIZE);
     g_assert(dlen == 0);
 
     g_free(test);
     g_free(compressed);
 }
 
-static void test_encode_decode_1_byte(void)
+static void test_encode_decode_1_byte(gconstpointer opaque)
 {
+    const XbzrleEncoder *enc = opaque;
     uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *test = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
@@ -96,8 +119,8 @@ static void test_encode_decode_1_byte(void)
 
     test[XBZRLE_PAGE_SIZE - 1] = 1;
 
-    dlen = xbzrle_encode_buffer(buffer, test, XBZRLE_PAGE_SIZE,
-                                compressed, XBZRLE_PAGE_SIZE);
+    dlen = encode(enc, buffer, test, XBZRLE_PAGE_SIZE,
+                  compressed, XBZRLE_PAGE_SIZE);
     g_assert(dlen == (uleb128_encode_small(&buf[0], 4095) + 2));
 
     rc = xbzrle_decode_buffer(compressed, dlen, buffer, XBZRLE_PAGE_SIZE);
@@ -109,8 +132,9 @@ static void test_encode_decode_1_byte(void)
     g_free(test);
 }
 
-static void test_encode_decode_overflow(void)
+static void test_encode_decode_overflow(gconstpointer opaque)
 {
+    const XbzrleEncoder *enc = opaque;
     uint8_t *compressed = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *test = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
@@ -121,8 +145,8 @@ static void test_encode_decode_overflow(void)
     }
 
     /* encode overflow */
-    rc = xbzrle_encode_buffer(buffer, test, XBZRLE_PAGE_SIZE,
-                              compressed, XBZRLE_PAGE_SIZE);
+    rc = encode(enc, buffer, test, XBZRLE_PAGE_SIZE,
+                compressed, XBZRLE_PAGE_SIZE);
     g_assert(rc == -1);
 
     g_free(buffer);
@@ -130,7 +154,7 @@ static void test_encode_decode_overflow(void)
     g_free(test);
 }
 
-static void encode_decode_range(void)
+static void encode_decode_range(const XbzrleEncoder *enc)
 {
     uint8_t *buffer = g_malloc0(XBZRLE_PAGE_SIZE);
     uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
@@ -152,8 +176,8 @@ static void encode_decode_range(void)
     test[1000 + diff_len + 5] = 109;
 
     /* test encode/decode */
-    dlen = xbzrle_encode_buffer(test, buffer, XBZRLE_PAGE_SIZE,
-                                compressed, XBZRLE_PAGE_SIZE);
+    dlen = encode(enc, test, buffer, XBZRLE_PAGE_SIZE,
+                  compressed, XBZRLE_PAGE_SIZE);
 
     rc = xbzrle_decode_buffer(compressed, dlen, test, XBZRLE_PAGE_SIZE);
     g_assert(rc < XBZRLE_PAGE_SIZE);
@@ -164,27 +188,137 @@ static void encode_decode_range(void)
     g_free(test);
 }
 
-static void test_encode_decode(void)
+static void test_encode_decode(gconstpointer opaque)
+{
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        encode_decode_range(opaque);
+    }
+}
+
+/*
+ * Dirty runs of every length up to a few vector widths, so that both the
+ * vector and the scalar tails of the encoder and the decoder are covered.
+ */
+static void encode_decode_random_runs(const XbzrleEncoder *enc,
+                                      int max_run)
+{
+    uint8_t *buffer = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *test = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int nr_runs = g_test_rand_int_range(1, 24);
+    int i, j, dlen, rc;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i++) {
+        buffer[i] = g_test_rand_int();
+    }
+    memcpy(test, buffer, XBZRLE_PAGE_SIZE);
+
+    for (i = 0; i < nr_runs; i++) {
+        int len = g_test_rand_int_range(1, max_run + 1);
+        int start = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE - len + 1);
+
+        for (j = start; j < start + len; j++) {
+            test[j] = buffer[j] ^ g_test_rand_int_range(1, 256);
+        }
+    }
+
+    dlen = encode(enc, buffer, test, XBZRLE_PAGE_SIZE,
+                  compressed, XBZRLE_PAGE_SIZE);
+    g_assert(dlen > 0);
+
+    rc = xbzrle_decode_buffer(compressed, dlen, buffer, XBZRLE_PAGE_SIZE);
+    g_assert(rc > 0 && rc <= XBZRLE_PAGE_SIZE);
+    g_assert(memcmp(test, buffer, XBZRLE_PAGE_SIZE) == 0);
+
+    g_free(buffer);
+    g_free(compressed);
+    g_free(test);
+}
+
+static void test_encode_decode_random(gconstpointer opaque)
 {
+    const XbzrleEncoder *enc = opaque;
     int i;
 
     for (i = 0; i < 10000; i++) {
-        encode_decode_range();
+        encode_decode_random_runs(enc, i % 2 ? 17 : 130);
+    }
+}
+
+/*
+ * Random pages where each byte changes with a probability from 1 to
+ * 1/256, so that some of them overflow the output buffer
+ */
+static void test_encode_random_pages(gconstpointer opaque)
+{
+    const XbzrleEncoder *enc = opaque;
+    uint8_t *buffer = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *test = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int i, j, dlen, rc;
+
+    for (i = 0; i < 2000; i++) {
+        int changed = 1 << (i % 9);
+
+        for (j = 0; j < XBZRLE_PAGE_SIZE; j++) {
+            buffer[j] = g_test_rand_int();
+            test[j] = g_test_rand_int_range(0, changed) ? buffer[j]
+                                                        : g_test_rand_int();
+        }
+
+        dlen = encode(enc, buffer, test, XBZRLE_PAGE_SIZE,
+                      compressed, XBZRLE_PAGE_SIZE);
+        if (dlen > 0) {
+            rc = xbzrle_decode_buffer(compressed, dlen, buffer,
+                                      XBZRLE_PAGE_SIZE);
+            g_assert(rc > 0 && rc <= XBZRLE_PAGE_SIZE);
+        }
+        if (dlen >= 0) {
+            g_assert(memcmp(test, buffer, XBZRLE_PAGE_SIZE) == 0);
+        }
     }
+
+    g_free(buffer);
+    g_free(compressed);
+    g_free(test);
+}
+
+static void add_encoder_test(const XbzrleEncoder *enc, const char *name,
+                             GTestDataFunc fn)
+{
+    g_autofree char *path = g_strdup_printf("/xbzrle/%s/%s", enc->name, name);
+
+    g_test_add_data_func(path, enc, fn);
 }
 
 int main(int argc, char **argv)
 {
+    int nr_encoders, i;
+
     g_test_init(&argc, &argv, NULL);
     g_test_rand_int();
     g_test_add_func("/xbzrle/uleb", test_uleb);
-    g_test_add_func("/xbzrle/encode_decode_zero", test_encode_decode_zero);
-    g_test_add_func("/xbzrle/encode_decode_unchanged",
-                    test_encode_decode_unchanged);
-    g_test_add_func("/xbzrle/encode_decode_1_byte", test_encode_decode_1_byte);
-    g_test_add_func("/xbzrle/encode_decode_overflow",
-                    test_encode_decode_overflow);
-    g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+
+    /* Every encoder runs every test, and must match the generic one */
+    nr_encoders = xbzrle_get_encoders(&encoders);
+    for (i = 0; i < nr_encoders; i++) {
+        const XbzrleEncoder *enc = &encoders[i];
+
+        add_encoder_test(enc, "encode_decode_zero", test_encode_decode_zero);
+        add_encoder_test(enc, "encode_decode_unchanged",
+                         test_encode_decode_unchanged);
+        add_encoder_test(enc, "encode_decode_1_byte",
+                         test_encode_decode_1_byte);
+        add_encoder_test(enc, "encode_decode_overflow",
+                         test_encode_decode_overflow);
+        add_encoder_test(enc, "encode_decode", test_encode_decode);
+        add_encoder_test(enc, "encode_decode_random",
+                         test_encode_decode_random);
+        add_encoder_test(enc, "encode_random_pages",
+                         test_encode_random_pages);
+    }
 
     return g_test_run();
 }
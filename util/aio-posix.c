@@ -21,12 +21,21 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "trace.h"
 #include "aio-posix.h"
 
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
+/*
+ * With poll_percentile, halve the histograms of a handler every so many
+ * events so that the polling time follows changes in the workload, and
+ * ignore handlers until they have seen enough events.
+ */
+#define POLL_HIST_DECAY_EVENTS 256
+#define POLL_HIST_MIN_EVENTS 16
+
 bool aio_poll_disabled(AioContext *ctx)
 {
     return qatomic_read(&ctx->poll_disable_cnt);
@@ -565,6 +574,93 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
     return progress;
 }
 
+static int poll_hist_bucket(int64_t ns)
+{
+    if (ns <= 0) {
+        return 0;
+    }
+    return MIN(64 - clz64(ns), AIO_POLL_HIST_BUCKETS - 1);
+}
+
+/* Account an event of @node at time @now in its histogram */
+static void poll_hist_add_event(AioHandler *node, int64_t now)
+{
+    int i;
+
+    if (node->poll_last_event) {
+        node->poll_hist[poll_hist_bucket(now - node->poll_last_event)]++;
+
+        if (++node->poll_hist_count == POLL_HIST_DECAY_EVENTS) {
+            node->poll_hist_count = 0;
+            for (i = 0; i < AIO_POLL_HIST_BUCKETS; i++) {
+                node->poll_hist[i] /= 2;
+                node->poll_hist_count += node->poll_hist[i];
+            }
+        }
+    }
+    node->poll_last_event = now;
+}
+
+/*
+ * Returns how long to poll for to see @percentile percent of the events
+ * of @node, rounded up to the end of a histogram bucket.
+ */
+static int64_t poll_hist_percentile(AioHandler *node, int64_t percentile)
+{
+    uint64_t target = DIV_ROUND_UP((uint64_t)node->poll_hist_count *
+                                   percentile, 100);
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < AIO_POLL_HIST_BUCKETS - 1; i++) {
+        sum += node->poll_hist[i];
+        if (sum >= target) {
+            return 1LL << i;
+        }
+    }
+    return INT64_MAX;
+}
+
+/*
+ * adjust_polling_time_percentile:
+ * @ctx: the AioContext
+ * @ready_list: the handlers that had an event in this aio_poll()
+ * @now: the time at which the events were seen
+ *
+ * Poll long enough to see ctx->poll_percentile percent of the events of
+ * the polled handler that has the shortest time between events.
+ */
+static void adjust_polling_time_percentile(AioContext *ctx,
+                                           AioHandlerList *ready_list,
+                                           int64_t now)
+{
+    int64_t old = ctx->poll_ns;
+    int64_t window = INT64_MAX;
+    AioHandler *node;
+
+    QLIST_FOREACH(node, ready_list, node_ready) {
+        if (node->io_poll && node->opaque != &ctx->notifier) {
+            poll_hist_add_event(node, now);
+        }
+    }
+
+    QLIST_FOREACH(node, &ctx->poll_aio_handlers, node_poll) {
+        if (node->poll_hist_count >= POLL_HIST_MIN_EVENTS) {
+            window = MIN(window,
+                         poll_hist_percentile(node, ctx->poll_percentile));
+        }
+    }
+
+    /* Don't burn CPU for events that would mostly come too late anyway */
+    ctx->poll_ns = window <= ctx->poll_max_ns ? window : 0;
+
+    if (ctx->poll_ns < old) {
+        trace_poll_shrink(ctx, old, ctx->poll_ns);
+    } else if (ctx->poll_ns > old) {
+        trace_poll_grow(ctx, old, ctx->poll_ns);
+    }
+}
+
 /* try_poll_mode:
  * @ctx: the AioContext
  * @ready_list: list to add handlers that need to be run
@@ -593,8 +689,10 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
         poll_set_started(ctx, ready_list, true);
 
         if (run_poll_handlers(ctx, ready_list, max_ns, timeout)) {
+            stat64_add(&ctx->poll_stats.hits, 1);
             return true;
         }
+        stat64_add(&ctx->poll_stats.misses, 1);
     }
     return false;
 }
@@ -621,7 +719,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     qemu_lockcnt_inc(&ctx->list_lock);
 
-    if (ctx->poll_max_ns) {
+    if (blocking || ctx->poll_max_ns) {
         start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     }
 
@@ -678,11 +776,21 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
     aio_notify_accept(ctx);
 
-    /* Adjust polling time */
-    if (ctx->poll_max_ns) {
-        int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+    if (blocking || ctx->poll_max_ns) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        int64_t block_ns = now - start;
+
+        if (blocking) {
+            stat64_add(&ctx->poll_stats.wait_time[poll_hist_bucket(block_ns)],
+                       1);
+        }
 
-        if (block_ns <= ctx->poll_ns) {
+        /* Adjust polling time */
+        if (!ctx->poll_max_ns) {
+            /* Polling is disabled */
+        } else if (ctx->poll_percentile) {
+            adjust_polling_time_percentile(ctx, &ready_list, now);
+        } else if (block_ns <= ctx->poll_ns) {
             /* This is the sweet spot, no adjustment needed */
         } else if (block_ns > ctx->poll_max_ns) {
             /* We'd have to poll for too long, poll less */
@@ -777,6 +885,15 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
+void aio_context_set_poll_percentile(AioContext *ctx, int64_t percentile)
+{
+    /* No thread synchronization here, as in aio_context_set_poll_params() */
+    ctx->poll_percentile = percentile;
+    ctx->poll_ns = 0;
+
+    aio_notify(ctx);
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
     /*
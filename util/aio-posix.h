@@ -37,6 +37,10 @@ struct AioHandler {
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
+    int64_t poll_last_event; /* when the handler last had an event */
+    uint32_t poll_hist_count; /* number of samples in poll_hist */
+    /* time between two events, only tracked with ctx->poll_percentile */
+    uint32_t poll_hist[AIO_POLL_HIST_BUCKETS];
     bool poll_ready; /* has polling detected an event? */
 };
 
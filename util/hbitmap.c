@@ -50,8 +50,29 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * The last level is by far the largest, and for big disks most of it is
+ * usually zero.  It is therefore split into leaves of HBITMAP_LEAF_WORDS
+ * words that are allocated only when a bit in them is first set; a leaf
+ * that is entirely set instead points to a single shared, read-only leaf
+ * of ones, which is copied before it is modified.  Leaves that become
+ * clear again are freed.  Memory usage thus follows the amount of dirty
+ * data rather than the size of the bitmap, and all other levels (which are
+ * at most 1/BITS_PER_LONG of the size of the last one) are unchanged.
  */
 
+#define HBITMAP_LEAF_SHIFT     9
+#define HBITMAP_LEAF_WORDS     (1UL << HBITMAP_LEAF_SHIFT)
+
+/* Number of bits of a last-level index that select a bit within a leaf.  */
+#define HBITMAP_LEAF_BITS      (HBITMAP_LEAF_SHIFT + BITS_PER_LEVEL)
+
+static const unsigned long hb_zero_leaf[HBITMAP_LEAF_WORDS];
+static const unsigned long hb_full_leaf[HBITMAP_LEAF_WORDS] = {
+    [0 ... HBITMAP_LEAF_WORDS - 1] = ~0UL
+};
+#define HB_FULL_LEAF           ((unsigned long *)hb_full_leaf)
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -93,14 +114,119 @@ struct HBitmap {
      * actual bitmap.
      *
      * Note that all bitmaps have the same number of levels.  Even a 1-bit
-     * bitmap will still allocate HBITMAP_LEVELS arrays.
+     * bitmap will still allocate HBITMAP_LEVELS arrays.  The last level is
+     * not stored here, but in @leaves.
+     */
+    unsigned long *levels[HBITMAP_LEVELS - 1];
+
+    /*
+     * The leaves of the last level, each HBITMAP_LEAF_WORDS words long.
+     * NULL stands for a leaf of zeroes and HB_FULL_LEAF for a leaf of ones;
+     * the latter is only used for leaves that are entirely inside the bitmap.
      */
-    unsigned long *levels[HBITMAP_LEVELS];
+    unsigned long **leaves;
 
-    /* The length of each levels[] array. */
+    /* The length in words of each level, including the last one. */
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+static inline uint64_t hb_leaf_count(uint64_t words)
+{
+    return DIV_ROUND_UP(words, HBITMAP_LEAF_WORDS);
+}
+
+/* Return word @pos of level @level; absent leaves read as zero.  */
+static inline unsigned long hb_word(const HBitmap *hb, int level, uint64_t pos)
+{
+    const unsigned long *leaf;
+
+    if (level < HBITMAP_LEVELS - 1) {
+        return hb->levels[level][pos];
+    }
+    leaf = hb->leaves[pos >> HBITMAP_LEAF_SHIFT];
+    return leaf ? leaf[pos & (HBITMAP_LEAF_WORDS - 1)] : 0;
+}
+
+/* Replace leaf @n with @leaf, which may be NULL or HB_FULL_LEAF.  */
+static void hb_leaf_replace(HBitmap *hb, uint64_t n, unsigned long *leaf)
+{
+    if (hb->leaves[n] != HB_FULL_LEAF) {
+        g_free(hb->leaves[n]);
+    }
+    hb->leaves[n] = leaf;
+}
+
+/* Return leaf @n in a form that can be written to.  */
+static unsigned long *hb_leaf_mut(HBitmap *hb, uint64_t n)
+{
+    unsigned long *leaf = hb->leaves[n];
+
+    if (leaf && leaf != HB_FULL_LEAF) {
+        return leaf;
+    }
+
+    leaf = g_new(unsigned long, HBITMAP_LEAF_WORDS);
+    memset(leaf, hb->leaves[n] ? 0xff : 0, HBITMAP_LEAF_WORDS * sizeof(*leaf));
+    hb->leaves[n] = leaf;
+    return leaf;
+}
+
+/* Whether leaf @n lies entirely within the bitmap; the last one may not. */
+static inline bool hb_leaf_is_whole(const HBitmap *hb, uint64_t n)
+{
+    return (n + 1) << HBITMAP_LEAF_BITS <= hb->size;
+}
+
+/* Whether leaf @n has any bit set, according to the level above it.  */
+static bool hb_leaf_is_dirty(const HBitmap *hb, uint64_t n)
+{
+    const unsigned long *up = hb->levels[HBITMAP_LEVELS - 2];
+    uint64_t pos = (n << HBITMAP_LEAF_SHIFT) >> BITS_PER_LEVEL;
+    uint64_t end = MIN(pos + (HBITMAP_LEAF_WORDS >> BITS_PER_LEVEL),
+                       hb->sizes[HBITMAP_LEVELS - 2]);
+
+    for (; pos < end; pos++) {
+        if (up[pos]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Free leaf @n if it was left without any bit set.  */
+static void hb_leaf_drop_clean(HBitmap *hb, uint64_t n)
+{
+    if (hb->leaves[n] && !hb_leaf_is_dirty(hb, n)) {
+        hb_leaf_replace(hb, n, NULL);
+    }
+}
+
+/*
+ * Free leaf @n if it is all zeroes, or share it if it is all ones.  This
+ * does not look at the upper levels, so it can be used while deserializing.
+ */
+static void hb_leaf_compact(HBitmap *hb, uint64_t n)
+{
+    unsigned long *leaf = hb->leaves[n];
+    unsigned long any = 0, all = ~0UL;
+    unsigned i;
+
+    if (!leaf || leaf == HB_FULL_LEAF) {
+        return;
+    }
+
+    for (i = 0; i < HBITMAP_LEAF_WORDS; i++) {
+        any |= leaf[i];
+        all &= leaf[i];
+    }
+
+    if (!any) {
+        hb_leaf_replace(hb, n, NULL);
+    } else if (all == ~0UL && hb_leaf_is_whole(hb, n)) {
+        hb_leaf_replace(hb, n, HB_FULL_LEAF);
+    }
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -136,7 +262,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
         hbi->cur[i] = cur & (cur - 1);
 
         /* Set up next level for iteration.  */
-        cur = hb->levels[i + 1][pos];
+        cur = hb_word(hb, i + 1, pos);
     }
 
     hbi->pos = pos;
@@ -149,7 +275,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
 int64_t hbitmap_iter_next(HBitmapIter *hbi)
 {
     unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1] &
-            hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
+            hb_word(hbi->hb, HBITMAP_LEVELS - 1, hbi->pos);
     int64_t item;
 
     if (cur == 0) {
@@ -182,7 +308,7 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
         pos >>= BITS_PER_LEVEL;
 
         /* Drop bits representing items before first.  */
-        hbi->cur[i] = hb->levels[i][pos] & ~((1UL << bit) - 1);
+        hbi->cur[i] = hb_word(hb, i, pos) & ~((1UL << bit) - 1);
 
         /* We have already added level i+1, so the lowest set bit has
          * been processed.  Clear it.
@@ -220,8 +346,7 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
-    unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
-    unsigned long cur = last_lev[pos];
+    unsigned long cur;
     unsigned start_bit_offset;
     uint64_t end_bit, sz;
     int64_t res;
@@ -236,6 +361,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
                 hb->size :
                 ((start + count - 1) >> hb->granularity) + 1;
     sz = (end_bit + BITS_PER_LONG - 1) >> BITS_PER_LEVEL;
+    cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
 
     /* There may be some zero bits in @cur before @start. We are not interested
      * in them, let's set them.
@@ -247,13 +373,14 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     if (cur == (unsigned long)-1) {
         do {
             pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
+        } while (pos < sz &&
+                 hb_word(hb, HBITMAP_LEVELS - 1, pos) == (unsigned long)-1);
 
         if (pos >= sz) {
             return -1;
         }
 
-        cur = last_lev[pos];
+        cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
     }
 
     res = (pos << BITS_PER_LEVEL) + ctol(cur);
@@ -426,31 +553,79 @@ static inline bool hb_set_elem(unsigned long *elem, uint64_t start, uint64_t las
     return old != *elem;
 }
 
-/* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
- * Returns true if at least one bit is changed. */
-static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
-                           uint64_t last)
+/*
+ * Set bits @start to @last of the array @words.
+ * Returns true if at least one bit is changed.
+ */
+static bool hb_set_words(unsigned long *words, uint64_t start, uint64_t last)
 {
-    size_t pos = start >> BITS_PER_LEVEL;
+    size_t i = start >> BITS_PER_LEVEL;
     size_t lastpos = last >> BITS_PER_LEVEL;
     bool changed = false;
-    size_t i;
 
-    i = pos;
     if (i < lastpos) {
         uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
-        changed |= hb_set_elem(&hb->levels[level][i], start, next - 1);
+        changed |= hb_set_elem(&words[i], start, next - 1);
         for (;;) {
             start = next;
             next += BITS_PER_LONG;
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] == 0);
-            hb->levels[level][i] = ~0UL;
+            changed |= (words[i] == 0);
+            words[i] = ~0UL;
         }
     }
-    changed |= hb_set_elem(&hb->levels[level][i], start, last);
+    changed |= hb_set_elem(&words[i], start, last);
+    return changed;
+}
+
+/*
+ * Same as hb_set_words, for the last level.  Leaves that are entirely
+ * covered become the shared leaf of ones, others are allocated as needed.
+ */
+static bool hb_set_leaves(HBitmap *hb, uint64_t start, uint64_t last)
+{
+    const uint64_t mask = (UINT64_C(1) << HBITMAP_LEAF_BITS) - 1;
+    bool changed = false;
+
+    for (;;) {
+        uint64_t n = start >> HBITMAP_LEAF_BITS;
+        uint64_t leaf_last = MIN(last, start | mask);
+        unsigned long *leaf = hb->leaves[n];
+
+        if (leaf == HB_FULL_LEAF) {
+            /* Nothing to do.  */
+        } else if ((start & mask) == 0 && (leaf_last & mask) == mask) {
+            changed |= !leaf || memcmp(leaf, hb_full_leaf,
+                                       sizeof(hb_full_leaf)) != 0;
+            hb_leaf_replace(hb, n, HB_FULL_LEAF);
+        } else {
+            changed |= hb_set_words(hb_leaf_mut(hb, n), start & mask,
+                                    leaf_last & mask);
+        }
+
+        if (leaf_last == last) {
+            return changed;
+        }
+        start = leaf_last + 1;
+    }
+}
+
+/* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
+ * Returns true if at least one bit is changed. */
+static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
+                           uint64_t last)
+{
+    size_t pos = start >> BITS_PER_LEVEL;
+    size_t lastpos = last >> BITS_PER_LEVEL;
+    bool changed;
+
+    if (level == HBITMAP_LEVELS - 1) {
+        changed = hb_set_leaves(hb, start, last);
+    } else {
+        changed = hb_set_words(hb->levels[level], start, last);
+    }
 
     /* If there was any change in this layer, we may have to update
      * the one above.
@@ -504,55 +679,96 @@ static inline bool hb_reset_elem(unsigned long *elem, uint64_t start, uint64_t l
     return blanked;
 }
 
-/* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
- * Returns true if at least one bit is changed. */
-static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
-                             uint64_t last)
+/*
+ * Reset bits @start to @last of the array @words.
+ * Returns true if at least one word became zero.
+ */
+static bool hb_reset_words(unsigned long *words, uint64_t start, uint64_t last)
 {
-    size_t pos = start >> BITS_PER_LEVEL;
+    size_t i = start >> BITS_PER_LEVEL;
     size_t lastpos = last >> BITS_PER_LEVEL;
     bool changed = false;
-    size_t i;
 
-    i = pos;
     if (i < lastpos) {
         uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
-
-        /* Here we need a more complex test than when setting bits.  Even if
-         * something was changed, we must not blank bits in the upper level
-         * unless the lower-level word became entirely zero.  So, remove pos
-         * from the upper-level range if bits remain set.
-         */
-        if (hb_reset_elem(&hb->levels[level][i], start, next - 1)) {
-            changed = true;
-        } else {
-            pos++;
-        }
-
+        changed |= hb_reset_elem(&words[i], start, next - 1);
         for (;;) {
             start = next;
             next += BITS_PER_LONG;
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
+            changed |= (words[i] != 0);
+            words[i] = 0UL;
         }
     }
+    changed |= hb_reset_elem(&words[i], start, last);
+    return changed;
+}
 
-    /* Same as above, this time for lastpos.  */
-    if (hb_reset_elem(&hb->levels[level][i], start, last)) {
-        changed = true;
+/*
+ * Same as hb_reset_words, for the last level.  Leaves that are entirely
+ * covered are freed; the caller frees partially covered ones once they
+ * are found to be clear.
+ */
+static bool hb_reset_leaves(HBitmap *hb, uint64_t start, uint64_t last)
+{
+    const uint64_t mask = (UINT64_C(1) << HBITMAP_LEAF_BITS) - 1;
+    bool changed = false;
+
+    for (;;) {
+        uint64_t n = start >> HBITMAP_LEAF_BITS;
+        uint64_t leaf_last = MIN(last, start | mask);
+
+        if (!hb->leaves[n]) {
+            /* Nothing to do.  */
+        } else if ((start & mask) == 0 && (leaf_last & mask) == mask) {
+            changed |= hb_leaf_is_dirty(hb, n);
+            hb_leaf_replace(hb, n, NULL);
+        } else {
+            changed |= hb_reset_words(hb_leaf_mut(hb, n), start & mask,
+                                      leaf_last & mask);
+        }
+
+        if (leaf_last == last) {
+            return changed;
+        }
+        start = leaf_last + 1;
+    }
+}
+
+/* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
+ * Returns true if at least one bit is changed. */
+static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
+                             uint64_t last)
+{
+    size_t pos = start >> BITS_PER_LEVEL;
+    size_t lastpos = last >> BITS_PER_LEVEL;
+    bool changed;
+
+    if (level == HBITMAP_LEVELS - 1) {
+        changed = hb_reset_leaves(hb, start, last);
     } else {
-        lastpos--;
+        changed = hb_reset_words(hb->levels[level], start, last);
     }
 
     if (level > 0 && changed) {
+        /* Here we need a more complex test than when setting bits.  Even if
+         * something was changed, we must not blank bits in the upper level
+         * unless the lower-level word became entirely zero.  So, remove pos
+         * and lastpos from the upper-level range if bits remain set.
+         */
+        if (hb_word(hb, level, pos)) {
+            pos++;
+        }
+        if (hb_word(hb, level, lastpos)) {
+            lastpos--;
+        }
+        assert(pos <= lastpos);
         hb_reset_between(hb, level - 1, pos, lastpos);
     }
 
     return changed;
-
 }
 
 void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
@@ -577,18 +793,28 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
 
     hb->count -= hb_count_between(hb, first, last);
-    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
-        hbitmap_set(hb->meta, start, count);
+    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last)) {
+        /* Leaves in the middle are gone already, check the edges.  */
+        hb_leaf_drop_clean(hb, first >> HBITMAP_LEAF_BITS);
+        hb_leaf_drop_clean(hb, last >> HBITMAP_LEAF_BITS);
+
+        if (hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
     }
 }
 
 void hbitmap_reset_all(HBitmap *hb)
 {
     unsigned int i;
+    uint64_t n;
+
+    for (n = 0; n < hb_leaf_count(hb->sizes[HBITMAP_LEVELS - 1]); n++) {
+        hb_leaf_replace(hb, n, NULL);
+    }
 
     /* Same as hbitmap_alloc() except for memset() instead of malloc() */
-    for (i = HBITMAP_LEVELS; --i >= 1; ) {
+    for (i = HBITMAP_LEVELS - 1; --i >= 1; ) {
         memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
     }
 
@@ -621,7 +847,7 @@ bool hbitmap_get(const HBitmap *hb, uint64_t item)
     unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
     assert(pos < hb->size);
 
-    return (hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] & bit) != 0;
+    return (hb_word(hb, HBITMAP_LEVELS - 1, pos >> BITS_PER_LEVEL) & bit) != 0;
 }
 
 uint64_t hbitmap_serialization_align(const HBitmap *hb)
@@ -638,7 +864,7 @@ uint64_t hbitmap_serialization_align(const HBitmap *hb)
  */
 static void serialization_chunk(const HBitmap *hb,
                                 uint64_t start, uint64_t count,
-                                unsigned long **first_el, uint64_t *el_count)
+                                uint64_t *first_el, uint64_t *el_count)
 {
     uint64_t last = start + count - 1;
     uint64_t gran = hbitmap_serialization_align(hb);
@@ -652,7 +878,7 @@ static void serialization_chunk(const HBitmap *hb,
     start = (start >> hb->granularity) >> BITS_PER_LEVEL;
     last = (last >> hb->granularity) >> BITS_PER_LEVEL;
 
-    *first_el = &hb->levels[HBITMAP_LEVELS - 1][start];
+    *first_el = start;
     *el_count = last - start + 1;
 }
 
@@ -660,7 +886,7 @@ uint64_t hbitmap_serialization_size(const HBitmap *hb,
                                     uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur;
+    uint64_t cur;
 
     if (!count) {
         return 0;
@@ -674,7 +900,7 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
 
     if (!count) {
         return;
@@ -683,9 +909,9 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        unsigned long el =
-            (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
+        unsigned long el = hb_word(hb, HBITMAP_LEVELS - 1, cur);
 
+        el = (BITS_PER_LONG == 32 ? cpu_to_le32(el) : cpu_to_le64(el));
         memcpy(buf, &el, sizeof(el));
         buf += sizeof(el);
         cur++;
@@ -697,7 +923,7 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
 
     if (!count) {
         return;
@@ -706,12 +932,20 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        memcpy(cur, buf, sizeof(*cur));
+        unsigned long el;
+
+        memcpy(&el, buf, sizeof(el));
 
         if (BITS_PER_LONG == 32) {
-            le32_to_cpus((uint32_t *)cur);
+            le32_to_cpus((uint32_t *)&el);
         } else {
-            le64_to_cpus((uint64_t *)cur);
+            le64_to_cpus((uint64_t *)&el);
+        }
+
+        /* Do not allocate leaves just to store zeroes into them.  */
+        if (el != hb_word(hb, HBITMAP_LEVELS - 1, cur)) {
+            hb_leaf_mut(hb, cur >> HBITMAP_LEAF_SHIFT)
+                [cur & (HBITMAP_LEAF_WORDS - 1)] = el;
         }
 
         buf += sizeof(unsigned long);
@@ -722,18 +956,42 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     }
 }
 
+/*
+ * Fill @count words of the last level, starting at @pos, with zeroes or
+ * ones.  Whole leaves are freed or shared rather than written to.
+ */
+static void hb_fill_words(HBitmap *hb, uint64_t pos, uint64_t count, bool ones)
+{
+    unsigned long *fill_leaf = ones ? HB_FULL_LEAF : NULL;
+    uint64_t end = pos + count;
+
+    while (pos < end) {
+        uint64_t n = pos >> HBITMAP_LEAF_SHIFT;
+        uint64_t off = pos & (HBITMAP_LEAF_WORDS - 1);
+        uint64_t len = MIN(end - pos, HBITMAP_LEAF_WORDS - off);
+
+        if (len == HBITMAP_LEAF_WORDS) {
+            hb_leaf_replace(hb, n, fill_leaf);
+        } else if (hb->leaves[n] != fill_leaf) {
+            memset(hb_leaf_mut(hb, n) + off, ones ? 0xff : 0,
+                   len * sizeof(unsigned long));
+        }
+        pos += len;
+    }
+}
+
 void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    hb_fill_words(hb, first, el_count, false);
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -743,14 +1001,14 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0xff, el_count * sizeof(unsigned long));
+    hb_fill_words(hb, first, el_count, true);
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -759,8 +1017,25 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
 void hbitmap_deserialize_finish(HBitmap *bitmap)
 {
     int64_t i, size, prev_size;
+    uint64_t n;
     int lev;
 
+    /* whole words were deserialized, drop any bits past the end */
+    if (bitmap->size & (BITS_PER_LONG - 1)) {
+        uint64_t pos = bitmap->sizes[HBITMAP_LEVELS - 1] - 1;
+        unsigned long mask = (1UL << (bitmap->size & (BITS_PER_LONG - 1))) - 1;
+
+        if (hb_word(bitmap, HBITMAP_LEVELS - 1, pos) & ~mask) {
+            hb_leaf_mut(bitmap, pos >> HBITMAP_LEAF_SHIFT)
+                [pos & (HBITMAP_LEAF_WORDS - 1)] &= mask;
+        }
+    }
+
+    /* deserialization may have left leaves that are all zeroes or ones */
+    for (n = 0; n < hb_leaf_count(bitmap->sizes[HBITMAP_LEVELS - 1]); n++) {
+        hb_leaf_compact(bitmap, n);
+    }
+
     /* restore levels starting from penultimate to zero level, assuming
      * that the last level is ok */
     size = MAX((bitmap->size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
@@ -770,7 +1045,13 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
         memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
 
         for (i = 0; i < prev_size; ++i) {
-            if (bitmap->levels[lev + 1][i]) {
+            if (lev + 1 == HBITMAP_LEVELS - 1 &&
+                !bitmap->leaves[i >> HBITMAP_LEAF_SHIFT]) {
+                /* skip the whole leaf */
+                i |= HBITMAP_LEAF_WORDS - 1;
+                continue;
+            }
+            if (hb_word(bitmap, lev + 1, i)) {
                 bitmap->levels[lev][i >> BITS_PER_LEVEL] |=
                     1UL << (i & (BITS_PER_LONG - 1));
             }
@@ -784,8 +1065,13 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
 void hbitmap_free(HBitmap *hb)
 {
     unsigned i;
+    uint64_t n;
     assert(!hb->meta);
-    for (i = HBITMAP_LEVELS; i-- > 0; ) {
+    for (n = 0; n < hb_leaf_count(hb->sizes[HBITMAP_LEVELS - 1]); n++) {
+        hb_leaf_replace(hb, n, NULL);
+    }
+    g_free(hb->leaves);
+    for (i = HBITMAP_LEVELS - 1; i-- > 0; ) {
         g_free(hb->levels[i]);
     }
     g_free(hb);
@@ -808,7 +1094,12 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
-        hb->levels[i] = g_new0(unsigned long, size);
+        if (i == HBITMAP_LEVELS - 1) {
+            /* Leaves are allocated on demand.  */
+            hb->leaves = g_new0(unsigned long *, hb_leaf_count(size));
+        } else {
+            hb->levels[i] = g_new0(unsigned long, size);
+        }
     }
 
     /* We necessarily have free bits in level 0 due to the definition
@@ -820,6 +1111,25 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     return hb;
 }
 
+/*
+ * Resize the array of leaves.  Leaves beyond the new end are clear after
+ * the hbitmap_reset() in hbitmap_truncate(), and new ones start absent.
+ * A partial leaf always has its words past the end of the bitmap zeroed,
+ * so growing into it needs no work.
+ */
+static void hb_resize_leaves(HBitmap *hb, uint64_t old, uint64_t count)
+{
+    uint64_t n;
+
+    for (n = count; n < old; n++) {
+        hb_leaf_replace(hb, n, NULL);
+    }
+    hb->leaves = g_renew(unsigned long *, hb->leaves, count);
+    if (count > old) {
+        memset(&hb->leaves[old], 0, (count - old) * sizeof(*hb->leaves));
+    }
+}
+
 void hbitmap_truncate(HBitmap *hb, uint64_t size)
 {
     bool shrink;
@@ -862,6 +1172,10 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         }
         old = hb->sizes[i];
         hb->sizes[i] = size;
+        if (i == HBITMAP_LEVELS - 1) {
+            hb_resize_leaves(hb, hb_leaf_count(old), hb_leaf_count(size));
+            continue;
+        }
         hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
         if (!shrink) {
             memset(&hb->levels[i][old], 0x00,
@@ -902,6 +1216,7 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 {
     int i;
     uint64_t j;
+    uint64_t n;
 
     assert(a->orig_size == result->orig_size);
     assert(b->orig_size == result->orig_size);
@@ -934,22 +1249,56 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
     assert(a->size == b->size);
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
+    for (i = HBITMAP_LEVELS - 2; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
         }
     }
 
+    /* The last level only needs work where either side has a leaf.  */
+    for (n = 0; n < hb_leaf_count(a->sizes[HBITMAP_LEVELS - 1]); n++) {
+        unsigned long *la = a->leaves[n];
+        unsigned long *lb = b->leaves[n];
+        unsigned long *dst;
+
+        if (la == HB_FULL_LEAF || lb == HB_FULL_LEAF) {
+            if (result->leaves[n] != HB_FULL_LEAF) {
+                hb_leaf_replace(result, n, HB_FULL_LEAF);
+            }
+            continue;
+        }
+        if (!la && !lb) {
+            hb_leaf_replace(result, n, NULL);
+            continue;
+        }
+
+        /* If result aliases a or b, dst is the same leaf as la or lb.  */
+        dst = hb_leaf_mut(result, n);
+        for (j = 0; j < HBITMAP_LEAF_WORDS; j++) {
+            dst[j] = (la ? la[j] : 0) | (lb ? lb[j] : 0);
+        }
+    }
+
     /* Recompute the dirty count */
     result->count = hb_count_between(result, 0, result->size - 1);
 }
 
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
 {
-    size_t size = bitmap->sizes[HBITMAP_LEVELS - 1] * sizeof(unsigned long);
-    char *data = (char *)bitmap->levels[HBITMAP_LEVELS - 1];
+    uint64_t words = bitmap->sizes[HBITMAP_LEVELS - 1];
+    uint64_t n, nr_leaves = hb_leaf_count(words);
+    g_autofree struct iovec *iov = g_new(struct iovec, nr_leaves);
     char *hash = NULL;
-    qcrypto_hash_digest(QCRYPTO_HASH_ALG_SHA256, data, size, &hash, errp);
+
+    /* Hash the same bytes as a flat last level would contain.  */
+    for (n = 0; n < nr_leaves; n++) {
+        const unsigned long *leaf = bitmap->leaves[n] ?: hb_zero_leaf;
+        uint64_t len = MIN(words - n * HBITMAP_LEAF_WORDS, HBITMAP_LEAF_WORDS);
+
+        iov[n].iov_base = (void *)leaf;
+        iov[n].iov_len = len * sizeof(unsigned long);
+    }
+    qcrypto_hash_digestv(QCRYPTO_HASH_ALG_SHA256, iov, nr_leaves, &hash, errp);
 
     return hash;
 }
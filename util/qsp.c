@@ -115,6 +115,10 @@ static struct qht qsp_callsite_ht;
 
 static struct qht qsp_ht;
 static QSPSnapshot *qsp_snapshot;
+
+/* names set with qsp_set_name(), indexed by object */
+static GHashTable *qsp_names;
+static QemuSpin qsp_names_lock;
 static bool qsp_initialized, qsp_initializing;
 
 static const char * const qsp_typenames[] = {
@@ -241,6 +245,8 @@ static void qsp_do_init(void)
              QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
     qht_init(&qsp_callsite_ht, qsp_callsite_cmp, QSP_INITIAL_SIZE,
              QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+    qsp_names = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    qemu_spin_init(&qsp_names_lock);
 }
 
 static __attribute__((noinline)) void qsp_init__slowpath(void)
@@ -457,6 +463,18 @@ void qsp_disable(void)
     qatomic_set(&qemu_cond_timedwait_func, qemu_cond_timedwait_impl);
 }
 
+void qsp_set_name(const void *obj, const char *name)
+{
+    qsp_init();
+    qemu_spin_lock(&qsp_names_lock);
+    if (name) {
+        g_hash_table_insert(qsp_names, (gpointer)obj, g_strdup(name));
+    } else {
+        g_hash_table_remove(qsp_names, obj);
+    }
+    qemu_spin_unlock(&qsp_names_lock);
+}
+
 static gint qsp_tree_cmp(gconstpointer ap, gconstpointer bp, gpointer up)
 {
     const QSPEntry *a = ap;
@@ -661,6 +679,7 @@ static char *qsp_at(const QSPCallSite *callsite)
 struct QSPReportEntry {
     const void *obj;
     char *callsite_at;
+    char *name;
     const char *typename;
     double time_s;
     double ns_avg;
@@ -698,6 +717,39 @@ static gboolean qsp_tree_report(gpointer key, gpointer value, gpointer udata)
     return FALSE;
 }
 
+/*
+ * Copy the names set with qsp_set_name() into the report.  Only the copy is
+ * done with qsp_names_lock held, so that threads that are creating or
+ * destroying named objects are not held up while the report is formatted.
+ * Coalesced call sites (@n_objs > 1) do not refer to a single object and
+ * are left unnamed.
+ */
+static void qsp_report_get_names(QSPReport *rep)
+{
+    size_t i;
+
+    qemu_spin_lock(&qsp_names_lock);
+    for (i = 0; i < rep->n_entries; i++) {
+        QSPReportEntry *e = &rep->entries[i];
+
+        if (e->n_objs <= 1) {
+            e->name = g_strdup(g_hash_table_lookup(qsp_names, e->obj));
+        }
+    }
+    qemu_spin_unlock(&qsp_names_lock);
+
+    for (i = 0; i < rep->n_entries; i++) {
+        QSPReportEntry *e = &rep->entries[i];
+        char *at;
+
+        if (e->name) {
+            at = g_strdup_printf("%s (%s)", e->callsite_at, e->name);
+            g_free(e->callsite_at);
+            e->callsite_at = at;
+        }
+    }
+}
+
 static void pr_report(const QSPReport *rep)
 {
     char *dashes;
@@ -761,6 +813,7 @@ static void report_destroy(QSPReport *rep)
         QSPReportEntry *e = &rep->entries[i];
 
         g_free(e->callsite_at);
+        g_free(e->name);
     }
     g_free(rep->entries);
 }
@@ -780,6 +833,7 @@ void qsp_report(size_t max, enum QSPSortBy sort_by,
     qsp_mktree(tree, callsite_coalesce);
     g_tree_foreach(tree, qsp_tree_report, &rep);
     g_tree_destroy(tree);
+    qsp_report_get_names(&rep);
 
     pr_report(&rep);
     report_destroy(&rep);